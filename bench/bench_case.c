@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/*
+ * A `while read` loop dispatching each line through a 200-arm case: all
+ * literal arms (one hash probe), then the same keys as patterns, which are
+ * compiled at parse time and tried in order.
+ * Usage: bench_case [LINES]
+ * SHELL_BIN is the path of the 42sh binary, set by the build.
+ */
+
+#define ARMS 200
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static double run(const char *script)
+{
+    double t0 = now_ms();
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl(SHELL_BIN, SHELL_BIN, "-c", script, (char *)NULL);
+        _exit(127);
+    }
+    int ws;
+    waitpid(pid, &ws, 0);
+    if (!WIFEXITED(ws) || WEXITSTATUS(ws) != 0)
+        fprintf(stderr, "bench_case: script failed\n");
+    return now_ms() - t0;
+}
+
+static void write_input(const char *path, int n)
+{
+    FILE *f = fopen(path, "w");
+    if (!f)
+        exit(1);
+    for (int i = 0; i < n; i++)
+        fprintf(f, "key%d\n", (i * 7) % ARMS);
+    fclose(f);
+}
+
+/* suffix is "" for literal arms, "*" for prefix patterns */
+static char *make_script(const char *in, const char *suffix)
+{
+    size_t cap = 64 * ARMS + 256;
+    char *s = malloc(cap);
+    if (!s)
+        exit(1);
+    size_t len = (size_t)snprintf(s, cap, "n=0; while read k; do case $k in\n");
+    for (int i = ARMS - 1; i >= 0; i--)
+        len += (size_t)snprintf(s + len, cap - len, "key%d%s) n=%d;;\n", i, suffix, i);
+    snprintf(s + len, cap - len, "esac; done < %s", in);
+    return s;
+}
+
+int main(int argc, char **argv)
+{
+    int n = argc > 1 ? atoi(argv[1]) : 200000;
+    char in[64];
+    snprintf(in, sizeof(in), "/tmp/bench_case_in_%d", (int)getpid());
+    write_input(in, n);
+
+    char *lit = make_script(in, "");
+    char *pat = make_script(in, "*");
+    double t_lit = run(lit);
+    double t_pat = run(pat);
+
+    printf("case with %d arms, %d lines\n", ARMS, n);
+    printf("  literal arms: %9.1f ms  %8.0f ns/line\n", t_lit, t_lit * 1e6 / n);
+    printf("  pattern arms: %9.1f ms  %8.0f ns/line\n", t_pat, t_pat * 1e6 / n);
+    free(lit);
+    free(pat);
+    unlink(in);
+    return 0;
+}
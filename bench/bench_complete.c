@@ -0,0 +1,85 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "expand/cmdtable.h"
+
+/*
+ * Command completion over a PATH of many executables: one full build,
+ * then prefix lookups as a keypress would do them, then lookups right
+ * after a new executable appears.
+ * Usage: bench_complete [EXECUTABLES]
+ */
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void make_exec(const char *dir, const char *name)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0755);
+    if (fd >= 0)
+        close(fd);
+}
+
+int main(int argc, char **argv)
+{
+    int n = argc > 1 ? atoi(argv[1]) : 10000;
+    char dir[64];
+    snprintf(dir, sizeof(dir), "/tmp/bench_complete_%d", (int)getpid());
+    char cmd[256];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s && mkdir -p %s", dir, dir);
+    if (system(cmd) != 0)
+        return 1;
+    char name[64];
+    for (int i = 0; i < n; i++) {
+        snprintf(name, sizeof(name), "tool-%c%c-%d", 'a' + i % 26, 'a' + i / 26 % 26, i);
+        make_exec(dir, name);
+    }
+    char *saved = strdup(getenv("PATH") ? getenv("PATH") : "/usr/bin:/bin");
+    setenv("PATH", dir, 1);
+
+    double t0 = now_ms();
+    cmdtable_refresh();
+    double tbuild = now_ms() - t0;
+
+    const char *prefixes[] = { "t", "tool-", "tool-q", "tool-qz", "tool-qz-9", "x" };
+    size_t np = sizeof(prefixes) / sizeof(*prefixes);
+    int rounds = 10000;
+    size_t first, total = 0;
+    t0 = now_ms();
+    for (int r = 0; r < rounds; r++) {
+        const char *p = prefixes[r % np];
+        total += cmdtable_prefix(p, strlen(p), &first);
+    }
+    double tprefix = (now_ms() - t0) / rounds;
+
+    double tupdate = 0;
+    for (int i = 0; i < 100; i++) {
+        snprintf(name, sizeof(name), "fresh-%d", i);
+        make_exec(dir, name);
+        t0 = now_ms();
+        if (!cmdtable_lookup(name))
+            fprintf(stderr, "missed %s\n", name);
+        tupdate += now_ms() - t0;
+    }
+
+    printf("completion over %d executables (%zu matches seen)\n", n, total);
+    printf("  initial build:            %8.3f ms\n", tbuild);
+    printf("  prefix query:             %8.3f ms\n", tprefix);
+    printf("  lookup after a new file:  %8.3f ms\n", tupdate / 100);
+
+    cmdtable_clear();
+    setenv("PATH", saved, 1);
+    free(saved);
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    return system(cmd) != 0;
+}
@@ -0,0 +1,99 @@
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "expand/glob.h"
+#include "expand/dircache.h"
+#include "util/vec.h"
+
+/*
+ * Repeated "*.log" expansion in a large flat directory, as done by a loop
+ * body, against glibc glob(). Usage: bench_glob [ENTRIES] [ITERATIONS]
+ */
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void make_tree(const char *dir, long entries)
+{
+    char path[256];
+    for (long i = 0; i < entries; i++) {
+        snprintf(path, sizeof(path), "%s/f%06ld.%s", dir, i, i % 100 == 0 ? "log" : "dat");
+        int fd = open(path, O_WRONLY | O_CREAT, 0644);
+        if (fd < 0) {
+            perror(path);
+            exit(1);
+        }
+        close(fd);
+    }
+}
+
+static void remove_tree(const char *dir, long entries)
+{
+    char path[256];
+    for (long i = 0; i < entries; i++) {
+        snprintf(path, sizeof(path), "%s/f%06ld.%s", dir, i, i % 100 == 0 ? "log" : "dat");
+        unlink(path);
+    }
+    rmdir(dir);
+}
+
+int main(int argc, char **argv)
+{
+    long entries = argc > 1 ? atol(argv[1]) : 100000;
+    int iters = argc > 2 ? atoi(argv[2]) : 50;
+
+    char dir[] = "/tmp/bench_glob_XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    make_tree(dir, entries);
+    if (chdir(dir) < 0) {
+        perror("chdir");
+        return 1;
+    }
+    usleep(50000); // let the directory mtime settle
+
+    size_t n42 = 0;
+    double t0 = now_ms();
+    struct glob_pat *p = glob_compile("*.log");
+    for (int i = 0; i < iters; i++) {
+        struct vec out;
+        vec_init(&out);
+        n42 = glob_expand(p, &out);
+        for (size_t k = 0; k < out.len; k++)
+            free(vec_get(&out, k));
+        vec_free(&out);
+    }
+    glob_free(p);
+    double t42 = now_ms() - t0;
+
+    size_t nlibc = 0;
+    t0 = now_ms();
+    for (int i = 0; i < iters; i++) {
+        glob_t g;
+        if (glob("*.log", 0, NULL, &g) == 0)
+            nlibc = g.gl_pathc;
+        globfree(&g);
+    }
+    double tlibc = now_ms() - t0;
+
+    printf("glob \"*.log\" over %ld entries, %d iterations (%zu/%zu matches)\n",
+           entries, iters, n42, nlibc);
+    printf("  42sh glob:  %9.2f ms total, %7.3f ms/iter\n", t42, t42 / iters);
+    printf("  glibc glob: %9.2f ms total, %7.3f ms/iter\n", tlibc, tlibc / iters);
+
+    dircache_clear();
+    remove_tree(dir, entries);
+    return n42 != nlibc;
+}
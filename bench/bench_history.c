@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "history/history.h"
+
+/*
+ * Reverse search in a large history: the first search scans and indexes
+ * every block, the next ones skip blocks through the trigram filters.
+ * Usage: bench_history [ENTRIES]
+ */
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static const char *const cmds[] = {
+    "ls -la %d", "cd /srv/app%d", "git log --oneline -n %d", "make -j%d",
+    "grep -rn TODO src/%d", "ssh host%d.example", "tail -f /var/log/app%d.log",
+};
+
+int main(int argc, char **argv)
+{
+    int n = argc > 1 ? atoi(argv[1]) : 1000000;
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/bench_history_%d", (int)getpid());
+    unlink(path);
+    if (history_open(path) < 0)
+        return 1;
+
+    double t0 = now_ms();
+    char line[128];
+    for (int i = 0; i < n; i++) {
+        snprintf(line, sizeof(line), cmds[i % 7], i);
+        history_add(line, strlen(line));
+    }
+    history_add("rsync -a backup/ vault:", 23);
+    for (int i = 0; i < 1000; i++) {
+        snprintf(line, sizeof(line), cmds[i % 7], i);
+        history_add(line, strlen(line));
+    }
+    double tadd = now_ms() - t0;
+
+    const char *q = "vault:";
+    size_t pos, len;
+    double times[3];
+    for (int r = 0; r < 3; r++) {
+        pos = HISTORY_END;
+        t0 = now_ms();
+        // search down to the oldest entry: every block is visited
+        while (history_search(q, strlen(q), &pos, &len))
+            ;
+        times[r] = now_ms() - t0;
+    }
+
+    printf("history of %d entries (%.0f ms to append)\n", n + 1001, tadd);
+    printf("  first full search (indexes): %8.2f ms\n", times[0]);
+    printf("  indexed full search:         %8.2f ms\n", (times[1] + times[2]) / 2);
+    history_close();
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include "lexer/lexer.h"
+#include "util/str.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Tokenizes a machine-generated script held in memory: long plain words
+ * (paths, flags), quoted strings and parameters, as build tools emit them.
+ * Usage: bench_lexer [MB]
+ */
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void make_script(struct str *s, size_t bytes)
+{
+    char line[512];
+    for (int i = 0; s->len < bytes; i++) {
+        int n = snprintf(line, sizeof(line),
+                         "/usr/lib/toolchain/bin/compiler-driver --target=x86_64-linux-gnu "
+                         "-I/build/output/include/generated/module_%d -DCONFIG_VALUE=%d "
+                         "-o /build/output/objects/module_%d/source_file_%d.o "
+                         "\"$SRCDIR/module_%d/source file %d.c\" 2>>/build/logs/errors.log\n",
+                         i % 97, i, i % 97, i, i % 97, i);
+        str_appendn(s, line, (size_t)n);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t mb = argc > 1 ? (size_t)atoi(argv[1]) : 64;
+    struct str script;
+    str_init(&script);
+    make_script(&script, mb << 20);
+
+    double best = 0;
+    size_t tokens = 0;
+    for (int round = 0; round < 3; round++) {
+        struct lexer lx;
+        lexer_init_mem(&lx, script.buf, script.len);
+        double t0 = now_ms();
+        tokens = 0;
+        for (;;) {
+            struct token t = lexer_next(&lx);
+            if (t.type == TOK_EOF)
+                break;
+            token_free(&t);
+            tokens++;
+        }
+        double ms = now_ms() - t0;
+        lexer_destroy(&lx);
+        if (round == 0 || ms < best)
+            best = ms;
+    }
+
+    printf("lexer, %.1f MB script, %zu tokens\n", script.len / 1048576.0, tokens);
+    printf("  %9.1f ms  %6.2f GB/s  %6.1f ns/token\n", best, script.len / best / 1e6,
+           best * 1e6 / tokens);
+    str_free(&script);
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include "lexer/lexer.h"
+#include "parser/parser.h"
+#include "util/str.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Parses a large generated script (a flat list of commands with a few
+ * compound ones) in one pass, then cut into pieces parsed on threads.
+ * Usage: bench_parse [MB] [THREADS]
+ */
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void make_script(struct str *s, size_t bytes)
+{
+    char line[512];
+    for (int i = 0; s->len < bytes; i++) {
+        int n = snprintf(line, sizeof(line),
+                         "cp -p /build/stage/module_%d/out.o /build/dist/lib/mod_%d.o\n"
+                         "if test -f /build/stage/module_%d/extra; then\n"
+                         "    install -m 644 \"/build/stage/module_%d/extra\" /build/dist/share\n"
+                         "fi\n",
+                         i % 97, i % 89, i % 97, i % 97);
+        str_appendn(s, line, (size_t)n);
+    }
+}
+
+static double run(const struct str *script, int threads)
+{
+    struct lexer lx;
+    lexer_init_mem(&lx, script->buf, script->len);
+    double t0 = now_ms();
+    struct ast *root = threads ? parse_input_split(&lx, threads) : parse_input(&lx);
+    double ms = now_ms() - t0;
+    ast_free(root);
+    lexer_destroy(&lx);
+    return ms;
+}
+
+int main(int argc, char **argv)
+{
+    size_t mb = argc > 1 ? (size_t)atoi(argv[1]) : 64;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = argc > 2 ? atoi(argv[2]) : ncpu > 1 ? (int)ncpu : 2;
+    struct str script;
+    str_init(&script);
+    make_script(&script, mb << 20);
+
+    run(&script, 0); // command names interned and the heap warm before timing
+    double seq = run(&script, 0);
+    double par = run(&script, threads);
+
+    printf("parse, %.1f MB script, %ld CPUs\n", script.len / 1048576.0, ncpu);
+    printf("  sequential:  %9.1f ms\n", seq);
+    printf("  %2d threads:  %9.1f ms  (x%.2f)\n", threads, par, seq / par);
+    str_free(&script);
+    return 0;
+}
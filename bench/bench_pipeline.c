@@ -0,0 +1,82 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/*
+ * A very long generated pipeline, `echo x | cat | ... | cat`: wall time
+ * from start to the last stage's output, and the most descriptors the
+ * shell held at once, sampled from /proc while it sets the stages up.
+ * Usage: bench_pipeline [STAGES]
+ * SHELL_BIN is the path of the 42sh binary, set by the build.
+ */
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int count_fds(pid_t pid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/fd", (int)pid);
+    DIR *d = opendir(path);
+    if (!d)
+        return -1;
+    int n = 0;
+    struct dirent *de;
+    while ((de = readdir(d)))
+        n += de->d_name[0] != '.';
+    closedir(d);
+    return n;
+}
+
+int main(int argc, char **argv)
+{
+    int stages = argc > 1 ? atoi(argv[1]) : 2000;
+    size_t cap = (size_t)stages * 8 + 16;
+    char *script = malloc(cap);
+    if (!script)
+        return 1;
+    size_t len = (size_t)snprintf(script, cap, "echo x");
+    for (int i = 1; i < stages; i++)
+        len += (size_t)snprintf(script + len, cap - len, " | cat");
+
+    int out[2];
+    if (pipe(out) < 0)
+        return 1;
+    double t0 = now_ms();
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(out[1], STDOUT_FILENO);
+        close(out[0]);
+        close(out[1]);
+        execl(SHELL_BIN, SHELL_BIN, "-c", script, (char *)NULL);
+        _exit(127);
+    }
+    close(out[1]);
+
+    int peak = 0, ws;
+    while (waitpid(pid, &ws, WNOHANG) == 0) {
+        int n = count_fds(pid);
+        if (n > peak)
+            peak = n;
+    }
+    double ms = now_ms() - t0;
+    char buf[16] = { 0 };
+    ssize_t got = read(out[0], buf, sizeof(buf) - 1);
+    close(out[0]);
+    if (got != 2 || strcmp(buf, "x\n") != 0 || !WIFEXITED(ws) || WEXITSTATUS(ws) != 0)
+        fprintf(stderr, "bench_pipeline: pipeline failed\n");
+
+    printf("pipeline of %d stages\n", stages);
+    printf("  total:    %9.1f ms  %8.1f us/stage\n", ms, ms * 1e3 / stages);
+    printf("  peak fds in the shell: %d\n", peak);
+    free(script);
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/*
+ * Generating a CSV with printf in a `while read` loop: the printf builtin
+ * against /usr/bin/printf, a fork and exec per line (timed on fewer lines).
+ * Usage: bench_printf [LINES]
+ * SHELL_BIN is the path of the 42sh binary, set by the build.
+ */
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static double run(const char *script)
+{
+    double t0 = now_ms();
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl(SHELL_BIN, SHELL_BIN, "-c", script, (char *)NULL);
+        _exit(127);
+    }
+    int ws;
+    waitpid(pid, &ws, 0);
+    if (!WIFEXITED(ws) || WEXITSTATUS(ws) != 0)
+        fprintf(stderr, "bench_printf: script failed\n");
+    return now_ms() - t0;
+}
+
+static void write_input(const char *path, int n)
+{
+    FILE *f = fopen(path, "w");
+    if (!f)
+        exit(1);
+    for (int i = 0; i < n; i++)
+        fprintf(f, "%d user%d %d.%02d\n", i, i % 1000, i % 500, i % 100);
+    fclose(f);
+}
+
+static long file_size(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return -1;
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fclose(f);
+    return n;
+}
+
+int main(int argc, char **argv)
+{
+    int n = argc > 1 ? atoi(argv[1]) : 1000000;
+    int n_ext = n < 2000 ? n : 2000;
+    char in[64], in_ext[64], out[64], script[512];
+    snprintf(in, sizeof(in), "/tmp/bench_printf_in_%d", (int)getpid());
+    snprintf(in_ext, sizeof(in_ext), "/tmp/bench_printf_ext_%d", (int)getpid());
+    snprintf(out, sizeof(out), "/tmp/bench_printf_out_%d", (int)getpid());
+    write_input(in, n);
+    write_input(in_ext, n_ext);
+
+    snprintf(script, sizeof(script),
+             "while read id name amount; do printf '%%08d,\"%%s\",%%10.2f\\n' $id $name $amount;"
+             " done < %s > %s", in, out);
+    double builtin = run(script);
+    long size = file_size(out);
+
+    snprintf(script, sizeof(script),
+             "while read id name amount; do /usr/bin/printf '%%08d,\"%%s\",%%10.2f\\n' $id $name"
+             " $amount; done < %s > %s", in_ext, out);
+    double external = run(script);
+
+    printf("printf CSV, %d lines (%.1f MB)\n", n, size / 1e6);
+    printf("  builtin:         %9.1f ms  %8.0f ns/line\n", builtin, builtin * 1e6 / n);
+    printf("  /usr/bin/printf: %9.1f ms  %8.0f ns/line (%d lines)\n", external,
+           external * 1e6 / n_ext, n_ext);
+    unlink(in);
+    unlink(in_ext);
+    unlink(out);
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/*
+ * `while read line; do ...; done` over a large file, with the input as a
+ * redirection of the loop (mapped), as the shell's standard input (block
+ * reads given back with lseek) and through a pipe (byte reads).
+ * Usage: bench_read [LINES]
+ * SHELL_BIN is the path of the 42sh binary, set by the build.
+ */
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* Runs 42sh -c script with stdin from in_fd; returns its duration in ms */
+static double run(const char *script, int in_fd)
+{
+    double t0 = now_ms();
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (in_fd >= 0)
+            dup2(in_fd, 0);
+        execl(SHELL_BIN, SHELL_BIN, "-c", script, (char *)NULL);
+        _exit(127);
+    }
+    int ws;
+    waitpid(pid, &ws, 0);
+    if (!WIFEXITED(ws) || WEXITSTATUS(ws) != 0)
+        fprintf(stderr, "bench_read: script failed\n");
+    return now_ms() - t0;
+}
+
+int main(int argc, char **argv)
+{
+    int n = argc > 1 ? atoi(argv[1]) : 1000000;
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/bench_read_%d", (int)getpid());
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return 1;
+    for (int i = 0; i < n; i++)
+        fprintf(f, "%d field%d some more text on the line\n", i, i % 97);
+    long size = ftell(f);
+    fclose(f);
+
+    char script[256];
+    snprintf(script, sizeof(script), "while read n rest; do true; done < %s", path);
+    double mapped = run(script, -1);
+
+    int fd = open(path, O_RDONLY);
+    double seek = run("while read n rest; do true; done", fd);
+    close(fd);
+
+    int p[2];
+    if (pipe(p) < 0)
+        return 1;
+    pid_t cat = fork();
+    if (cat == 0) {
+        dup2(p[1], 1);
+        close(p[0]);
+        execlp("cat", "cat", path, (char *)NULL);
+        _exit(127);
+    }
+    close(p[1]);
+    double piped = run("while read n rest; do true; done", p[0]);
+    close(p[0]);
+    waitpid(cat, NULL, 0);
+
+    printf("read loop over %d lines (%.1f MB)\n", n, size / 1e6);
+    printf("  loop redirection (mapped): %8.1f ms  %6.0f ns/line\n", mapped, mapped * 1e6 / n);
+    printf("  seekable stdin (lseek):    %8.1f ms  %6.0f ns/line\n", seek, seek * 1e6 / n);
+    printf("  pipe (byte reads):         %8.1f ms  %6.0f ns/line\n", piped, piped * 1e6 / n);
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "executer/events.h"
+
+/*
+ * Reaping many concurrent children that end in reverse creation order:
+ * the event loop against waitpid() in creation order.
+ * Usage: bench_reap [CHILDREN]
+ */
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static double cpu_ms(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec * 1e3 + ru.ru_utime.tv_usec / 1e3 + ru.ru_stime.tv_sec * 1e3
+         + ru.ru_stime.tv_usec / 1e3;
+}
+
+// child i lives (n - i) * 100us, so the first one created ends last
+static void spawn_all(pid_t *pids, int n)
+{
+    for (int i = 0; i < n; i++) {
+        pids[i] = fork();
+        if (pids[i] == 0) {
+            usleep((useconds_t)(n - i) * 100);
+            _exit(i & 0x7f);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int n = argc > 1 ? atoi(argv[1]) : 2000;
+    pid_t *pids = malloc(n * sizeof(pid_t));
+    int *statuses = malloc(n * sizeof(int));
+    if (!pids || !statuses)
+        return 1;
+
+    int bad = 0;
+    spawn_all(pids, n);
+    double t0 = now_ms(), c0 = cpu_ms();
+    events_wait_children(pids, n, statuses, -1);
+    double tloop = now_ms() - t0, cloop = cpu_ms() - c0;
+    for (int i = 0; i < n; i++)
+        bad += !WIFEXITED(statuses[i]) || WEXITSTATUS(statuses[i]) != (i & 0x7f);
+
+    spawn_all(pids, n);
+    t0 = now_ms();
+    c0 = cpu_ms();
+    for (int i = 0; i < n; i++) {
+        waitpid(pids[i], &statuses[i], 0);
+        bad += !WIFEXITED(statuses[i]) || WEXITSTATUS(statuses[i]) != (i & 0x7f);
+    }
+    double tseq = now_ms() - t0, cseq = cpu_ms() - c0;
+
+    printf("reaping %d children (%d wrong statuses)\n", n, bad);
+    printf("  event loop:       %9.2f ms wall, %7.2f ms cpu\n", tloop, cloop);
+    printf("  waitpid in order: %9.2f ms wall, %7.2f ms cpu\n", tseq, cseq);
+    free(pids);
+    free(statuses);
+    return bad != 0;
+}
@@ -0,0 +1,81 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "server/server.h"
+
+/*
+ * Per-script latency of a persistent `42sh --server` against starting a
+ * fresh 42sh for every script. Usage: bench_server [ITERATIONS]
+ * SHELL_BIN is the path of the 42sh binary, set by the build.
+ */
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static pid_t spawn(char **argv, int devnull)
+{
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(devnull, 1);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    return pid;
+}
+
+int main(int argc, char **argv)
+{
+    int iters = argc > 1 ? atoi(argv[1]) : 2000;
+    const char *script = "echo hello\n";
+
+    char sock[64];
+    snprintf(sock, sizeof(sock), "/tmp/bench_server_%d.sock", (int)getpid());
+    int devnull = open("/dev/null", O_WRONLY);
+    if (devnull < 0) {
+        perror("/dev/null");
+        return 1;
+    }
+
+    char *srv_argv[] = { SHELL_BIN, "--server", sock, NULL };
+    pid_t srv = spawn(srv_argv, devnull);
+    struct stat st;
+    for (int i = 0; i < 200 && stat(sock, &st) < 0; i++)
+        usleep(10000);
+
+    int fds[3] = { 0, devnull, 2 };
+    char *args[] = { "bench", NULL };
+    int failures = 0;
+    double t0 = now_ms();
+    for (int i = 0; i < iters; i++)
+        failures += client_request(sock, script, strlen(script), 1, args, fds) != 0;
+    double tsrv = now_ms() - t0;
+
+    char *run_argv[] = { SHELL_BIN, "-c", (char *)script, NULL };
+    t0 = now_ms();
+    for (int i = 0; i < iters; i++) {
+        int ws;
+        waitpid(spawn(run_argv, devnull), &ws, 0);
+        failures += !WIFEXITED(ws) || WEXITSTATUS(ws) != 0;
+    }
+    double texec = now_ms() - t0;
+
+    kill(srv, SIGTERM);
+    waitpid(srv, NULL, 0);
+    unlink(sock);
+
+    printf("\"%.*s\", %d runs (%d failures)\n", (int)strlen(script) - 1, script, iters, failures);
+    printf("  42sh --server:  %9.2f ms total, %7.3f ms/run\n", tsrv, tsrv / iters);
+    printf("  fork+exec 42sh: %9.2f ms total, %7.3f ms/run\n", texec, texec / iters);
+    return failures != 0;
+}
@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#include "executer/spawn.h"
+
+/*
+ * Cost of starting /bin/true from a process holding a large heap: plain
+ * fork+exec against the spawn helper forked while the process was small.
+ * Usage: bench_spawn [HEAP_MB] [ITERATIONS]
+ */
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    long heap_mb = argc > 1 ? atol(argv[1]) : 512;
+    int iters = argc > 2 ? atoi(argv[2]) : 500;
+
+    if (spawn_helper_start() < 0) {
+        perror("spawn helper");
+        return 1;
+    }
+
+    // the interpreter's state: touched so every page is really mapped
+    size_t heap_len = (size_t)heap_mb << 20;
+    char *heap = malloc(heap_len);
+    if (!heap) {
+        perror("malloc");
+        return 1;
+    }
+    memset(heap, 1, heap_len);
+
+    char *cmd[] = { "true", NULL };
+    int failures = 0;
+
+    double t0 = now_ms();
+    for (int i = 0; i < iters; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            execvp(cmd[0], cmd);
+            _exit(127);
+        }
+        int ws;
+        waitpid(pid, &ws, 0);
+        failures += ws != 0;
+    }
+    double tfork = now_ms() - t0;
+
+    static const int stdio[3] = { 0, 1, 2 };
+    t0 = now_ms();
+    for (int i = 0; i < iters; i++) {
+        pid_t pid = spawn_helper_spawn(cmd, stdio);
+        failures += pid < 0 || spawn_helper_wait(pid) != 0;
+    }
+    double thelper = now_ms() - t0;
+
+    printf("spawn \"true\" with a %ld MB heap, %d runs (%d failures)\n", heap_mb, iters, failures);
+    printf("  fork+exec:    %9.2f ms total, %7.3f ms/run\n", tfork, tfork / iters);
+    printf("  spawn helper: %9.2f ms total, %7.3f ms/run\n", thelper, thelper / iters);
+    free(heap);
+    return failures != 0;
+}
@@ -0,0 +1,367 @@
+#include "batch.h"
+#include "shell.h"
+#include "lexer/lexer.h"
+#include "parser/parser.h"
+#include "parser/ast.h"
+#include "executer/executer.h"
+#include "executer/optimize.h"
+#include "expand/vars.h"
+#include "util/error.h"
+#include "util/intern.h"
+#include "util/str.h"
+#include "util/vec.h"
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* One distinct script text, parsed once for every job that runs it */
+struct batch_script {
+    char *text;
+    size_t len;
+    size_t hash;
+    struct ast *root;
+    struct str error;       // syntax error, if it did not parse
+};
+
+struct batch_job {
+    char **argv;            // argv[0] is the script path and $0
+    int argc;
+    struct batch_script *script;
+    pid_t pid;
+    double start_ms;
+    double ms;
+    int status;
+};
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int wait_status(int wstatus)
+{
+    if (WIFEXITED(wstatus))
+        return WEXITSTATUS(wstatus);
+    if (WIFSIGNALED(wstatus))
+        return 128 + WTERMSIG(wstatus);
+    return 1;
+}
+
+static char *xstrdup(const char *s)
+{
+    char *d = strdup(s);
+    if (!d)
+        abort();
+    return d;
+}
+
+static void push_job(struct vec *jobs, char **argv, int argc)
+{
+    struct batch_job *j = calloc(1, sizeof(*j));
+    if (!j)
+        abort();
+    j->argv = argv;
+    j->argc = argc;
+    vec_push(jobs, j);
+}
+
+/* ---------- job list ---------- */
+
+static int cmp_names(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int load_dir(const char *path, struct vec *jobs)
+{
+    DIR *d = opendir(path);
+    if (!d)
+        return -1;
+    struct vec names;
+    vec_init(&names);
+    struct dirent *de;
+    while ((de = readdir(d))) {
+        struct str full;
+        str_init(&full);
+        str_append(&full, path);
+        str_pushc(&full, '/');
+        str_append(&full, de->d_name);
+        struct stat st;
+        if (de->d_name[0] != '.' && stat(full.buf, &st) == 0 && S_ISREG(st.st_mode))
+            vec_push(&names, str_take(&full));
+        else
+            str_free(&full);
+    }
+    closedir(d);
+
+    qsort(names.data, names.len, sizeof(void *), cmp_names);
+    for (size_t i = 0; i < names.len; i++) {
+        char **argv = calloc(2, sizeof(char *));
+        if (!argv)
+            abort();
+        argv[0] = vec_get(&names, i);
+        push_job(jobs, argv, 1);
+    }
+    vec_free(&names);
+    return 0;
+}
+
+static int load_manifest(const char *path, struct vec *jobs)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return -1;
+    char *line = NULL;
+    size_t cap = 0;
+    while (getline(&line, &cap, f) > 0) {
+        struct vec words;
+        vec_init(&words);
+        char *save;
+        for (char *w = strtok_r(line, " \t\n", &save); w; w = strtok_r(NULL, " \t\n", &save))
+            vec_push(&words, xstrdup(w));
+        if (words.len == 0 || ((char *)vec_get(&words, 0))[0] == '#') {
+            for (size_t i = 0; i < words.len; i++)
+                free(vec_get(&words, i));
+            vec_free(&words);
+            continue;
+        }
+        vec_push(&words, NULL);
+        push_job(jobs, (char **)words.data, (int)words.len - 1);
+    }
+    free(line);
+    fclose(f);
+    return 0;
+}
+
+/* ---------- shared parsing ---------- */
+
+static void record_error(void *ctx, int line, int col, const char *msg)
+{
+    struct batch_script *s = ctx;
+    char pos[64];
+    snprintf(pos, sizeof(pos), " at %d:%d\n", line, col);
+    str_append(&s->error, "42sh: ");
+    str_append(&s->error, msg);
+    str_append(&s->error, pos);
+}
+
+static void parse_script(struct batch_script *s)
+{
+    struct lexer lx;
+    lexer_init_mem(&lx, s->text, s->len);
+    jmp_buf env;
+    syntax_error_set_reporter(record_error, s);
+    if (setjmp(env) == 0) {
+        syntax_error_set_recover(&env);
+        s->root = parse_input(&lx);
+    }
+    syntax_error_set_recover(NULL);
+    syntax_error_set_reporter(NULL, NULL);
+    lexer_destroy(&lx);
+}
+
+static char *read_file(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return NULL;
+    struct str all;
+    str_init(&all);
+    char chunk[8192];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+        str_appendn(&all, chunk, n);
+    fclose(f);
+    *len = all.len;
+    return str_take(&all);
+}
+
+/* Jobs running the same text, whatever its path, share one parse */
+static struct batch_script *script_for(struct vec *scripts, const char *path, int optimize)
+{
+    size_t len;
+    char *text = read_file(path, &len);
+    if (!text)
+        return NULL;
+    size_t h = intern_hash_bytes(text, len);
+    for (size_t i = 0; i < scripts->len; i++) {
+        struct batch_script *s = vec_get(scripts, i);
+        if (s->hash == h && s->len == len && memcmp(s->text, text, len) == 0) {
+            free(text);
+            return s;
+        }
+    }
+
+    struct batch_script *s = calloc(1, sizeof(*s));
+    if (!s)
+        abort();
+    s->text = text;
+    s->len = len;
+    s->hash = h;
+    str_init(&s->error);
+    parse_script(s);
+    if (optimize)
+        s->root = optimize_ast(s->root);
+    vec_push(scripts, s);
+    return s;
+}
+
+/* ---------- workers ---------- */
+
+static int open_output(const char *outdir, size_t n, const char *ext)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%zu.%s", outdir, n, ext);
+    return open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+}
+
+static void run_job(struct batch_job *j, size_t n, const char *outdir)
+{
+    int out = open_output(outdir, n, "out");
+    int err = open_output(outdir, n, "err");
+    int in = open("/dev/null", O_RDONLY);
+    if (out < 0 || err < 0 || in < 0)
+        _exit(126);
+    dup2(in, 0);
+    dup2(out, 1);
+    dup2(err, 2);
+    close(in);
+
+    struct batch_script *s = j->script;
+    if (!s) {
+        fprintf(stderr, "42sh: cannot open file: %s\n", j->argv[0]);
+        _exit(SHELL_ERR_CLI);
+    }
+    if (s->error.len) {
+        fwrite(s->error.buf, 1, s->error.len, stderr);
+        _exit(SHELL_ERR_SYNTAX);
+    }
+    vars_set_positional(j->argc, j->argv);
+    int status = s->root ? exec_ast_final(s->root) : 0;
+    fflush(stdout);
+    fflush(stderr);
+    _exit(status);
+}
+
+static int start_job(struct batch_job *j, size_t n, const char *outdir)
+{
+    fflush(NULL);
+    j->start_ms = now_ms();
+    j->pid = fork();
+    if (j->pid == 0)
+        run_job(j, n, outdir);
+    return j->pid < 0 ? -1 : 0;
+}
+
+static void print_summary(FILE *out, struct vec *jobs)
+{
+    fprintf(out, "%6s %6s %10s  %s\n", "job", "status", "ms", "script");
+    for (size_t i = 0; i < jobs->len; i++) {
+        struct batch_job *j = vec_get(jobs, i);
+        fprintf(out, "%6zu %6d %10.2f ", i + 1, j->status, j->ms);
+        for (int a = 0; a < j->argc; a++)
+            fprintf(out, " %s", j->argv[a]);
+        fputc('\n', out);
+    }
+    fflush(out);
+}
+
+static void free_all(struct vec *jobs, struct vec *scripts)
+{
+    for (size_t i = 0; i < jobs->len; i++) {
+        struct batch_job *j = vec_get(jobs, i);
+        for (int a = 0; a < j->argc; a++)
+            free(j->argv[a]);
+        free(j->argv);
+        free(j);
+    }
+    for (size_t i = 0; i < scripts->len; i++) {
+        struct batch_script *s = vec_get(scripts, i);
+        ast_free(s->root);
+        str_free(&s->error);
+        free(s->text);
+        free(s);
+    }
+    vec_free(jobs);
+    vec_free(scripts);
+}
+
+int batch_run(const char *source, const char *outdir, int jobs, int optimize, FILE *summary)
+{
+    struct vec list, scripts;
+    vec_init(&list);
+    vec_init(&scripts);
+
+    struct stat st;
+    int rc = stat(source, &st) == 0 && S_ISDIR(st.st_mode) ? load_dir(source, &list)
+                                                             : load_manifest(source, &list);
+    if (rc < 0) {
+        fprintf(stderr, "42sh: cannot read batch: %s: %s\n", source, strerror(errno));
+        return SHELL_ERR_CLI;
+    }
+    if (mkdir(outdir, 0755) < 0 && errno != EEXIST) {
+        fprintf(stderr, "42sh: cannot create %s: %s\n", outdir, strerror(errno));
+        free_all(&list, &scripts);
+        return SHELL_ERR_CLI;
+    }
+
+    // parse everything before the first fork so workers inherit the trees
+    for (size_t i = 0; i < list.len; i++) {
+        struct batch_job *j = vec_get(&list, i);
+        j->script = script_for(&scripts, j->argv[0], optimize);
+    }
+
+    // jobs in flight, so an exit is matched without scanning the whole batch
+    struct batch_job **slots = calloc(jobs, sizeof(*slots));
+    if (!slots)
+        abort();
+    size_t next = 0, running = 0;
+    int failed = 0;
+    while (next < list.len || running > 0) {
+        if (next < list.len && running < (size_t)jobs) {
+            struct batch_job *j = vec_get(&list, next);
+            next++;
+            if (start_job(j, next, outdir) < 0) {
+                perror("42sh: fork");
+                j->status = 126;
+                failed = 1;
+            } else {
+                slots[running++] = j;
+            }
+            continue;
+        }
+
+        int ws;
+        pid_t pid = waitpid(-1, &ws, 0);
+        if (pid < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        for (size_t i = 0; i < running; i++) {
+            struct batch_job *j = slots[i];
+            if (j->pid != pid)
+                continue;
+            j->ms = now_ms() - j->start_ms;
+            j->status = wait_status(ws);
+            failed |= j->status != 0;
+            slots[i] = slots[--running];
+            break;
+        }
+    }
+    free(slots);
+
+    print_summary(summary, &list);
+    free_all(&list, &scripts);
+    return failed;
+}
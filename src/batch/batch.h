@@ -0,0 +1,23 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdio.h>
+
+/*
+ * `42sh --batch`: runs many scripts from one process. Each distinct
+ * script is parsed once up front; every job then runs in a forked worker,
+ * at most `jobs` at a time, with stdout and stderr in OUTDIR/N.out and
+ * OUTDIR/N.err (N counts jobs from 1).
+ *
+ * source is a directory (each regular file is a job, in name order) or a
+ * manifest with one job per line: SCRIPT [ARGS...], blank lines and lines
+ * starting with '#' ignored.
+ */
+
+/*
+ * With optimize, each parsed script also goes through optimize_ast once.
+ * Writes a status and duration table to summary; returns 0 if every job exited 0.
+ */
+int batch_run(const char *source, const char *outdir, int jobs, int optimize, FILE *summary);
+
+#endif
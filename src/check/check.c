@@ -0,0 +1,132 @@
+#include "check.h"
+#include "lexer/lexer.h"
+#include "parser/ast.h"
+#include "parser/parser.h"
+#include "shell.h"
+#include "util/arena.h"
+#include "util/error.h"
+#include "util/str.h"
+#include <errno.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct check_result {
+    const char *path;
+    struct str report;      // FILE:LINE:COL: lines, printed once all are done
+    int failed;
+};
+
+struct check_pool {
+    int n;
+    int next;               // next file to take, shared by the workers
+    struct check_result *results;
+};
+
+static void report_error(void *ctx, int line, int col, const char *msg)
+{
+    struct check_result *r = ctx;
+    char pos[64];
+    snprintf(pos, sizeof(pos), ":%d:%d: ", line, col);
+    str_append(&r->report, r->path);
+    str_append(&r->report, pos);
+    str_append(&r->report, msg);
+    str_pushc(&r->report, '\n');
+    r->failed = 1;
+}
+
+static void check_one(struct check_result *r, struct arena *a)
+{
+    FILE *f = fopen(r->path, "r");
+    if (!f) {
+        str_append(&r->report, r->path);
+        str_append(&r->report, ": ");
+        str_append(&r->report, strerror(errno));
+        str_pushc(&r->report, '\n');
+        r->failed = 1;
+        return;
+    }
+
+    struct lexer lx;
+    lexer_init(&lx, f);
+    syntax_error_set_reporter(report_error, r);
+
+    // volatile: read again after a longjmp back here
+    volatile int more = 1;
+    jmp_buf env;
+    while (more) {
+        if (setjmp(env) == 0) {
+            syntax_error_set_recover(&env);
+            parse_input(&lx);
+            more = 0;
+        } else {
+            more = lexer_resync(&lx);
+        }
+        arena_reset(a);
+    }
+
+    syntax_error_set_recover(NULL);
+    syntax_error_set_reporter(NULL, NULL);
+    lexer_destroy(&lx);
+    fclose(f);
+}
+
+static void *worker(void *arg)
+{
+    struct check_pool *pool = arg;
+    struct arena a;
+    arena_init(&a);
+    ast_set_arena(&a);
+
+    int i;
+    while ((i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) < pool->n)
+        check_one(&pool->results[i], &a);
+
+    ast_set_arena(NULL);
+    arena_free(&a);
+    return NULL;
+}
+
+int check_files(char **files, int n, FILE *out)
+{
+    size_t count = n > 0 ? (size_t)n : 0;
+    struct check_pool pool = { n, 0, calloc(count ? count : 1, sizeof(struct check_result)) };
+    if (!pool.results)
+        abort();
+    for (int i = 0; i < n; i++) {
+        pool.results[i].path = files[i];
+        str_init(&pool.results[i].report);
+    }
+
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t nthreads = ncpu > 0 && (size_t)ncpu < count ? (size_t)ncpu : count;
+    pthread_t *threads = calloc(nthreads ? nthreads : 1, sizeof(pthread_t));
+    if (!threads)
+        abort();
+
+    size_t started = 0;
+    for (; started < nthreads; started++)
+        if (pthread_create(&threads[started], NULL, worker, &pool) != 0)
+            break;
+    if (started == 0)
+        worker(&pool); // no threads to be had: check everything here
+    for (size_t t = 0; t < started; t++)
+        pthread_join(threads[t], NULL);
+
+    // reports come out in argument order, whatever thread produced them
+    int status = SHELL_OK;
+    for (int i = 0; i < n; i++) {
+        struct check_result *r = &pool.results[i];
+        if (r->report.len)
+            fwrite(r->report.buf, 1, r->report.len, out);
+        if (r->failed)
+            status = SHELL_ERR_SYNTAX;
+        str_free(&r->report);
+    }
+    fflush(out);
+    free(threads);
+    free(pool.results);
+    return status;
+}
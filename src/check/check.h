@@ -0,0 +1,15 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+/*
+ * `42sh -n FILE...`: lex and parse every file without running anything.
+ * Files are spread over a pool of threads, each with its own lexer and
+ * arena; every syntax error is reported as FILE:LINE:COL: message.
+ */
+
+/* Returns 0 if every file parsed, 2 otherwise */
+int check_files(char **files, int n, FILE *out);
+
+#endif
@@ -3,12 +3,20 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 static void usage(FILE *out)
 {
     fprintf(out, "Usage: 42sh [OPTIONS] [SCRIPT] [ARGUMENTS...]\n");
     fprintf(out, "Options:\n");
-    fprintf(out, "  -c \"SCRIPT\"   read commands from string\n");
+    fprintf(out, "  -c \"SCRIPT\" [NAME [ARGUMENTS...]]   read commands from string\n");
+    fprintf(out, "  -n FILE...                          check syntax only, every error reported\n");
+    fprintf(out, "  --batch [-j N] [-o DIR] MANIFEST|DIR run many scripts, N at a time\n");
+    fprintf(out, "  --zygote                            spawn commands from a helper process\n");
+    fprintf(out, "  --stats                             print work counters as JSON at exit\n");
+    fprintf(out, "  -O                                  optimize scripts before running them\n");
+    fprintf(out, "  --server SOCKET                     serve scripts on a unix socket\n");
+    fprintf(out, "  --client SOCKET [-c ...|SCRIPT]     run a script on a server\n");
 }
 
 static void die_cli(const char *msg)
@@ -37,33 +45,126 @@ static FILE *open_mem_script(const char *s)
 #endif
 }
 
+/* Parses the run options starting at argv[first]; argv[0] is the default $0 */
+static void parse_run(struct cli_ctx *ctx, int argc, char **argv, int first)
+{
+    if (argc > first && strcmp(argv[first], "-c") == 0) {
+        if (argc < first + 2)
+            die_cli("missing argument after -c");
+        ctx->input = open_mem_script(argv[first + 1]);
+        ctx->owns_file = 1;
+        // -c SCRIPT NAME ARGS...: NAME is $0
+        if (argc > first + 2) {
+            ctx->argc = argc - first - 2;
+            ctx->argv = argv + first + 2;
+        }
+        return;
+    }
+
+    if (argc > first) {
+        // treat argv[first] as script file, the rest as $1...
+        ctx->argc = argc - first;
+        ctx->argv = argv + first;
+        ctx->input = fopen(argv[first], "re");
+        if (!ctx->input) {
+            fprintf(stderr, "42sh: cannot open file: %s\n", argv[first]);
+            exit(SHELL_ERR_CLI);
+        }
+        ctx->owns_file = 1;
+        return;
+    }
+
+    ctx->input = stdin;
+    ctx->owns_file = 0;
+}
+
+static void parse_batch(struct cli_ctx *ctx, int argc, char **argv, int first)
+{
+    ctx->mode = CLI_BATCH;
+    for (; argc > first + 1; first += 2) {
+        if (strcmp(argv[first], "-j") == 0) {
+            ctx->jobs = atoi(argv[first + 1]);
+            if (ctx->jobs <= 0)
+                die_cli("-j takes a positive number");
+        } else if (strcmp(argv[first], "-o") == 0) {
+            ctx->outdir = argv[first + 1];
+        } else {
+            break;
+        }
+    }
+    if (argc != first + 1)
+        die_cli("--batch takes one MANIFEST or DIR");
+    if (ctx->jobs == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        ctx->jobs = n > 0 ? (int)n : 1;
+    }
+    ctx->argc = 1;
+    ctx->argv = argv + first;
+}
+
 struct cli_ctx cli_parse(int argc, char **argv)
 {
     struct cli_ctx ctx;
+    ctx.mode = CLI_RUN;
+    ctx.socket_path = NULL;
+    ctx.zygote = 0;
+    ctx.stats = 0;
+    ctx.optimize = 0;
+    ctx.jobs = 0;
+    ctx.outdir = "batch.out";
     ctx.input = NULL;
     ctx.owns_file = 0;
+    ctx.argc = 1;
+    ctx.argv = argv;
 
-    if (argc >= 2 && strcmp(argv[1], "-c") == 0) {
-        if (argc < 3)
-            die_cli("missing argument after -c");
-        ctx.input = open_mem_script(argv[2]);
-        ctx.owns_file = 1;
+    int first = 1;
+    for (; argc > first; first++) {
+        if (strcmp(argv[first], "--zygote") == 0) {
+            ctx.zygote = 1;
+        } else if (strcmp(argv[first], "--stats") == 0) {
+#ifndef SHELL_STATS
+            die_cli("--stats is not available in this build");
+#endif
+            ctx.stats = 1;
+        } else if (strcmp(argv[first], "-O") == 0) {
+            ctx.optimize = 1;
+        } else {
+            break;
+        }
+    }
+
+    if (argc > first && strcmp(argv[first], "-n") == 0) {
+        if (argc < first + 2)
+            die_cli("missing FILE after -n");
+        ctx.mode = CLI_CHECK;
+        ctx.argc = argc - first - 1;
+        ctx.argv = argv + first + 1;
         return ctx;
     }
 
-    if (argc >= 2) {
-        // treat argv[1] as script file (ignore ARGUMENTS for step1)
-        ctx.input = fopen(argv[1], "r");
-        if (!ctx.input) {
-            fprintf(stderr, "42sh: cannot open file: %s\n", argv[1]);
-            exit(SHELL_ERR_CLI);
-        }
-        ctx.owns_file = 1;
+    if (argc > first && strcmp(argv[first], "--batch") == 0) {
+        parse_batch(&ctx, argc, argv, first + 1);
         return ctx;
     }
 
-    ctx.input = stdin;
-    ctx.owns_file = 0;
+    if (argc > first && strcmp(argv[first], "--server") == 0) {
+        if (argc != first + 2)
+            die_cli("--server takes exactly one SOCKET");
+        ctx.mode = CLI_SERVER;
+        ctx.socket_path = argv[first + 1];
+        return ctx;
+    }
+
+    if (argc > first && strcmp(argv[first], "--client") == 0) {
+        if (argc < first + 2)
+            die_cli("missing SOCKET after --client");
+        ctx.mode = CLI_CLIENT;
+        ctx.socket_path = argv[first + 1];
+        parse_run(&ctx, argc, argv, first + 2);
+        return ctx;
+    }
+
+    parse_run(&ctx, argc, argv, first);
     return ctx;
 }
 
@@ -3,9 +3,26 @@
 
 #include <stdio.h>
 
+enum cli_mode {
+    CLI_RUN,           // run a script in this process
+    CLI_SERVER,        // --server SOCKET
+    CLI_CLIENT,        // --client SOCKET, the script runs on the server
+    CLI_CHECK,         // -n FILE...: parse only, files in argc/argv
+    CLI_BATCH,         // --batch [-j N] [-o DIR] MANIFEST|DIR, source in argv[0]
+};
+
 struct cli_ctx {
+    enum cli_mode mode;
+    const char *socket_path;
+    int zygote;        // --zygote: spawn commands through a helper process
+    int stats;         // --stats: print work counters as JSON at exit
+    int optimize;      // -O: fold constant conditions and bind builtins before running
+    int jobs;          // --batch: scripts running at once
+    const char *outdir; // --batch: where N.out and N.err go
     FILE *input;
     int owns_file;     // 1 for fclose()
+    int argc;          // positional parameters, argv[0] is $0
+    char **argv;
 };
 
 struct cli_ctx cli_parse(int argc, char **argv);
@@ -0,0 +1,51 @@
+#include "bind.h"
+#include "builtins.h"
+#include "expand/cmdtable.h"
+#include "util/intern.h"
+#include <string.h>
+
+static int literal_name(const struct ast_simple *s)
+{
+    size_t c = s->assign_len;
+    return s->argv[c] && !(s->words && s->words[c]) && !(s->globs && s->globs[c]);
+}
+
+void bind_command(struct ast_simple *s)
+{
+    if (s->builtin || !literal_name(s))
+        return;
+    int id = builtin_find(s->argv[s->assign_len]);
+    s->builtin = id >= 0 ? id + 1 : -1;
+}
+
+int bind_builtin(struct ast_simple *s, const char *name)
+{
+    bind_command(s);
+    if (s->builtin)
+        return s->builtin > 0 ? s->builtin - 1 : -1;
+    return builtin_find(name); // a name that comes from an expansion
+}
+
+const char *bind_path(struct ast_simple *s, int lookup)
+{
+    bind_command(s);
+    // a prefix assignment may set PATH for this command alone: execvp reads it
+    if (s->builtin >= 0 || s->path_seen < 0 || s->assign_len > 0)
+        return NULL;
+    if (!lookup)
+        return s->path_gen == cmdtable_generation() ? s->path : NULL;
+    const char *name = s->argv[s->assign_len];
+    if (!s->path_seen) {
+        s->path_seen = strchr(name, '/') ? -1 : 1; // a path is run as it is written
+        return NULL;
+    }
+
+    cmdtable_refresh();
+    unsigned long gen = cmdtable_generation();
+    if (s->path_gen != gen) {
+        const char *p = cmdtable_lookup(name);
+        s->path = p ? intern_cstr(p) : NULL;
+        s->path_gen = gen;
+    }
+    return s->path;
+}
@@ -0,0 +1,28 @@
+#ifndef BIND_H
+#define BIND_H
+
+#include "parser/ast.h"
+
+/*
+ * What a simple command with a literal name runs, decided on the node the
+ * first time it runs and reused after: its builtin, or for an external
+ * command the path the command table gives it. The path is looked up
+ * again only when the table's generation moves, which a new $PATH or a
+ * change in one of its directories does.
+ */
+
+/* Sets s->builtin if the command name is literal and it was not bound yet */
+void bind_command(struct ast_simple *s);
+
+/* Builtin id of the command, or -1; name is the expanded command name */
+int bind_builtin(struct ast_simple *s, const char *name);
+
+/*
+ * Full path to exec a bound external command with, or NULL to let execvp
+ * search, as it does for a command with prefix assignments. A command is only looked up from its second run on, so one that
+ * runs once never builds the table. With lookup 0 (in a child, which must
+ * not read the table's events) only a path that is still current is given.
+ */
+const char *bind_path(struct ast_simple *s, int lookup);
+
+#endif
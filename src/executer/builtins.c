@@ -1,6 +1,20 @@
 #include "builtins.h"
+#include "cond.h"
+#include "events.h"
+#include "format.h"
+#include "lineread.h"
+#include "memo.h"
+#include "sys.h"
+#include "expand/vars.h"
+#include "history/history.h"
+#include <sys/wait.h>
+#include <ctype.h>
+#include <errno.h>
+#include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 static void echo_print_escaped(const char *s)
 {
@@ -83,22 +97,328 @@ static int builtin_echo(char **argv)
     return 0;
 }
 
-int try_builtin(char **argv, int *out_status)
+/* DURATION is a number with an optional s, m, h or d suffix; -1 if invalid */
+static long parse_duration_ms(const char *s)
 {
-    if (!argv || !argv[0])
-        return 0;
+    char *end;
+    double v = strtod(s, &end);
+    if (end == s || v < 0)
+        return -1;
+    double scale = 1000;
+    if (*end == 'm')
+        scale = 60 * 1000.0;
+    else if (*end == 'h')
+        scale = 3600 * 1000.0;
+    else if (*end == 'd')
+        scale = 86400 * 1000.0;
+    else if (*end != 's' && *end != '\0')
+        return -1;
+    if (*end && end[1])
+        return -1;
+    return (long)(v * scale);
+}
 
-    if (strcmp(argv[0], "true") == 0) {
-        *out_status = builtin_true(argv);
-        return 1;
+static int parse_signal(const char *s)
+{
+    static const struct {
+        const char *name;
+        int sig;
+    } sigs[] = { { "HUP", SIGHUP }, { "INT", SIGINT }, { "QUIT", SIGQUIT }, { "KILL", SIGKILL },
+                 { "USR1", SIGUSR1 }, { "USR2", SIGUSR2 }, { "ALRM", SIGALRM },
+                 { "TERM", SIGTERM } };
+
+    if (s[0] >= '0' && s[0] <= '9')
+        return atoi(s);
+    if (strncmp(s, "SIG", 3) == 0)
+        s += 3;
+    for (size_t i = 0; i < sizeof(sigs) / sizeof(*sigs); i++) {
+        if (strcmp(s, sigs[i].name) == 0)
+            return sigs[i].sig;
     }
-    if (strcmp(argv[0], "false") == 0) {
-        *out_status = builtin_false(argv);
+    return -1;
+}
+
+static int status_of(int ws)
+{
+    if (ws < 0)
         return 1;
+    if (WIFEXITED(ws))
+        return WEXITSTATUS(ws);
+    return 128 + WTERMSIG(ws);
+}
+
+static int timeout_usage(void)
+{
+    fprintf(stderr, "timeout: usage: timeout [-s SIGNAL] [-k DURATION] DURATION COMMAND\n");
+    return 125;
+}
+
+/* timeout [-s SIGNAL] [-k DURATION] DURATION COMMAND [ARG]... */
+static int builtin_timeout(char **argv)
+{
+    int sig = SIGTERM;
+    long kill_after = -1;
+    int i = 1;
+    while (argv[i] && argv[i + 1] && argv[i][0] == '-') {
+        if (strcmp(argv[i], "-s") == 0) {
+            if ((sig = parse_signal(argv[i + 1])) < 0)
+                return timeout_usage();
+        } else if (strcmp(argv[i], "-k") == 0) {
+            if ((kill_after = parse_duration_ms(argv[i + 1])) < 0)
+                return timeout_usage();
+        } else {
+            break;
+        }
+        i += 2;
+    }
+    long limit = argv[i] ? parse_duration_ms(argv[i]) : -1;
+    if (limit < 0 || !argv[i + 1])
+        return timeout_usage();
+
+    fflush(stdout);
+    pid_t pid = sys_fork(STATS_BUILTINS);
+    if (pid < 0) {
+        perror("fork");
+        return 125;
+    }
+    if (pid == 0) {
+        sys_execvp(STATS_BUILTINS, argv[i + 1], argv + i + 1);
+        int err = errno;
+        perror(argv[i + 1]);
+        _exit(err == ENOENT ? 127 : 126);
+    }
+
+    // a zero duration disables the timeout, as in coreutils
+    int ws;
+    if (!events_wait_children(&pid, 1, &ws, limit > 0 ? (int)limit : -1))
+        return status_of(ws);
+
+    kill(pid, sig);
+    if (kill_after >= 0 && events_wait_children(&pid, 1, &ws, (int)kill_after)) {
+        kill(pid, SIGKILL);
+        events_wait_children(&pid, 1, &ws, -1);
+        return 128 + SIGKILL;
     }
-    if (strcmp(argv[0], "echo") == 0) {
-        *out_status = builtin_echo(argv);
+    if (kill_after < 0)
+        events_wait_children(&pid, 1, &ws, -1);
+    return 124;
+}
+
+/* history [N]: the last N entries, oldest first; history -s TEXT: matches, newest first */
+static int builtin_history(char **argv)
+{
+    if (!history_is_open() && history_open(NULL) < 0) {
+        perror("42sh: history");
         return 1;
     }
+
+    size_t pos = HISTORY_END, len;
+    const char *e;
+    if (argv[1] && strcmp(argv[1], "-s") == 0) {
+        if (!argv[2]) {
+            fprintf(stderr, "42sh: history: -s needs a search text\n");
+            return 2;
+        }
+        int found = 0;
+        while ((e = history_search(argv[2], strlen(argv[2]), &pos, &len))) {
+            printf("%.*s\n", (int)len, e);
+            found = 1;
+        }
+        return !found;
+    }
+
+    size_t want = argv[1] ? strtoul(argv[1], NULL, 10) : (size_t)-1;
+    size_t n = 0, cap = 0;
+    size_t *starts = NULL;
+    while (n < want && history_prev(&pos, &len)) {
+        if (n == cap) {
+            cap = cap ? cap * 2 : 64;
+            starts = realloc(starts, cap * sizeof(*starts));
+            if (!starts)
+                abort();
+        }
+        starts[n++] = pos;
+    }
+    while (n-- > 0)
+        if ((e = history_entry(starts[n], &len)))
+            printf("%.*s\n", (int)len, e);
+    free(starts);
+    return 0;
+}
+
+/* read state reused across calls: the loop body runs once per line */
+static struct str read_raw;
+static struct str read_text;
+static struct str read_escaped;  // 1 where read_text has a backslash-quoted byte
+
+/* Unquotes one line into read_text; returns 1 if it ended in a line continuation */
+static int read_unquote(const char *p, size_t n, int raw)
+{
+    for (size_t i = 0; i < n; i++) {
+        char esc = 0;
+        if (!raw && p[i] == '\\') {
+            if (++i == n)
+                return 1;
+            esc = 1;
+        }
+        str_pushc(&read_text, p[i]);
+        str_pushc(&read_escaped, esc);
+    }
     return 0;
 }
+
+static int read_is_ifs(const unsigned char *ifs, size_t i)
+{
+    return ifs[(unsigned char)read_text.buf[i]] && !read_escaped.buf[i];
+}
+
+static int read_is_ws(const unsigned char *ifs, size_t i)
+{
+    char c = read_text.buf[i];
+    return read_is_ifs(ifs, i) && (c == ' ' || c == '\t' || c == '\n');
+}
+
+/* Splits read_text on IFS: one field per name, the last name gets the rest */
+static void read_assign(char **names)
+{
+    unsigned char ifs[256] = { 0 };
+    size_t ifs_len;
+    const char *v = vars_lookup("IFS", 3, &ifs_len);
+    if (!v) {
+        v = " \t\n";
+        ifs_len = 3;
+    }
+    for (size_t i = 0; i < ifs_len; i++)
+        ifs[(unsigned char)v[i]] = 1;
+
+    size_t n = read_text.len;
+    size_t p = 0;
+    while (p < n && read_is_ws(ifs, p))
+        p++;
+    while (n > p && read_is_ws(ifs, n - 1))
+        n--;
+
+    for (; *names; names++) {
+        size_t start = p;
+        if (names[1]) {
+            while (p < n && !read_is_ifs(ifs, p))
+                p++;
+        } else {
+            p = n;
+        }
+        vars_set(*names, strlen(*names), read_text.buf + start, p - start);
+
+        // one delimiter: IFS whitespace around at most one other IFS byte
+        while (p < n && read_is_ws(ifs, p))
+            p++;
+        if (p < n && read_is_ifs(ifs, p)) {
+            p++;
+            while (p < n && read_is_ws(ifs, p))
+                p++;
+        }
+    }
+}
+
+static int read_valid_name(const char *s)
+{
+    if (!isalpha((unsigned char)*s) && *s != '_')
+        return 0;
+    while (*++s)
+        if (!isalnum((unsigned char)*s) && *s != '_')
+            return 0;
+    return 1;
+}
+
+/* read [-r] [NAME...]: one line of standard input into variables (REPLY by default) */
+static int builtin_read(char **argv)
+{
+    int raw = 0;
+    int i = 1;
+    for (; argv[i] && argv[i][0] == '-' && argv[i][1]; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        }
+        if (strcmp(argv[i], "-r") != 0) {
+            fprintf(stderr, "42sh: read: usage: read [-r] [NAME...]\n");
+            return 2;
+        }
+        raw = 1;
+    }
+    static char *reply[] = { "REPLY", NULL };
+    char **names = argv[i] ? argv + i : reply;
+    for (char **nm = names; *nm; nm++) {
+        if (!read_valid_name(*nm)) {
+            fprintf(stderr, "42sh: read: '%s': not a valid identifier\n", *nm);
+            return 2;
+        }
+    }
+
+    read_text.len = 0;
+    read_escaped.len = 0;
+    int got;
+    do {
+        read_raw.len = 0;
+        got = line_read(STDIN_FILENO, &read_raw);
+        if (got < 0) {
+            perror("42sh: read");
+            return 2;
+        }
+    } while (read_unquote(read_raw.buf, read_raw.len, raw) && got == 1);
+
+    str_pushc(&read_text, '\0');
+    read_text.len--;
+    read_assign(names);
+    return got == 1 ? 0 : 1;
+}
+
+static const struct {
+    const char *name;
+    int (*fn)(char **argv);
+    int in_place;   // changes no shell state but variables (see builtin_in_place)
+} builtins[BUILTIN_COUNT] = {
+    [BUILTIN_TRUE] = { "true", builtin_true, 1 },
+    [BUILTIN_FALSE] = { "false", builtin_false, 1 },
+    [BUILTIN_ECHO] = { "echo", builtin_echo, 1 },
+    [BUILTIN_TIMEOUT] = { "timeout", builtin_timeout, 0 },
+    [BUILTIN_HISTORY] = { "history", builtin_history, 0 },
+    [BUILTIN_READ] = { "read", builtin_read, 1 },
+    [BUILTIN_PRINTF] = { "printf", builtin_printf, 1 },
+    [BUILTIN_TEST] = { "test", builtin_test, 1 },
+    [BUILTIN_BRACKET] = { "[", builtin_test, 1 },
+    [BUILTIN_MEMO] = { "memo", builtin_memo, 0 },
+};
+
+int builtin_find(const char *name)
+{
+    for (int i = 0; i < BUILTIN_COUNT; i++)
+        if (strcmp(name, builtins[i].name) == 0)
+            return i;
+    return -1;
+}
+
+int builtin_run(int id, char **argv)
+{
+    return builtins[id].fn(argv);
+}
+
+int builtin_in_place(int id)
+{
+    return id >= 0 && id < BUILTIN_COUNT && builtins[id].in_place;
+}
+
+int is_builtin(const char *name)
+{
+    return builtin_find(name) >= 0;
+}
+
+int try_builtin(char **argv, int *out_status)
+{
+    if (!argv || !argv[0])
+        return 0;
+    int id = builtin_find(argv[0]);
+    if (id < 0)
+        return 0;
+    *out_status = builtin_run(id, argv);
+    return 1;
+}
@@ -1,6 +1,33 @@
 #ifndef BUILTINS_H
 #define BUILTINS_H
 
+enum builtin_id {
+    BUILTIN_TRUE,
+    BUILTIN_FALSE,
+    BUILTIN_ECHO,
+    BUILTIN_TIMEOUT,
+    BUILTIN_HISTORY,
+    BUILTIN_READ,
+    BUILTIN_PRINTF,
+    BUILTIN_TEST,
+    BUILTIN_BRACKET,
+    BUILTIN_MEMO,
+    BUILTIN_COUNT
+};
+
+/* Id of the builtin called name, or -1 */
+int builtin_find(const char *name);
+int builtin_run(int id, char **argv);
+
+/*
+ * True if the builtin changes nothing in the shell but variables, so a
+ * subshell may run it without forking. Builtins are left out unless
+ * marked: one that touches the cwd, the umask, traps or open files
+ * (cd, umask, trap, exec) must not be.
+ */
+int builtin_in_place(int id);
+
+int is_builtin(const char *name);
 int try_builtin(char **argv, int *out_status);
 
 #endif
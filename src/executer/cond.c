@@ -0,0 +1,291 @@
+#include "cond.h"
+#include <sys/stat.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct cond {
+    char **args;
+    int len;
+    int pos;
+    const char *name;   // test or [
+    int error;
+    int dry;            // folding: no messages, no look at files or ttys
+    int depends;        // dry run needed the system
+};
+
+static int cond_error(struct cond *c, const char *msg, const char *arg)
+{
+    if (!c->error && !c->dry) {
+        if (arg)
+            fprintf(stderr, "42sh: %s: %s: %s\n", c->name, arg, msg);
+        else
+            fprintf(stderr, "42sh: %s: %s\n", c->name, msg);
+    }
+    c->error = 1;
+    return 0;
+}
+
+static int is_unary(const char *op)
+{
+    return op[0] == '-' && op[1] && !op[2] && strchr("bcdefghknprstuwxzGLOS", op[1]);
+}
+
+static int is_binary(const char *op)
+{
+    static const char *const ops[] = { "=", "==", "!=", "<", ">", "-eq", "-ne", "-gt", "-ge",
+                                       "-lt", "-le", "-nt", "-ot", "-ef", NULL };
+    for (int i = 0; ops[i]; i++)
+        if (strcmp(op, ops[i]) == 0)
+            return 1;
+    return 0;
+}
+
+static long long to_int(struct cond *c, const char *s)
+{
+    char *end;
+    errno = 0;
+    long long v = strtoll(s, &end, 10);
+    while (*end == ' ' || *end == '\t')
+        end++;
+    if (end == s || *end || errno)
+        cond_error(c, "integer expression expected", s);
+    return v;
+}
+
+static int file_test(char op, const char *path)
+{
+    struct stat st;
+    if (op == 'h' || op == 'L')
+        return lstat(path, &st) == 0 && S_ISLNK(st.st_mode);
+    if (op == 'r')
+        return access(path, R_OK) == 0;
+    if (op == 'w')
+        return access(path, W_OK) == 0;
+    if (op == 'x')
+        return access(path, X_OK) == 0;
+    if (stat(path, &st) < 0)
+        return 0;
+    switch (op) {
+    case 'b': return S_ISBLK(st.st_mode);
+    case 'c': return S_ISCHR(st.st_mode);
+    case 'd': return S_ISDIR(st.st_mode);
+    case 'e': return 1;
+    case 'f': return S_ISREG(st.st_mode);
+    case 'g': return (st.st_mode & S_ISGID) != 0;
+    case 'k': return (st.st_mode & S_ISVTX) != 0;
+    case 'p': return S_ISFIFO(st.st_mode);
+    case 's': return st.st_size > 0;
+    case 'u': return (st.st_mode & S_ISUID) != 0;
+    case 'G': return st.st_gid == getegid();
+    case 'O': return st.st_uid == geteuid();
+    case 'S': return S_ISSOCK(st.st_mode);
+    default: return 0;
+    }
+}
+
+static int unary(struct cond *c, const char *op, const char *arg)
+{
+    switch (op[1]) {
+    case 'n': return arg[0] != '\0';
+    case 'z': return arg[0] == '\0';
+    }
+    if (c->dry) {
+        c->depends = 1;
+        return 0;
+    }
+    if (op[1] == 't')
+        return isatty((int)to_int(c, arg));
+    return file_test(op[1], arg);
+}
+
+static int compare_mtime(const char *a, const char *b, int newer)
+{
+    struct stat sa, sb;
+    int ha = stat(a, &sa) == 0, hb = stat(b, &sb) == 0;
+    if (!ha || !hb)
+        return newer ? ha && !hb : hb && !ha;
+    if (sa.st_mtim.tv_sec != sb.st_mtim.tv_sec)
+        return newer ? sa.st_mtim.tv_sec > sb.st_mtim.tv_sec
+                     : sa.st_mtim.tv_sec < sb.st_mtim.tv_sec;
+    return newer ? sa.st_mtim.tv_nsec > sb.st_mtim.tv_nsec
+                 : sa.st_mtim.tv_nsec < sb.st_mtim.tv_nsec;
+}
+
+static int binary(struct cond *c, const char *a, const char *op, const char *b)
+{
+    if (op[0] == '=')
+        return strcmp(a, b) == 0;
+    if (op[0] == '!')
+        return strcmp(a, b) != 0;
+    if (op[0] == '<')
+        return strcmp(a, b) < 0;
+    if (op[0] == '>')
+        return strcmp(a, b) > 0;
+    if (c->dry && (strcmp(op, "-nt") == 0 || strcmp(op, "-ot") == 0 || strcmp(op, "-ef") == 0)) {
+        c->depends = 1;
+        return 0;
+    }
+    if (strcmp(op, "-nt") == 0 || strcmp(op, "-ot") == 0)
+        return compare_mtime(a, b, op[1] == 'n');
+    if (strcmp(op, "-ef") == 0) {
+        struct stat sa, sb;
+        return stat(a, &sa) == 0 && stat(b, &sb) == 0 && sa.st_dev == sb.st_dev
+               && sa.st_ino == sb.st_ino;
+    }
+
+    long long x = to_int(c, a), y = to_int(c, b);
+    switch (op[1] << 8 | op[2]) {
+    case 'e' << 8 | 'q': return x == y;
+    case 'n' << 8 | 'e': return x != y;
+    case 'g' << 8 | 't': return x > y;
+    case 'g' << 8 | 'e': return x >= y;
+    case 'l' << 8 | 't': return x < y;
+    default: return x <= y;
+    }
+}
+
+/* ---------- long expressions ---------- */
+
+static int parse_or(struct cond *c);
+
+static const char *peek(struct cond *c, int ahead)
+{
+    return c->pos + ahead < c->len ? c->args[c->pos + ahead] : NULL;
+}
+
+static const char *next(struct cond *c)
+{
+    if (c->pos >= c->len) {
+        cond_error(c, "argument expected", NULL);
+        return "";
+    }
+    return c->args[c->pos++];
+}
+
+static int parse_primary(struct cond *c)
+{
+    const char *a = next(c);
+    if (strcmp(a, "!") == 0 && peek(c, 0))
+        return !parse_primary(c);
+    if (strcmp(a, "(") == 0 && peek(c, 0)) {
+        int v = parse_or(c);
+        const char *close = peek(c, 0);
+        if (!close || strcmp(close, ")") != 0)
+            return cond_error(c, "')' expected", NULL);
+        c->pos++;
+        return v;
+    }
+    const char *op = peek(c, 0);
+    if (op && is_binary(op) && peek(c, 1)) {
+        c->pos++;
+        return binary(c, a, op, next(c));
+    }
+    if (is_unary(a) && op)
+        return unary(c, a, next(c));
+    return a[0] != '\0';
+}
+
+static int parse_and(struct cond *c)
+{
+    int v = parse_primary(c);
+    while (peek(c, 0) && strcmp(peek(c, 0), "-a") == 0) {
+        c->pos++;
+        v &= parse_primary(c);
+    }
+    return v;
+}
+
+static int parse_or(struct cond *c)
+{
+    int v = parse_and(c);
+    while (peek(c, 0) && strcmp(peek(c, 0), "-o") == 0) {
+        c->pos++;
+        v |= parse_and(c);
+    }
+    return v;
+}
+
+/* ---------- POSIX rules by argument count ---------- */
+
+static int eval(struct cond *c, char **a, int n);
+
+static int eval3(struct cond *c, char **a)
+{
+    if (is_binary(a[1]))
+        return binary(c, a[0], a[1], a[2]);
+    if (strcmp(a[1], "-a") == 0)
+        return a[0][0] && a[2][0];
+    if (strcmp(a[1], "-o") == 0)
+        return a[0][0] || a[2][0];
+    if (strcmp(a[0], "!") == 0)
+        return !eval(c, a + 1, 2);
+    if (strcmp(a[0], "(") == 0 && strcmp(a[2], ")") == 0)
+        return a[1][0] != '\0';
+    return cond_error(c, "binary operator expected", a[1]);
+}
+
+static int eval(struct cond *c, char **a, int n)
+{
+    switch (n) {
+    case 0:
+        return 0;
+    case 1:
+        return a[0][0] != '\0';
+    case 2:
+        if (strcmp(a[0], "!") == 0)
+            return a[1][0] == '\0';
+        if (is_unary(a[0]))
+            return unary(c, a[0], a[1]);
+        return cond_error(c, "unary operator expected", a[0]);
+    case 3:
+        return eval3(c, a);
+    case 4:
+        if (strcmp(a[0], "!") == 0)
+            return !eval3(c, a + 1);
+        if (strcmp(a[0], "(") == 0 && strcmp(a[3], ")") == 0)
+            return eval(c, a + 1, 2);
+        /* fallthrough */
+    default:
+        c->args = a;
+        c->len = n;
+        c->pos = 0;
+        int v = parse_or(c);
+        if (c->pos < c->len)
+            cond_error(c, "too many arguments", NULL);
+        return v;
+    }
+}
+
+static int run_test(struct cond *c, char **argv)
+{
+    c->name = argv[0];
+    int n = 0;
+    while (argv[n + 1])
+        n++;
+    if (strcmp(argv[0], "[") == 0) {
+        if (n == 0 || strcmp(argv[n], "]") != 0) {
+            cond_error(c, "missing ']'", NULL);
+            return 2;
+        }
+        n--;
+    }
+    int v = eval(c, argv + 1, n);
+    return c->error ? 2 : !v;
+}
+
+int builtin_test(char **argv)
+{
+    struct cond c = { 0 };
+    return run_test(&c, argv);
+}
+
+int test_constant(char **argv)
+{
+    struct cond c = { 0 };
+    c.dry = 1;
+    int st = run_test(&c, argv);
+    return c.depends || c.error ? -1 : st;
+}
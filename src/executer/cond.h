@@ -0,0 +1,15 @@
+#ifndef COND_H
+#define COND_H
+
+/*
+ * test EXPR and [ EXPR ]: file tests through stat/lstat/access, string
+ * and integer comparisons, and !, -a, -o with parentheses. Up to four
+ * arguments follow the POSIX rules by argument count; longer expressions
+ * are parsed with -a binding tighter than -o.
+ */
+int builtin_test(char **argv);
+
+/* Status of a test that only compares its words, or -1 if it needs files, a tty, or fails */
+int test_constant(char **argv);
+
+#endif
@@ -0,0 +1,190 @@
+#include "events.h"
+#include "sys.h"
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define EVENTS_BATCH 64
+#define EVENTS_MAX_WATCH 64     /* pidfds open at once; the next open as these close */
+#define EVENT_SIGNAL UINT64_MAX
+
+/* One loop per process: a forked child that waits builds its own */
+static int epfd = -1;
+static int sigfd = -1;
+static pid_t owner;
+static sigset_t forward;
+
+static int loop_ready(void)
+{
+    pid_t self = getpid();
+    if (epfd >= 0 && owner == self)
+        return 0;
+    if (epfd >= 0) {
+        // inherited across fork: the epoll set is shared with the parent
+        sys_close(STATS_EVENTS, epfd);
+        sys_close(STATS_EVENTS, sigfd);
+        epfd = sigfd = -1;
+    }
+
+    sigemptyset(&forward);
+    sigaddset(&forward, SIGTERM);
+    sigaddset(&forward, SIGHUP);
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0)
+        return -1;
+    sigfd = signalfd(-1, &forward, SFD_CLOEXEC | SFD_NONBLOCK);
+    struct epoll_event ev = { .events = EPOLLIN, .data.u64 = EVENT_SIGNAL };
+    if (sigfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, sigfd, &ev) < 0) {
+        sys_close(STATS_EVENTS, epfd);
+        if (sigfd >= 0)
+            sys_close(STATS_EVENTS, sigfd);
+        epfd = sigfd = -1;
+        return -1;
+    }
+    owner = self;
+    return 0;
+}
+
+int events_pidfd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+static void forward_signals(const pid_t *pids, const int *statuses, size_t n, sigset_t *got)
+{
+    struct signalfd_siginfo si;
+    while (read(sigfd, &si, sizeof(si)) == sizeof(si)) {
+        for (size_t i = 0; i < n; i++) {
+            if (statuses[i] == -1) // not reaped yet, so the pid is still its own
+                kill(pids[i], (int)si.ssi_signo);
+        }
+        sigaddset(got, (int)si.ssi_signo);
+    }
+}
+
+/*
+ * Opens pidfds for the children from *next on, in pipeline order (the
+ * first stages are usually done first), until EVENTS_MAX_WATCH are
+ * watched. A child without a pidfd is left to a plain wait at the end.
+ */
+static size_t watch_more(const pid_t *pids, size_t n, int *pidfds, size_t *next, size_t watched)
+{
+    while (watched < EVENTS_MAX_WATCH && *next < n) {
+        size_t i = (*next)++;
+        pidfds[i] = events_pidfd(pids[i]);
+        if (pidfds[i] < 0)
+            continue;
+        struct epoll_event ev = { .events = EPOLLIN, .data.u64 = i };
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, pidfds[i], &ev) < 0) {
+            sys_close(STATS_EVENTS, pidfds[i]);
+            pidfds[i] = -1;
+            continue;
+        }
+        watched++;
+    }
+    return watched;
+}
+
+int events_wait_children(const pid_t *pids, size_t n, int *statuses, int timeout_ms)
+{
+    if (loop_ready() < 0) {
+        // no epoll: fall back to waiting in order, without a deadline
+        for (size_t i = 0; i < n; i++) {
+            if (sys_waitpid(STATS_EVENTS, pids[i], &statuses[i], 0) < 0)
+                statuses[i] = -1;
+        }
+        return 0;
+    }
+
+    sigset_t old, got;
+    sigemptyset(&got);
+    sigprocmask(SIG_BLOCK, &forward, &old);
+
+    int *pidfds = malloc(n * sizeof(int));
+    if (n && !pidfds)
+        abort();
+    for (size_t i = 0; i < n; i++) {
+        statuses[i] = -1;
+        pidfds[i] = -1;
+    }
+    // every child stays under the loop, and so gets forwarded signals, until reaped
+    size_t next = 0;
+    size_t left = watch_more(pids, n, pidfds, &next, 0);
+
+    int timed_out = 0;
+    long deadline = timeout_ms >= 0 ? now_ms() + timeout_ms : 0;
+    struct epoll_event evs[EVENTS_BATCH];
+    while (left > 0) {
+        int wait_ms = -1;
+        if (timeout_ms >= 0) {
+            long rem = deadline - now_ms();
+            wait_ms = rem > 0 ? (int)rem : 0;
+        }
+        int nev = epoll_wait(epfd, evs, EVENTS_BATCH, wait_ms);
+        if (nev < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (nev == 0) {
+            timed_out = 1;
+            break;
+        }
+        for (int k = 0; k < nev; k++) {
+            uint64_t i = evs[k].data.u64;
+            if (i == EVENT_SIGNAL) {
+                forward_signals(pids, statuses, n, &got);
+                continue;
+            }
+            sys_waitpid(STATS_EVENTS, pids[i], &statuses[i], 0);
+            sys_close(STATS_EVENTS, pidfds[i]); // also drops it from the epoll set
+            pidfds[i] = -1;
+            left--;
+        }
+        left = watch_more(pids, n, pidfds, &next, left);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        if (pidfds[i] >= 0)
+            sys_close(STATS_EVENTS, pidfds[i]);
+        else if (statuses[i] == -1 && !timed_out && sys_waitpid(STATS_EVENTS, pids[i], &statuses[i], 0) < 0)
+            statuses[i] = -1; // no pidfd for it: plain blocking wait
+    }
+    free(pidfds);
+    sigprocmask(SIG_SETMASK, &old, NULL);
+
+    // now the shell itself gets the signals it passed on
+    for (int sig = 1; sig < NSIG; sig++) {
+        if (sigismember(&got, sig) == 1)
+            raise(sig);
+    }
+    return timed_out;
+}
+
+int events_wait_child(pid_t pid)
+{
+    int status;
+    events_wait_children(&pid, 1, &status, -1);
+    return status;
+}
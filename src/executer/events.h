@@ -0,0 +1,28 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * Executer event loop. Children are watched through pidfds in one epoll
+ * set, so waiting for many of them costs one wakeup per exit, in whatever
+ * order they end. SIGTERM and SIGHUP received while waiting come in
+ * through a signalfd and are passed on to the children being waited for,
+ * then acted on by the shell once they are gone.
+ */
+
+/*
+ * Waits for all n children; statuses[i] gets the wait status of pids[i].
+ * timeout_ms < 0 waits forever. Returns 0 once all have ended, 1 if the
+ * deadline passed first (statuses of live children are left at -1).
+ */
+int events_wait_children(const pid_t *pids, size_t n, int *statuses, int timeout_ms);
+
+/* Blocking wait for one child; returns its wait status, -1 on error */
+int events_wait_child(pid_t pid);
+
+/* A pidfd for pid, readable once it exits; -1 where the kernel has none */
+int events_pidfd(pid_t pid);
+
+#endif
@@ -1,18 +1,32 @@
+#define _GNU_SOURCE
+
 #include "executer.h"
+#include "bind.h"
 #include "builtins.h"
+#include "events.h"
+#include "lineread.h"
+#include "spawn.h"
+#include "sys.h"
+#include "expand/casetab.h"
+#include "expand/expand.h"
+#include "expand/glob.h"
+#include "expand/vars.h"
+#include "util/intern.h"
 #include <sys/wait.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <string.h>
 
-static int apply_redirections(struct redirection *redirs, size_t redir_len)
+static int apply_redirections(struct redirection *redirs, size_t redir_len, char **targets)
 {
     for (size_t i = 0; i < redir_len; i++) {
         struct redirection *r = &redirs[i];
+        const char *target = targets ? targets[i] : r->target;
         int fd = r->fd;
         int mode = 0644;
         int target_fd = -1;
@@ -20,185 +34,301 @@ static int apply_redirections(struct redirection *redirs, size_t redir_len)
         switch (r->type) {
             case REDIR_IN:
                 /* < file: read from file */
-                target_fd = open(r->target, O_RDONLY);
+                target_fd = sys_open(STATS_EXECUTER, target, O_RDONLY, 0);
                 if (target_fd < 0) {
-                    perror(r->target);
+                    perror(target);
                     return -1;
                 }
-                if (dup2(target_fd, fd) < 0) {
+                if (sys_dup2(STATS_EXECUTER, target_fd, fd) < 0) {
                     perror("dup2");
-                    close(target_fd);
+                    sys_close(STATS_EXECUTER, target_fd);
                     return -1;
                 }
-                close(target_fd);
+                sys_close(STATS_EXECUTER, target_fd);
                 break;
 
             case REDIR_OUT:
                 /* > file: write to file (truncate) */
-                target_fd = open(r->target, O_WRONLY | O_CREAT | O_TRUNC, mode);
+                target_fd = sys_open(STATS_EXECUTER, target, O_WRONLY | O_CREAT | O_TRUNC, mode);
                 if (target_fd < 0) {
-                    perror(r->target);
+                    perror(target);
                     return -1;
                 }
-                if (dup2(target_fd, fd) < 0) {
+                if (sys_dup2(STATS_EXECUTER, target_fd, fd) < 0) {
                     perror("dup2");
-                    close(target_fd);
+                    sys_close(STATS_EXECUTER, target_fd);
                     return -1;
                 }
-                close(target_fd);
+                sys_close(STATS_EXECUTER, target_fd);
                 break;
 
             case REDIR_APPEND:
                 /* >> file: append to file */
-                target_fd = open(r->target, O_WRONLY | O_CREAT | O_APPEND, mode);
+                target_fd = sys_open(STATS_EXECUTER, target, O_WRONLY | O_CREAT | O_APPEND, mode);
                 if (target_fd < 0) {
-                    perror(r->target);
+                    perror(target);
                     return -1;
                 }
-                if (dup2(target_fd, fd) < 0) {
+                if (sys_dup2(STATS_EXECUTER, target_fd, fd) < 0) {
                     perror("dup2");
-                    close(target_fd);
+                    sys_close(STATS_EXECUTER, target_fd);
                     return -1;
                 }
-                close(target_fd);
+                sys_close(STATS_EXECUTER, target_fd);
                 break;
 
             case REDIR_CLOBBER:
                 /* >| file: write to file, clobber (same as > for our purposes) */
-                target_fd = open(r->target, O_WRONLY | O_CREAT | O_TRUNC, mode);
+                target_fd = sys_open(STATS_EXECUTER, target, O_WRONLY | O_CREAT | O_TRUNC, mode);
                 if (target_fd < 0) {
-                    perror(r->target);
+                    perror(target);
                     return -1;
                 }
-                if (dup2(target_fd, fd) < 0) {
+                if (sys_dup2(STATS_EXECUTER, target_fd, fd) < 0) {
                     perror("dup2");
-                    close(target_fd);
+                    sys_close(STATS_EXECUTER, target_fd);
                     return -1;
                 }
-                close(target_fd);
+                sys_close(STATS_EXECUTER, target_fd);
                 break;
 
             case REDIR_OUT_ERR:
                 /* >& fd_or_file: redirect stdout to fd or file */
                 /* Try to parse as fd number first */
-                if (strcmp(r->target, "-") == 0) {
+                if (strcmp(target, "-") == 0) {
                     /* Special case: close fd */
-                    close(fd);
-                } else if (r->target[0] >= '0' && r->target[0] <= '9') {
-                    int target = atoi(r->target);
-                    if (dup2(target, fd) < 0) {
+                    sys_close(STATS_EXECUTER, fd);
+                } else if (target[0] >= '0' && target[0] <= '9') {
+                    int src_fd = atoi(target);
+                    if (sys_dup2(STATS_EXECUTER, src_fd, fd) < 0) {
                         perror("dup2");
                         return -1;
                     }
                 } else {
                     /* Treat as filename */
-                    target_fd = open(r->target, O_WRONLY | O_CREAT | O_TRUNC, mode);
+                    target_fd = sys_open(STATS_EXECUTER, target, O_WRONLY | O_CREAT | O_TRUNC, mode);
                     if (target_fd < 0) {
-                        perror(r->target);
+                        perror(target);
                         return -1;
                     }
-                    if (dup2(target_fd, fd) < 0) {
+                    if (sys_dup2(STATS_EXECUTER, target_fd, fd) < 0) {
                         perror("dup2");
-                        close(target_fd);
+                        sys_close(STATS_EXECUTER, target_fd);
                         return -1;
                     }
-                    close(target_fd);
+                    sys_close(STATS_EXECUTER, target_fd);
                 }
                 break;
 
             case REDIR_IN_ERR:
                 /* <& fd_or_file: redirect stdin from fd or file */
-                if (strcmp(r->target, "-") == 0) {
-                    close(fd);
-                } else if (r->target[0] >= '0' && r->target[0] <= '9') {
-                    int target = atoi(r->target);
-                    if (dup2(target, fd) < 0) {
+                if (strcmp(target, "-") == 0) {
+                    sys_close(STATS_EXECUTER, fd);
+                } else if (target[0] >= '0' && target[0] <= '9') {
+                    int src_fd = atoi(target);
+                    if (sys_dup2(STATS_EXECUTER, src_fd, fd) < 0) {
                         perror("dup2");
                         return -1;
                     }
                 } else {
-                    target_fd = open(r->target, O_RDONLY);
+                    target_fd = sys_open(STATS_EXECUTER, target, O_RDONLY, 0);
                     if (target_fd < 0) {
-                        perror(r->target);
+                        perror(target);
                         return -1;
                     }
-                    if (dup2(target_fd, fd) < 0) {
+                    if (sys_dup2(STATS_EXECUTER, target_fd, fd) < 0) {
                         perror("dup2");
-                        close(target_fd);
+                        sys_close(STATS_EXECUTER, target_fd);
                         return -1;
                     }
-                    close(target_fd);
+                    sys_close(STATS_EXECUTER, target_fd);
                 }
                 break;
 
             case REDIR_RDWR:
                 /* <> file: open file for both reading and writing */
-                target_fd = open(r->target, O_RDWR | O_CREAT, mode);
+                target_fd = sys_open(STATS_EXECUTER, target, O_RDWR | O_CREAT, mode);
                 if (target_fd < 0) {
-                    perror(r->target);
+                    perror(target);
                     return -1;
                 }
-                if (dup2(target_fd, fd) < 0) {
+                if (sys_dup2(STATS_EXECUTER, target_fd, fd) < 0) {
                     perror("dup2");
-                    close(target_fd);
+                    sys_close(STATS_EXECUTER, target_fd);
                     return -1;
                 }
-                close(target_fd);
+                sys_close(STATS_EXECUTER, target_fd);
                 break;
         }
     }
     return 0;
 }
 
-static int exec_simple(struct ast_simple *simple)
+static int wait_status(int wstatus)
 {
-    char **argv = simple->argv;
-    int st = 0;
+    if (wstatus < 0)
+        return 1;
+    if (WIFEXITED(wstatus))
+        return WEXITSTATUS(wstatus);
+    if (WIFSIGNALED(wstatus))
+        return 128 + WTERMSIG(wstatus);
+    return 1;
+}
 
-    /* If this is a builtin with redirections, we need to fork */
-    if (simple->redir_len > 0 && argv[0]) {
-        int is_builtin_cmd = (strcmp(argv[0], "true") == 0 ||
-                              strcmp(argv[0], "false") == 0 ||
-                              strcmp(argv[0], "echo") == 0);
+/* NAME=value words before the command name, as shell variables */
+static void assign_vars(char **words, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        size_t len = vars_assign_name_len(words[i]);
+        const char *v = words[i] + len + 1;
+        vars_set(words[i], len, v, strlen(v));
+    }
+}
 
-        if (is_builtin_cmd) {
-            /* Fork even for builtin if redirections are present */
-            pid_t pid = fork();
-            if (pid < 0) {
-                perror("fork");
-                return 1;
-            }
+/* In a child about to exec: the assignments only go to its environment */
+static void export_vars(char **words, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        size_t len = vars_assign_name_len(words[i]);
+        setenv(intern(words[i], len), words[i] + len + 1, 1);
+    }
+}
 
-            if (pid == 0) {
-                /* Child process: apply redirections then execute builtin */
-                if (apply_redirections(simple->redirs, simple->redir_len) < 0) {
-                    _exit(1);
-                }
-                if (try_builtin(argv, &st))
-                    _exit(st);
-                _exit(1);
-            }
+/* Previous values of the assigned names, for a builtin's temporary assignments */
+static char **save_vars(char **words, size_t n)
+{
+    char **saved = calloc(n, sizeof(char *));
+    if (!saved)
+        abort();
+    for (size_t i = 0; i < n; i++) {
+        size_t vl;
+        const char *v = vars_lookup(words[i], vars_assign_name_len(words[i]), &vl);
+        if (v && !(saved[i] = strndup(v, vl)))
+            abort();
+    }
+    return saved;
+}
 
-            int wstatus = 0;
-            if (waitpid(pid, &wstatus, 0) < 0) {
-                perror("waitpid");
-                return 1;
-            }
+static void restore_vars(char **words, size_t n, char **saved)
+{
+    for (size_t i = n; i-- > 0;) {
+        size_t len = vars_assign_name_len(words[i]);
+        if (saved[i])
+            vars_set(words[i], len, saved[i], strlen(saved[i]));
+        else
+            vars_unset(words[i], len);
+        free(saved[i]);
+    }
+    free(saved);
+}
 
-            if (WIFEXITED(wstatus))
-                return WEXITSTATUS(wstatus);
-            if (WIFSIGNALED(wstatus))
-                return 128 + WTERMSIG(wstatus);
+struct saved_fd {
+    int fd;
+    int copy;   /* -1 if fd was closed */
+};
 
-            return 1;
+/* Copies of the fds redirs will replace, kept out of the way (>= 10, close-on-exec) */
+static struct saved_fd *save_fds(const struct redirection *redirs, size_t len)
+{
+    struct saved_fd *saved = calloc(len, sizeof(*saved));
+    if (!saved)
+        abort();
+    for (size_t i = 0; i < len; i++) {
+        saved[i].fd = redirs[i].fd;
+        saved[i].copy = fcntl(redirs[i].fd, F_DUPFD_CLOEXEC, 10);
+    }
+    fflush(stdout);
+    return saved;
+}
+
+static void restore_fds(struct saved_fd *saved, size_t len)
+{
+    fflush(stdout);
+    for (size_t i = len; i-- > 0;) {
+        if (saved[i].copy >= 0) {
+            sys_dup2(STATS_EXECUTER, saved[i].copy, saved[i].fd);
+            sys_close(STATS_EXECUTER, saved[i].copy);
+        } else {
+            sys_close(STATS_EXECUTER, saved[i].fd);
         }
     }
+    free(saved);
+}
+
+static int exec_node(struct ast *n, int tail);
+
+/* Only returns on failure; execvp still gets a say if the bound path went away */
+static void exec_external(const char *path, char **argv)
+{
+    if (path)
+        sys_execv(STATS_EXECUTER, path, argv);
+    sys_execvp(STATS_EXECUTER, argv[0], argv);
+}
+
+/* tail: nothing runs after this command, so an external one replaces the shell */
+static int exec_command(struct ast_simple *simple, char **argv, char **targets, int tail)
+{
+    int st = 0;
+    size_t nassign = simple->assign_len;
+    char **assigns = argv;
+    argv += nassign;
+
+    /* Only assignments, or every word expanded to nothing */
+    if (!argv[0]) {
+        assign_vars(assigns, nassign);
+        return 0;
+    }
 
-    /* Check if it's a builtin command (before fork) */
-    if (try_builtin(argv, &st))
+    int id = bind_builtin(simple, argv[0]);
+
+    /* Last in a child: nothing to restore, the redirections can stay */
+    if (tail && id >= 0 && simple->redir_len > 0) {
+        if (apply_redirections(simple->redirs, simple->redir_len, targets) < 0)
+            return 1;
+        assign_vars(assigns, nassign);
+        return builtin_run(id, argv);
+    }
+
+    /* Builtins run in the shell, prefix assignments and redirections only last for the call */
+    if (id >= 0 && (nassign > 0 || simple->redir_len > 0)) {
+        struct saved_fd *fds = save_fds(simple->redirs, simple->redir_len);
+        st = 1;
+        if (apply_redirections(simple->redirs, simple->redir_len, targets) == 0) {
+            char **saved = save_vars(assigns, nassign);
+            assign_vars(assigns, nassign);
+            st = builtin_run(id, argv);
+            restore_vars(assigns, nassign, saved);
+        }
+        restore_fds(fds, simple->redir_len);
         return st;
+    }
+    if (id >= 0)
+        return builtin_run(id, argv);
+
+    if (tail) {
+        if (apply_redirections(simple->redirs, simple->redir_len, targets) < 0)
+            return 1;
+        export_vars(assigns, nassign);
+        fflush(NULL);
+        exec_external(bind_path(simple, 0), argv);
+        perror(argv[0]);
+        return 127;
+    }
+
+    /* The spawn helper only hands over stdio and the shell's environment */
+    if (spawn_helper_active() && simple->redir_len == 0 && nassign == 0) {
+        static const int stdio[3] = { 0, 1, 2 };
+        pid_t hpid = spawn_helper_spawn(argv, stdio);
+        if (hpid >= 0)
+            return wait_status(spawn_helper_wait(hpid));
+        if (spawn_helper_active()) {
+            perror("fork");
+            return 1;
+        }
+    }
 
-    pid_t pid = fork();
+    const char *path = bind_path(simple, 1);
+    pid_t pid = sys_fork(STATS_EXECUTER);
     if (pid < 0) {
         perror("fork");
         return 1;
@@ -206,196 +336,468 @@ static int exec_simple(struct ast_simple *simple)
 
     if (pid == 0) {
         /* Child process: apply redirections then execute */
-        if (apply_redirections(simple->redirs, simple->redir_len) < 0) {
+        if (apply_redirections(simple->redirs, simple->redir_len, targets) < 0) {
             _exit(1);
         }
-        execvp(argv[0], argv);
+        export_vars(assigns, nassign);
+        exec_external(path, argv);
         perror(argv[0]);
         _exit(127);
     }
 
-    int wstatus = 0;
-    if (waitpid(pid, &wstatus, 0) < 0) {
-        perror("waitpid");
-        return 1;
+    return wait_status(events_wait_child(pid));
+}
+
+/* Reused by every simple command; nested calls get their own */
+static struct expand_scratch scratch;
+static int scratch_ready;
+static int scratch_busy;
+
+static struct expand_scratch *scratch_get(struct expand_scratch *local)
+{
+    if (scratch_busy) {
+        expand_scratch_init(local);
+        return local;
+    }
+    if (!scratch_ready) {
+        expand_scratch_init(&scratch);
+        scratch_ready = 1;
     }
+    scratch_busy = 1;
+    return &scratch;
+}
 
-    if (WIFEXITED(wstatus))
-        return WEXITSTATUS(wstatus);
-    if (WIFSIGNALED(wstatus))
-        return 128 + WTERMSIG(wstatus);
+static void scratch_put(struct expand_scratch *sc)
+{
+    expand_release(sc);
+    if (sc == &scratch)
+        scratch_busy = 0;
+    else
+        expand_scratch_free(sc);
+}
 
-    return 1;
+static int exec_simple(struct ast_simple *simple, int tail)
+{
+    if (simple->frozen)
+        return exec_command(simple, simple->argv, NULL, tail);
+
+    struct expand_scratch local;
+    struct expand_scratch *sc = scratch_get(&local);
+
+    char **targets;
+    char **argv = expand_command(sc, simple, &targets);
+    int st = exec_command(simple, argv, targets, tail);
+
+    scratch_put(sc);
+    return st;
+}
+
+/* Bound to a builtin that does not start a command of its own, as timeout and memo do */
+static int runs_no_command(const struct ast_simple *s)
+{
+    return s->builtin > 0 && s->builtin != BUILTIN_TIMEOUT + 1 && s->builtin != BUILTIN_MEMO + 1;
+}
+
+/* A pipeline stage the spawn helper can run: an external command, stdio only */
+static int helper_stage(struct ast *n)
+{
+    if (!spawn_helper_active() || n->type != AST_SIMPLE)
+        return 0;
+    struct ast_simple *s = &n->as.simple;
+    if (s->redir_len > 0 || s->assign_len > 0)
+        return 0;
+    bind_command(s);
+    return s->builtin < 0;
 }
 
-static int exec_list(struct ast **items, size_t len)
+static pid_t spawn_stage(struct ast_simple *simple, const int fds[3])
+{
+    struct expand_scratch local;
+    struct expand_scratch *sc = scratch_get(&local);
+
+    char **targets;
+    char **argv = expand_command(sc, simple, &targets);
+    pid_t pid = spawn_helper_spawn(argv, fds);
+
+    scratch_put(sc);
+    return pid;
+}
+
+static int exec_list(struct ast **items, size_t len, int tail)
 {
     int st = 0;
     for (size_t i = 0; i < len; i++)
-        st = exec_ast(items[i]);
+        st = exec_node(items[i], tail && i + 1 == len);
     return st;
 }
 
-static int exec_if(struct ast_if *ifn)
+static int exec_if(struct ast_if *ifn, int tail)
 {
     int cond = exec_ast(ifn->cond);
     if (cond == 0)
-        return exec_ast(ifn->then_branch);
+        return exec_node(ifn->then_branch, tail);
 
     for (size_t i = 0; i < ifn->elif_len; i++) {
         int c = exec_ast(ifn->elif_conds[i]);
         if (c == 0)
-            return exec_ast(ifn->elif_thens[i]);
+            return exec_node(ifn->elif_thens[i], tail);
     }
 
     if (ifn->else_branch)
-        return exec_ast(ifn->else_branch);
+        return exec_node(ifn->else_branch, tail);
 
     return 0;
 }
 
-static int exec_pipeline(struct ast_pipeline *pipeline)
+static int exec_while(struct ast_while *w)
 {
-    size_t n = pipeline->len;
-    if (n == 0)
-        return 0;
-
-    /* Allocate arrays for pipes and PIDs */
-    int (*pipes)[2] = NULL;
-    pid_t *pids = NULL;
+    int st = 0;
+    while ((exec_ast(w->cond) == 0) != w->until)
+        st = exec_ast(w->body);
+    return st;
+}
 
-    if (n > 1) {
-        pipes = calloc(n - 1, sizeof(int[2]));
-        if (!pipes) {
-            perror("calloc");
-            return 1;
+/* Arm whose pattern first matches, or c->len */
+static size_t case_arm(struct ast_case *c, struct expand_scratch *sc)
+{
+    size_t len;
+    const char *subj = c->subject;
+    if (c->subject_word)
+        subj = expand_word(sc, c->subject_word, &len);
+    else
+        len = strlen(subj);
+    size_t off = c->subject_word ? (size_t)(subj - sc->text.buf) : 0;
+
+    long lit = c->index ? case_index_find(c->index, subj, len) : -1;
+    size_t best = lit < 0 ? c->len : (size_t)lit;
+    // earlier arms with patterns can still win over the literal hit
+    for (size_t i = 0; i < c->ndynamic; i++) {
+        struct case_pattern *p = &c->patterns[c->dynamic[i]];
+        if (p->arm >= best)
+            break;
+        if (p->glob) {
+            if (glob_match(p->glob, subj, len))
+                return p->arm;
+            continue;
         }
+        struct glob_pat *g = glob_compile_match(expand_pattern(sc, p->word));
+        if (c->subject_word)
+            subj = sc->text.buf + off;
+        int hit = glob_match(g, subj, len);
+        glob_free(g);
+        if (hit)
+            return p->arm;
     }
+    return best;
+}
+
+static int exec_case(struct ast_case *c, int tail)
+{
+    struct expand_scratch local;
+    struct expand_scratch *sc = scratch_get(&local);
+    size_t arm = case_arm(c, sc);
+    scratch_put(sc);
+    return arm < c->len ? exec_node(c->bodies[arm], tail) : 0;
+}
 
-    pids = calloc(n, sizeof(pid_t));
-    if (!pids) {
-        perror("calloc");
-        free(pipes);
+/*
+ * True if running n never forks, so nothing but the shell itself touches
+ * its standard input: only builtins that run in place, no pipelines, no
+ * nested redirections.
+ */
+static int in_process_only(struct ast *n)
+{
+    if (!n)
+        return 1;
+    switch (n->type) {
+    case AST_SIMPLE: {
+        struct ast_simple *s = &n->as.simple;
+        if (s->redir_len > 0)
+            return 0;
+        if (!s->argv[s->assign_len])
+            return 1;
+        bind_command(s);
+        return runs_no_command(s);
+    }
+    case AST_LIST:
+        for (size_t i = 0; i < n->as.list.len; i++)
+            if (!in_process_only(n->as.list.items[i]))
+                return 0;
+        return 1;
+    case AST_IF:
+        for (size_t i = 0; i < n->as.ifnode.elif_len; i++)
+            if (!in_process_only(n->as.ifnode.elif_conds[i])
+                || !in_process_only(n->as.ifnode.elif_thens[i]))
+                return 0;
+        return in_process_only(n->as.ifnode.cond) && in_process_only(n->as.ifnode.then_branch)
+               && in_process_only(n->as.ifnode.else_branch);
+    case AST_WHILE:
+        return in_process_only(n->as.whilenode.cond) && in_process_only(n->as.whilenode.body);
+    case AST_CASE:
+        for (size_t i = 0; i < n->as.casenode.len; i++)
+            if (!in_process_only(n->as.casenode.bodies[i]))
+                return 0;
         return 1;
+    default:
+        return 0;
     }
+}
 
-    /* Create all pipes */
-    for (size_t i = 0; i < n - 1; i++) {
-        if (pipe(pipes[i]) < 0) {
-            perror("pipe");
-            /* Close already created pipes */
-            for (size_t j = 0; j < i; j++) {
-                close(pipes[j][0]);
-                close(pipes[j][1]);
-            }
-            free(pipes);
-            free(pids);
-            return 1;
-        }
+static int exec_redirect(struct ast_redirect *r)
+{
+    struct expand_scratch local;
+    struct expand_scratch *sc = scratch_get(&local);
+    char **targets = expand_redirs(sc, r->redirs, r->redir_len, r->redir_words);
+
+    int stdin_file = 0;
+    for (size_t i = 0; i < r->redir_len; i++)
+        stdin_file |= r->redirs[i].fd == STDIN_FILENO && r->redirs[i].type == REDIR_IN;
+
+    struct saved_fd *saved = save_fds(r->redirs, r->redir_len);
+    int st = 1;
+    if (apply_redirections(r->redirs, r->redir_len, targets) == 0) {
+        scratch_put(sc);
+        sc = NULL;
+        // a loop reading a file no child can share takes its lines from a mapping
+        int mapped = stdin_file && r->body->type == AST_WHILE && in_process_only(r->body)
+                     && line_map_begin(STDIN_FILENO) == 0;
+        st = exec_ast(r->body);
+        if (mapped)
+            line_map_end();
     }
+    if (sc)
+        scratch_put(sc);
+
+    restore_fds(saved, r->redir_len);
+    return st;
+}
+
+/* Puts a pipe end on a standard fd for the stage, keeping it across exec */
+static int stage_fd(int fd, int std)
+{
+    if (fd == std)
+        return fcntl(fd, F_SETFD, 0);
+    return sys_dup2(STATS_EXECUTER, fd, std) < 0 ? -1 : 0;
+}
+
+static void close_end(int fd, int std)
+{
+    if (fd >= 0 && fd != std)
+        sys_close(STATS_EXECUTER, fd);
+}
 
-    /* Fork and execute each command */
+/*
+ * Stages are started left to right with only the pipe to the next stage
+ * open: at most three pipe ends exist in the shell at any time, all
+ * close-on-exec, so an exec'ing stage keeps exactly its stdin and stdout.
+ */
+static int exec_pipeline(struct ast_pipeline *pipeline)
+{
+    size_t n = pipeline->len;
+    if (n == 0)
+        return 0;
+
+    pid_t *pids = calloc(n, sizeof(pid_t));
+    char *via_helper = calloc(n, 1);
+    if (!pids || !via_helper)
+        abort();
+
+    int prev = -1;  /* read end of the previous stage's output */
+    size_t started = 0;
+    int failed = 0;
     for (size_t i = 0; i < n; i++) {
-        pid_t pid = fork();
-        if (pid < 0) {
-            perror("fork");
-            /* Close all pipes on error */
-            for (size_t j = 0; j < n - 1; j++) {
-                close(pipes[j][0]);
-                close(pipes[j][1]);
-            }
-            /* Wait for already started children */
-            for (size_t j = 0; j < i; j++) {
-                if (pids[j] > 0)
-                    waitpid(pids[j], NULL, 0);
-            }
-            free(pipes);
-            free(pids);
-            return 1;
+        int next[2] = { -1, -1 };
+        if (i + 1 < n && sys_pipe2(STATS_EXECUTER, next, O_CLOEXEC) < 0) {
+            perror("pipe");
+            failed = 1;
+            break;
         }
 
-        if (pid == 0) {
-            /* Child process */
-            
-            /* Set up stdin from previous pipe */
-            if (i > 0) {
-                if (dup2(pipes[i - 1][0], STDIN_FILENO) < 0) {
-                    perror("dup2");
-                    _exit(1);
-                }
+        if (helper_stage(pipeline->commands[i])) {
+            int fds[3] = { prev >= 0 ? prev : STDIN_FILENO,
+                           next[1] >= 0 ? next[1] : STDOUT_FILENO, STDERR_FILENO };
+            pid_t hpid = spawn_stage(&pipeline->commands[i]->as.simple, fds);
+            if (hpid >= 0) {
+                pids[i] = hpid;
+                via_helper[i] = 1;
             }
+        }
 
-            /* Set up stdout to next pipe */
-            if (i < n - 1) {
-                if (dup2(pipes[i][1], STDOUT_FILENO) < 0) {
+        if (!via_helper[i]) {
+            // the stage execs in the child, which leaves the command table alone
+            if (pipeline->commands[i]->type == AST_SIMPLE)
+                bind_path(&pipeline->commands[i]->as.simple, 1);
+            pid_t pid = sys_fork(STATS_EXECUTER);
+            if (pid == 0) {
+                if ((prev >= 0 && stage_fd(prev, STDIN_FILENO) < 0)
+                    || (next[1] >= 0 && stage_fd(next[1], STDOUT_FILENO) < 0)) {
                     perror("dup2");
                     _exit(1);
                 }
+                // for stages that do not exec (builtins, compound commands)
+                close_end(prev, STDIN_FILENO);
+                close_end(next[0], -1);
+                close_end(next[1], STDOUT_FILENO);
+
+                /* The child is the stage: an external command execs right here */
+                int status = exec_node(pipeline->commands[i], 1);
+                fflush(NULL);
+                _exit(status);
             }
-
-            /* Close all pipe file descriptors in child */
-            for (size_t j = 0; j < n - 1; j++) {
-                close(pipes[j][0]);
-                close(pipes[j][1]);
+            if (pid < 0) {
+                perror("fork");
+                close_end(next[0], -1);
+                close_end(next[1], -1);
+                failed = 1;
+                break;
             }
-
-            /* Execute the command */
-            int status = exec_ast(pipeline->commands[i]);
-            _exit(status);
+            pids[i] = pid;
         }
 
-        /* Parent process */
-        pids[i] = pid;
+        close_end(prev, -1);
+        close_end(next[1], -1);
+        prev = next[0];
+        started++;
     }
-
-    /* Close all pipes in parent */
-    for (size_t i = 0; i < n - 1; i++) {
-        close(pipes[i][0]);
-        close(pipes[i][1]);
+    close_end(prev, -1);
+
+    /* Wait for all children, reaping each as it ends; keep the last status */
+    int *statuses = malloc(n * sizeof(int));
+    pid_t *own = malloc(n * sizeof(pid_t));
+    if (!statuses || !own)
+        abort();
+    size_t nown = 0;
+    for (size_t i = 0; i < started; i++) {
+        if (!via_helper[i])
+            own[nown++] = pids[i];
     }
-
-    /* Wait for all children and collect exit status of last command */
-    int last_status = 0;
-    for (size_t i = 0; i < n; i++) {
-        int wstatus = 0;
-        if (waitpid(pids[i], &wstatus, 0) < 0) {
-            perror("waitpid");
-            last_status = 1;
-            continue;
-        }
-
-        /* Only keep the status of the last command */
-        if (i == n - 1) {
-            if (WIFEXITED(wstatus))
-                last_status = WEXITSTATUS(wstatus);
-            else if (WIFSIGNALED(wstatus))
-                last_status = 128 + WTERMSIG(wstatus);
-            else
-                last_status = 1;
-        }
+    events_wait_children(own, nown, statuses, -1);
+
+    int last_status = 1;
+    if (!failed && via_helper[n - 1])
+        last_status = wait_status(spawn_helper_wait(pids[n - 1]));
+    else if (!failed)
+        last_status = wait_status(statuses[nown - 1]);
+    for (size_t i = 0; i < started; i++) {
+        if (via_helper[i] && (failed || i + 1 < n))
+            spawn_helper_wait(pids[i]);
     }
-
-    free(pipes);
+    free(statuses);
+    free(own);
     free(pids);
+    free(via_helper);
     return last_status;
 }
 
-int exec_ast(struct ast *n)
+/*
+ * True if a subshell body only runs builtins that builtin_in_place()
+ * allows, so the only state it can change is variables: redirections are
+ * undone by the commands that make them. Any other builtin, and any one
+ * added without being marked, makes the subshell fork.
+ */
+static int runs_in_place(struct ast *n)
 {
     if (!n)
+        return 1;
+    switch (n->type) {
+    case AST_SIMPLE: {
+        struct ast_simple *s = &n->as.simple;
+        if (!s->argv[s->assign_len])
+            return 1;
+        bind_command(s);
+        return s->builtin > 0 && builtin_in_place(s->builtin - 1);
+    }
+    case AST_LIST:
+        for (size_t i = 0; i < n->as.list.len; i++)
+            if (!runs_in_place(n->as.list.items[i]))
+                return 0;
+        return 1;
+    case AST_IF:
+        for (size_t i = 0; i < n->as.ifnode.elif_len; i++)
+            if (!runs_in_place(n->as.ifnode.elif_conds[i])
+                || !runs_in_place(n->as.ifnode.elif_thens[i]))
+                return 0;
+        return runs_in_place(n->as.ifnode.cond) && runs_in_place(n->as.ifnode.then_branch)
+               && runs_in_place(n->as.ifnode.else_branch);
+    case AST_WHILE:
+        return runs_in_place(n->as.whilenode.cond) && runs_in_place(n->as.whilenode.body);
+    case AST_CASE:
+        for (size_t i = 0; i < n->as.casenode.len; i++)
+            if (!runs_in_place(n->as.casenode.bodies[i]))
+                return 0;
+        return 1;
+    case AST_REDIRECT:
+        return runs_in_place(n->as.redirect.body);
+    case AST_SUBSHELL:
+        return runs_in_place(n->as.subshell.body);
+    default:
         return 0;
+    }
+}
 
-    if (n->type == AST_SIMPLE)
-        return exec_simple(&n->as.simple);
+/*
+ * The body runs in a child so that nothing it changes reaches the shell,
+ * or in place with the variables saved and restored when that is all it
+ * can change.
+ */
+static int exec_subshell(struct ast_subshell *sub, int tail)
+{
+    if (tail)
+        return exec_node(sub->body, 1); // nothing left to protect
+    if (runs_in_place(sub->body)) {
+        struct vars_snapshot snap;
+        vars_snapshot(&snap);
+        int st = exec_node(sub->body, 0);
+        vars_restore(&snap);
+        return st;
+    }
+    fflush(stdout);
+    pid_t pid = sys_fork(STATS_EXECUTER);
+    if (pid < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (pid == 0) {
+        int st = exec_node(sub->body, 1);
+        fflush(NULL);
+        _exit(st);
+    }
+    return wait_status(events_wait_child(pid));
+}
 
-    if (n->type == AST_LIST)
-        return exec_list(n->as.list.items, n->as.list.len);
+static int exec_node(struct ast *n, int tail)
+{
+    if (!n)
+        return 0;
 
-    if (n->type == AST_IF)
-        return exec_if(&n->as.ifnode);
+    int st = 1;
+    if (n->type == AST_SIMPLE)
+        st = exec_simple(&n->as.simple, tail);
+    else if (n->type == AST_LIST)
+        st = exec_list(n->as.list.items, n->as.list.len, tail);
+    else if (n->type == AST_IF)
+        st = exec_if(&n->as.ifnode, tail);
+    else if (n->type == AST_PIPELINE)
+        st = exec_pipeline(&n->as.pipeline);
+    else if (n->type == AST_WHILE)
+        st = exec_while(&n->as.whilenode);
+    else if (n->type == AST_REDIRECT)
+        st = exec_redirect(&n->as.redirect);
+    else if (n->type == AST_CASE)
+        st = exec_case(&n->as.casenode, tail);
+    else if (n->type == AST_SUBSHELL)
+        st = exec_subshell(&n->as.subshell, tail);
+
+    vars_set_status(st);
+    return st;
+}
 
-    if (n->type == AST_PIPELINE)
-        return exec_pipeline(&n->as.pipeline);
+int exec_ast(struct ast *n)
+{
+    return exec_node(n, 0);
+}
 
-    return 1;
+int exec_ast_final(struct ast *n)
+{
+    return exec_node(n, 1);
 }
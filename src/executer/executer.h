@@ -5,4 +5,11 @@
 
 int exec_ast(struct ast *n);
 
+/*
+ * Runs n as the last thing this process does: an external command in
+ * tail position (last in its lists, not in a loop, a pipeline or under
+ * redirections to restore) is exec'd in place of the shell, no fork.
+ */
+int exec_ast_final(struct ast *n);
+
 #endif
@@ -0,0 +1,350 @@
+#include "format.h"
+#include "util/stats.h"
+#include "util/str.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FMT_CACHE_SIZE 64
+
+enum fmt_kind {
+    FMT_LIT,    /* literal bytes, escapes decoded */
+    FMT_INT,    /* d i */
+    FMT_UINT,   /* o u x X */
+    FMT_FLOAT,  /* e E f F g G a A */
+    FMT_STR,    /* s, and c as a one-byte %s */
+    FMT_ESC     /* b: %s of the argument with its escapes decoded */
+};
+
+struct fmt_dir {
+    enum fmt_kind kind;
+    size_t off;         // FMT_LIT: span in text
+    size_t len;
+    char spec[32];      // conversions: spec for printf(3), length modifier included
+    int stars;          // * widths and precisions taken from the arguments
+};
+
+struct fmt {
+    const char *key;    // address of the format it was compiled for
+    char *src;          // its bytes, to tell a reused address from a hit
+    struct str text;
+    struct fmt_dir *dirs;
+    size_t len;
+    size_t cap;
+    int nconv;
+};
+
+static struct fmt cache[FMT_CACHE_SIZE];
+static struct str esc_buf;
+
+static struct fmt_dir *add_dir(struct fmt *f, enum fmt_kind kind)
+{
+    if (f->len == f->cap) {
+        f->cap = f->cap ? f->cap * 2 : 8;
+        f->dirs = realloc(f->dirs, f->cap * sizeof(*f->dirs));
+        if (!f->dirs)
+            abort();
+        STATS_ALLOC(STATS_BUILTINS, f->cap * sizeof(*f->dirs));
+    }
+    struct fmt_dir *d = &f->dirs[f->len++];
+    memset(d, 0, sizeof(*d));
+    d->kind = kind;
+    return d;
+}
+
+/* The literal run being built, opened if the last directive was a conversion */
+static struct fmt_dir *open_lit(struct fmt *f)
+{
+    if (f->len > 0 && f->dirs[f->len - 1].kind == FMT_LIT)
+        return &f->dirs[f->len - 1];
+    struct fmt_dir *d = add_dir(f, FMT_LIT);
+    d->off = f->text.len;
+    return d;
+}
+
+/*
+ * Decodes the escape after a backslash at p into out; returns the bytes
+ * read. In %b arguments octal escapes are \0ddd and \c stops all output.
+ */
+static size_t decode_escape(const char *p, struct str *out, int in_arg, int *stop)
+{
+    static const char from[] = "\\abfnrtv\"'";
+    static const char to[] = "\\\a\b\f\n\r\t\v\"'";
+    const char *hit = *p ? strchr(from, *p) : NULL;
+    if (hit) {
+        str_pushc(out, to[hit - from]);
+        return 1;
+    }
+    if (in_arg && *p == 'c') {
+        *stop = 1;
+        return 1;
+    }
+    size_t i = in_arg && *p == '0' ? 1 : 0;
+    size_t start = i;
+    int v = 0;
+    while (i - start < 3 && p[i] >= '0' && p[i] <= '7')
+        v = v * 8 + (p[i++] - '0');
+    if (i > start || (in_arg && i == 1)) {
+        str_pushc(out, (char)v);
+        return i;
+    }
+    str_pushc(out, '\\');
+    return 0;
+}
+
+static void fmt_clear(struct fmt *f)
+{
+    free(f->src);
+    str_free(&f->text);
+    free(f->dirs);
+    memset(f, 0, sizeof(*f));
+}
+
+/* Parses one %... directive at p (past the %); returns the bytes read, 0 if invalid */
+static size_t compile_conv(struct fmt *f, const char *p)
+{
+    char spec[32];
+    size_t n = 0, i = 0;
+    int stars = 0;
+    spec[n++] = '%';
+    while (p[i] && strchr("-+ #0", p[i]) && n < 8)
+        spec[n++] = p[i++];
+    if (p[i] == '*') {
+        spec[n++] = p[i++];
+        stars++;
+    } else {
+        while (p[i] >= '0' && p[i] <= '9' && n < 16)
+            spec[n++] = p[i++];
+    }
+    if (p[i] == '.') {
+        spec[n++] = p[i++];
+        if (p[i] == '*') {
+            spec[n++] = p[i++];
+            stars++;
+        } else {
+            while (p[i] >= '0' && p[i] <= '9' && n < 24)
+                spec[n++] = p[i++];
+        }
+    }
+
+    char c = p[i];
+    enum fmt_kind kind;
+    if (c == 'd' || c == 'i') {
+        kind = FMT_INT;
+        spec[n++] = 'j';
+    } else if (c && strchr("ouxX", c)) {
+        kind = FMT_UINT;
+        spec[n++] = 'j';
+    } else if (c && strchr("eEfFgGaA", c)) {
+        kind = FMT_FLOAT;
+    } else if (c == 's' || c == 'b') {
+        kind = c == 's' ? FMT_STR : FMT_ESC;
+        c = 's';
+    } else if (c == 'c') {
+        kind = FMT_STR;
+        if (strchr(spec, '.'))
+            return 0;
+        spec[n++] = '.';
+        spec[n++] = '1';
+        c = 's';
+    } else {
+        return 0;
+    }
+    spec[n++] = c;
+    spec[n] = '\0';
+
+    struct fmt_dir *d = add_dir(f, kind);
+    memcpy(d->spec, spec, n + 1);
+    d->stars = stars;
+    f->nconv++;
+    return i + 1;
+}
+
+static int compile(struct fmt *f, const char *s)
+{
+    str_init(&f->text);
+    for (const char *p = s; *p;) {
+        if (*p == '\\') {
+            struct fmt_dir *d = open_lit(f);
+            size_t before = f->text.len;
+            int stop = 0;
+            p += 1 + decode_escape(p + 1, &f->text, 0, &stop);
+            d->len += f->text.len - before;
+            continue;
+        }
+        if (*p == '%' && p[1] == '%') {
+            open_lit(f)->len++;
+            str_pushc(&f->text, '%');
+            p += 2;
+            continue;
+        }
+        if (*p == '%') {
+            size_t used = compile_conv(f, p + 1);
+            if (!used) {
+                fprintf(stderr, "42sh: printf: %s: invalid directive\n", p);
+                return -1;
+            }
+            p += 1 + used;
+            continue;
+        }
+        const char *next = p + strcspn(p, "\\%");
+        struct fmt_dir *d = open_lit(f);
+        str_appendn(&f->text, p, (size_t)(next - p));
+        d->len += (size_t)(next - p);
+        p = next;
+    }
+    return 0;
+}
+
+/* The compiled form of s, from the cache when s was seen at the same address */
+static struct fmt *fmt_get(const char *s)
+{
+    struct fmt *f = &cache[((uintptr_t)s >> 3) % FMT_CACHE_SIZE];
+    if (f->key == s && strcmp(f->src, s) == 0)
+        return f;
+    fmt_clear(f);
+    if (compile(f, s) < 0) {
+        fmt_clear(f);
+        return NULL;
+    }
+    f->key = s;
+    f->src = strdup(s);
+    if (!f->src)
+        abort();
+    return f;
+}
+
+static int bad_number(const char *s)
+{
+    fprintf(stderr, "42sh: printf: %s: invalid number\n", s);
+    return 1;
+}
+
+/* 'c or "c is the value of c, as in POSIX */
+static intmax_t arg_int(const char *s, int *err)
+{
+    if (!*s)
+        return 0;
+    if (*s == '\'' || *s == '"')
+        return (unsigned char)s[1];
+    char *end;
+    errno = 0;
+    intmax_t v = strtoimax(s, &end, 0);
+    if (end == s || *end || errno)
+        *err |= bad_number(s);
+    return v;
+}
+
+static uintmax_t arg_uint(const char *s, int *err)
+{
+    if (!*s)
+        return 0;
+    if (*s == '\'' || *s == '"')
+        return (unsigned char)s[1];
+    char *end;
+    errno = 0;
+    uintmax_t v = strtoumax(s, &end, 0);
+    if (end == s || *end || errno)
+        *err |= bad_number(s);
+    return v;
+}
+
+static double arg_float(const char *s, int *err)
+{
+    if (!*s)
+        return 0;
+    if (*s == '\'' || *s == '"')
+        return (unsigned char)s[1];
+    char *end;
+    errno = 0;
+    double v = strtod(s, &end);
+    if (end == s || *end || errno)
+        *err |= bad_number(s);
+    return v;
+}
+
+/* %b: the argument with its escapes decoded into esc_buf; *stop on \c */
+static const char *decode_arg(const char *s, int *stop)
+{
+    esc_buf.len = 0;
+    for (const char *p = s; *p && !*stop;) {
+        if (*p == '\\') {
+            p += 1 + decode_escape(p + 1, &esc_buf, 1, stop);
+            continue;
+        }
+        str_pushc(&esc_buf, *p++);
+    }
+    str_pushc(&esc_buf, '\0');
+    return esc_buf.buf;
+}
+
+#define PRINT_STARS(spec, stars, st, v)                                                  \
+    ((stars) == 0   ? printf((spec), (v))                                                \
+     : (stars) == 1 ? printf((spec), (st)[0], (v))                                       \
+                    : printf((spec), (st)[0], (st)[1], (v)))
+
+/* One pass over the format; returns the arguments it consumed */
+static size_t run_pass(const struct fmt *f, char **args, int *err, int *stop)
+{
+    size_t used = 0;
+    for (size_t i = 0; i < f->len && !*stop; i++) {
+        const struct fmt_dir *d = &f->dirs[i];
+        if (d->kind == FMT_LIT) {
+            fwrite(f->text.buf + d->off, 1, d->len, stdout);
+            continue;
+        }
+        int st[2] = { 0, 0 };
+        for (int k = 0; k < d->stars; k++)
+            st[k] = args[used] ? (int)arg_int(args[used++], err) : 0;
+        const char *a = args[used] ? args[used++] : "";
+
+        switch (d->kind) {
+        case FMT_INT:
+            PRINT_STARS(d->spec, d->stars, st, arg_int(a, err));
+            break;
+        case FMT_UINT:
+            PRINT_STARS(d->spec, d->stars, st, arg_uint(a, err));
+            break;
+        case FMT_FLOAT:
+            PRINT_STARS(d->spec, d->stars, st, arg_float(a, err));
+            break;
+        case FMT_ESC:
+            a = decode_arg(a, stop);
+            /* fallthrough */
+        default:
+            PRINT_STARS(d->spec, d->stars, st, a);
+            break;
+        }
+    }
+    return used;
+}
+
+int builtin_printf(char **argv)
+{
+    int i = 1;
+    if (argv[i] && strcmp(argv[i], "--") == 0)
+        i++;
+    if (!argv[i]) {
+        fprintf(stderr, "42sh: printf: usage: printf FORMAT [ARG]...\n");
+        return 2;
+    }
+    struct fmt *f = fmt_get(argv[i]);
+    if (!f)
+        return 1;
+
+    // the format is reused while arguments remain
+    char **args = argv + i + 1;
+    int err = 0, stop = 0;
+    do {
+        size_t used = run_pass(f, args, &err, &stop);
+        args += used;
+        if (!used)
+            break;
+    } while (*args && !stop);
+
+    fflush(stdout);
+    return err;
+}
@@ -0,0 +1,12 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+/*
+ * printf FORMAT [ARG]...: formats are compiled once into a list of
+ * literal runs and conversions, each carrying its printf(3) spec, and
+ * cached by the address of the format string. A loop running the same
+ * command only converts its arguments.
+ */
+int builtin_printf(char **argv);
+
+#endif
@@ -0,0 +1,116 @@
+#include "lineread.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LINE_BLOCK_MIN 128
+#define LINE_BLOCK_MAX 65536
+
+static struct {
+    int fd;
+    const char *base;
+    size_t len;
+    size_t pos;
+} map = { -1, NULL, 0, 0 };
+
+/* Block size that last held a whole line, so short lines cost one small read */
+static size_t block = LINE_BLOCK_MIN;
+
+static int read_mapped(struct str *out)
+{
+    if (map.pos >= map.len)
+        return 0;
+    const char *p = map.base + map.pos;
+    size_t left = map.len - map.pos;
+    const char *nl = memchr(p, '\n', left);
+    size_t n = nl ? (size_t)(nl - p) : left;
+    str_appendn(out, p, n);
+    map.pos += n + (nl != NULL);
+    return nl != NULL;
+}
+
+static ssize_t read_retry(int fd, char *buf, size_t n)
+{
+    ssize_t r;
+    do
+        r = read(fd, buf, n);
+    while (r < 0 && errno == EINTR);
+    return r;
+}
+
+static int read_bytes(int fd, struct str *out)
+{
+    char c;
+    ssize_t r;
+    while ((r = read_retry(fd, &c, 1)) == 1) {
+        if (c == '\n')
+            return 1;
+        str_pushc(out, c);
+    }
+    return r < 0 ? -1 : 0;
+}
+
+static int read_seekable(int fd, struct str *out)
+{
+    char buf[LINE_BLOCK_MAX];
+    for (;;) {
+        ssize_t r = read_retry(fd, buf, block);
+        if (r <= 0)
+            return r < 0 ? -1 : 0;
+        const char *nl = memchr(buf, '\n', (size_t)r);
+        if (!nl) {
+            str_appendn(out, buf, (size_t)r);
+            if (block < LINE_BLOCK_MAX)
+                block *= 2;
+            continue;
+        }
+        size_t used = (size_t)(nl - buf);
+        str_appendn(out, buf, used);
+        if (used * 4 < (size_t)r && block > LINE_BLOCK_MIN)
+            block /= 2;
+        off_t excess = r - (ssize_t)used - 1;
+        if (excess > 0 && lseek(fd, -excess, SEEK_CUR) < 0)
+            return -1;
+        return 1;
+    }
+}
+
+int line_read(int fd, struct str *out)
+{
+    if (fd == map.fd)
+        return read_mapped(out);
+    if (lseek(fd, 0, SEEK_CUR) < 0)
+        return errno == ESPIPE ? read_bytes(fd, out) : -1;
+    return read_seekable(fd, out);
+}
+
+int line_map_begin(int fd)
+{
+    struct stat st;
+    if (map.fd >= 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+        return -1;
+    off_t pos = lseek(fd, 0, SEEK_CUR);
+    if (pos < 0)
+        return -1;
+    void *m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (m == MAP_FAILED)
+        return -1;
+    madvise(m, (size_t)st.st_size, MADV_SEQUENTIAL);
+    map.fd = fd;
+    map.base = m;
+    map.len = (size_t)st.st_size;
+    map.pos = (size_t)pos;
+    return 0;
+}
+
+void line_map_end(void)
+{
+    if (map.fd < 0)
+        return;
+    lseek(map.fd, (off_t)map.pos, SEEK_SET);
+    munmap((void *)map.base, map.len);
+    map.fd = -1;
+    map.base = NULL;
+}
@@ -0,0 +1,23 @@
+#ifndef LINEREAD_H
+#define LINEREAD_H
+
+#include "util/str.h"
+
+/*
+ * Line input for the read builtin. A line is never consumed past its
+ * newline, so commands run afterwards see the rest of the input: seekable
+ * descriptors are read in blocks and the excess is given back with lseek,
+ * anything else is read a byte at a time. While a map is active for the
+ * descriptor, lines come straight out of the mapping with no syscall.
+ */
+
+/* Appends one line without its newline; 1 if a newline ended it, 0 at EOF, -1 on error */
+int line_read(int fd, struct str *out);
+
+/* Serves fd (a regular file nobody else reads meanwhile) from a mapping */
+int line_map_begin(int fd);
+
+/* Drops the mapping and moves the file offset past the lines consumed */
+void line_map_end(void);
+
+#endif
@@ -0,0 +1,421 @@
+#define _GNU_SOURCE
+
+#include "memo.h"
+#include "events.h"
+#include "sys.h"
+#include "expand/cmdtable.h"
+#include "expand/vars.h"
+#include "util/str.h"
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MEMO_MAGIC "42memo1\n"
+#define MEMO_DEFAULT_MAX (64L << 20)
+
+/* An entry file is this header, the key, the command's stdout, then its stderr */
+struct memo_header {
+    char magic[8];
+    uint32_t status;
+    uint32_t key_len;
+    uint64_t out_len;
+    uint64_t err_len;
+};
+
+struct memo_entry {
+    char *name;
+    struct timespec used;   // mtime, touched on every hit
+    off_t size;
+};
+
+static int memo_usage(void)
+{
+    fprintf(stderr, "memo: usage: memo [--deps FILE... --] [--env NAME]... COMMAND [ARG]...\n");
+    return 2;
+}
+
+/* A shell variable or environment entry, empty if unset */
+static void append_var(struct str *s, const char *name)
+{
+    size_t len = 0;
+    const char *v = vars_lookup(name, strlen(name), &len);
+    if (v)
+        str_appendn(s, v, len);
+}
+
+static void key_field(struct str *key, const char *s)
+{
+    str_append(key, s);
+    str_pushc(key, '\0');
+}
+
+/* Identity of a file's current content, as far as stat can tell */
+static void key_file(struct str *key, const char *path)
+{
+    struct stat st;
+    char buf[128];
+    if (stat(path, &st) < 0)
+        snprintf(buf, sizeof(buf), "missing");
+    else
+        snprintf(buf, sizeof(buf), "%llu %llu %lld.%09ld %lld", (unsigned long long)st.st_dev,
+                 (unsigned long long)st.st_ino, (long long)st.st_mtim.tv_sec,
+                 st.st_mtim.tv_nsec, (long long)st.st_size);
+    key_field(key, path);
+    key_field(key, buf);
+}
+
+/* Everything the output is assumed to depend on; 0 if the command cannot be found */
+static int build_key(struct str *key, char **cmd, char **deps, size_t ndeps, char **envs,
+                     size_t nenvs)
+{
+    const char *exe = strchr(cmd[0], '/') ? cmd[0] : cmdtable_lookup(cmd[0]);
+    if (!exe)
+        return 0;
+    key_file(key, exe);
+    for (size_t i = 0; cmd[i]; i++)
+        key_field(key, cmd[i]);
+    str_pushc(key, '\0');
+
+    char *cwd = getcwd(NULL, 0);
+    key_field(key, cwd ? cwd : "");
+    free(cwd);
+    str_append(key, "PATH=");
+    append_var(key, "PATH");
+    str_pushc(key, '\0');
+    for (size_t i = 0; i < nenvs; i++) {
+        str_append(key, envs[i]);
+        str_pushc(key, '=');
+        append_var(key, envs[i]);
+        str_pushc(key, '\0');
+    }
+    for (size_t i = 0; i < ndeps; i++)
+        key_file(key, deps[i]);
+    return 1;
+}
+
+static uint64_t fnv1a(const char *p, size_t n)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < n; i++) {
+        h ^= (unsigned char)p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static int cache_dir(struct str *dir)
+{
+    append_var(dir, "MEMO_DIR");
+    if (dir->len == 0) {
+        append_var(dir, "HOME");
+        if (dir->len == 0)
+            return -1;
+        str_append(dir, "/.42sh_memo");
+    }
+    return mkdir(dir->buf, 0700) < 0 && errno != EEXIST ? -1 : 0;
+}
+
+static long cache_max(void)
+{
+    struct str v;
+    str_init(&v);
+    append_var(&v, "MEMO_MAX");
+    long max = v.len ? strtol(v.buf, NULL, 10) : MEMO_DEFAULT_MAX;
+    str_free(&v);
+    return max > 0 ? max : MEMO_DEFAULT_MAX;
+}
+
+/* Copies len bytes at off in fd to out: sendfile, or plain copies where it is refused */
+static int replay(int out, int fd, off_t off, uint64_t len)
+{
+    while (len > 0) {
+        ssize_t n = sendfile(out, fd, &off, len > (1U << 30) ? (1U << 30) : (size_t)len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EINVAL || errno == ENOSYS))
+            break; // O_APPEND targets, among others
+        if (n <= 0)
+            return -1;
+        len -= (uint64_t)n;
+    }
+    char buf[65536];
+    while (len > 0) {
+        ssize_t n = pread(fd, buf, len > sizeof(buf) ? sizeof(buf) : (size_t)len, off);
+        if (n <= 0)
+            return -1;
+        for (ssize_t w = 0; w < n;) {
+            ssize_t k = write(out, buf + w, (size_t)(n - w));
+            if (k < 0 && errno == EINTR)
+                continue;
+            if (k < 0)
+                return -1;
+            w += k;
+        }
+        off += n;
+        len -= (uint64_t)n;
+    }
+    return 0;
+}
+
+/* Stamps the entry as just used; the kernel's own mtime is too coarse to order them */
+static void touch(int fd)
+{
+    struct timespec now[2];
+    clock_gettime(CLOCK_REALTIME, &now[0]);
+    now[1] = now[0];
+    futimens(fd, now);
+}
+
+/* Replays the entry at path if it holds this exact key; returns 1 on a hit */
+static int try_hit(const char *path, const struct str *key, int *status)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+    struct memo_header h;
+    struct stat st;
+    int hit = pread(fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h)
+              && memcmp(h.magic, MEMO_MAGIC, sizeof(h.magic)) == 0 && h.key_len == key->len
+              && fstat(fd, &st) == 0
+              && (uint64_t)st.st_size == sizeof(h) + h.key_len + h.out_len + h.err_len;
+    if (hit) {
+        // the hash only names the file: the key itself must match
+        char *k = malloc(h.key_len ? h.key_len : 1);
+        if (!k)
+            abort();
+        hit = pread(fd, k, h.key_len, sizeof(h)) == (ssize_t)h.key_len
+              && memcmp(k, key->buf, h.key_len) == 0;
+        free(k);
+    }
+    if (hit) {
+        touch(fd);
+        off_t data = (off_t)(sizeof(h) + h.key_len);
+        fflush(stdout);
+        replay(STDOUT_FILENO, fd, data, h.out_len);
+        replay(STDERR_FILENO, fd, data + (off_t)h.out_len, h.err_len);
+        *status = (int)h.status;
+    }
+    close(fd);
+    return hit;
+}
+
+static int cmp_used(const void *a, const void *b)
+{
+    const struct memo_entry *x = a, *y = b;
+    if (x->used.tv_sec != y->used.tv_sec)
+        return x->used.tv_sec < y->used.tv_sec ? -1 : 1;
+    return (x->used.tv_nsec > y->used.tv_nsec) - (x->used.tv_nsec < y->used.tv_nsec);
+}
+
+/* Removes the entries used longest ago until the cache fits in max bytes */
+static void evict(const char *dir, long max)
+{
+    DIR *d = opendir(dir);
+    if (!d)
+        return;
+    struct memo_entry *entries = NULL;
+    size_t n = 0, cap = 0;
+    long long total = 0;
+    struct dirent *de;
+    while ((de = readdir(d))) {
+        struct stat st;
+        if (de->d_name[0] == '.' || fstatat(dirfd(d), de->d_name, &st, 0) < 0
+            || !S_ISREG(st.st_mode))
+            continue; // '.' also hides entries still being written
+        if (n == cap) {
+            cap = cap ? cap * 2 : 64;
+            entries = realloc(entries, cap * sizeof(*entries));
+            if (!entries)
+                abort();
+        }
+        entries[n].name = strdup(de->d_name);
+        if (!entries[n].name)
+            abort();
+        entries[n].used = st.st_mtim;
+        entries[n].size = st.st_size;
+        total += st.st_size;
+        n++;
+    }
+
+    if (total > max) {
+        qsort(entries, n, sizeof(*entries), cmp_used);
+        for (size_t i = 0; i < n && total > max; i++)
+            if (unlinkat(dirfd(d), entries[i].name, 0) == 0)
+                total -= entries[i].size;
+    }
+    for (size_t i = 0; i < n; i++)
+        free(entries[i].name);
+    free(entries);
+    closedir(d);
+}
+
+static int status_of(int ws)
+{
+    if (WIFEXITED(ws))
+        return WEXITSTATUS(ws);
+    return 128 + WTERMSIG(ws);
+}
+
+/* Runs cmd with stdout and stderr on out and err, or on the shell's own if they are -1 */
+static int run(char **cmd, int out, int err, int *ws)
+{
+    fflush(stdout);
+    pid_t pid = sys_fork(STATS_BUILTINS);
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        if ((out >= 0 && dup2(out, STDOUT_FILENO) < 0) || (err >= 0 && dup2(err, STDERR_FILENO) < 0))
+            _exit(126);
+        sys_execvp(STATS_BUILTINS, cmd[0], cmd);
+        int e = errno;
+        perror(cmd[0]);
+        _exit(e == ENOENT ? 127 : 126);
+    }
+    events_wait_children(&pid, 1, ws, -1);
+    return 0;
+}
+
+/*
+ * Runs the command with stdout going straight into a new entry, after its
+ * header and key, and stderr into a scratch file appended once it exits.
+ * The entry only gets its name when it is complete.
+ */
+static int run_and_store(char **cmd, const char *dir, const char *name, const struct str *key)
+{
+    struct str tmp, scratch, final;
+    str_init(&tmp);
+    str_init(&scratch);
+    str_init(&final);
+    str_append(&tmp, dir);
+    str_append(&tmp, "/.");
+    str_append(&tmp, name);
+    str_append(&tmp, ".XXXXXX");
+    str_append(&scratch, dir);
+    str_append(&scratch, "/.err.XXXXXX");
+    str_append(&final, dir);
+    str_pushc(&final, '/');
+    str_append(&final, name);
+
+    int fd = mkostemp(tmp.buf, O_CLOEXEC);
+    int efd = mkostemp(scratch.buf, O_CLOEXEC);
+    if (efd >= 0)
+        unlink(scratch.buf);
+    struct memo_header h = { .key_len = (uint32_t)key->len };
+    memcpy(h.magic, MEMO_MAGIC, sizeof(h.magic));
+    off_t data = (off_t)(sizeof(h) + key->len);
+    int ws, st = 1;
+    if (fd < 0 || efd < 0 || write(fd, &h, sizeof(h)) != (ssize_t)sizeof(h)
+        || write(fd, key->buf, key->len) != (ssize_t)key->len) {
+        // no room for an entry: the command still runs
+        if (run(cmd, -1, -1, &ws) == 0)
+            st = status_of(ws);
+        if (fd >= 0)
+            unlink(tmp.buf);
+        goto out;
+    }
+
+    if (run(cmd, fd, efd, &ws) < 0) {
+        unlink(tmp.buf);
+        goto out;
+    }
+    st = status_of(ws);
+    h.out_len = (uint64_t)(lseek(fd, 0, SEEK_END) - data);
+    h.err_len = (uint64_t)lseek(efd, 0, SEEK_END);
+    h.status = (uint32_t)st;
+    replay(STDOUT_FILENO, fd, data, h.out_len);
+    replay(STDERR_FILENO, efd, 0, h.err_len);
+
+    int keep = WIFEXITED(ws) && replay(fd, efd, 0, h.err_len) == 0
+               && pwrite(fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h);
+    if (keep) {
+        touch(fd);
+        keep = rename(tmp.buf, final.buf) == 0;
+    }
+    if (!keep)
+        unlink(tmp.buf);
+    else
+        evict(dir, cache_max());
+
+out:
+    if (fd >= 0)
+        close(fd);
+    if (efd >= 0)
+        close(efd);
+    str_free(&tmp);
+    str_free(&scratch);
+    str_free(&final);
+    return st;
+}
+
+int builtin_memo(char **argv)
+{
+    int argc = 0;
+    while (argv[argc])
+        argc++;
+    char **deps = NULL;
+    char **envs = calloc((size_t)argc, sizeof(*envs));
+    if (!envs)
+        abort();
+    size_t ndeps = 0, nenvs = 0;
+    int i = 1;
+    while (argv[i] && argv[i][0] == '-') {
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        }
+        if (strcmp(argv[i], "--deps") == 0) {
+            deps = argv + ++i;
+            while (argv[i] && strcmp(argv[i], "--") != 0)
+                i++;
+            if (!argv[i])
+                break;
+            ndeps = (size_t)(argv + i - deps);
+            i++;
+        } else if (strcmp(argv[i], "--env") == 0 && argv[i + 1]) {
+            envs[nenvs++] = argv[i + 1];
+            i += 2;
+        } else {
+            break;
+        }
+    }
+    char **cmd = argv + i;
+    if (!cmd[0] || cmd[0][0] == '-') {
+        free(envs);
+        return memo_usage();
+    }
+
+    struct str key, dir;
+    str_init(&key);
+    str_init(&dir);
+    int st, ws;
+    if (!build_key(&key, cmd, deps, ndeps, envs, nenvs) || cache_dir(&dir) < 0) {
+        // nothing to key on or nowhere to keep it: run as is
+        st = run(cmd, -1, -1, &ws) == 0 ? status_of(ws) : 1;
+    } else {
+        char name[17];
+        snprintf(name, sizeof(name), "%016llx", (unsigned long long)fnv1a(key.buf, key.len));
+        struct str path;
+        str_init(&path);
+        str_append(&path, dir.buf);
+        str_pushc(&path, '/');
+        str_append(&path, name);
+        if (!try_hit(path.buf, &key, &st))
+            st = run_and_store(cmd, dir.buf, name, &key);
+        str_free(&path);
+    }
+    str_free(&key);
+    str_free(&dir);
+    free(envs);
+    return st;
+}
@@ -0,0 +1,17 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+/*
+ * memo [--deps FILE... --] [--env NAME]... COMMAND [ARG]...: runs a
+ * deterministic command once and replays its stdout, stderr and status
+ * afterwards. The key is the argv, the cwd, $PATH, the variables named
+ * with --env, and the device, inode, mtime and size of the command's
+ * executable and of every dependency file. Entries live in $MEMO_DIR
+ * (default ~/.42sh_memo), one file per key named by its hash, and are
+ * replayed with sendfile. Over $MEMO_MAX bytes (default 64 MiB) the
+ * entries used longest ago are removed. A replay writes all of stdout
+ * before stderr, and a command killed by a signal is not stored.
+ */
+int builtin_memo(char **argv);
+
+#endif
@@ -0,0 +1,289 @@
+#include "optimize.h"
+#include "bind.h"
+#include "builtins.h"
+#include "cond.h"
+#include "lexer/word.h"
+#include "util/intern.h"
+#include <stdlib.h>
+#include <string.h>
+
+static int word_reads_status(const struct word *w)
+{
+    for (size_t i = 0; w && i < w->nsegs; i++)
+        if (w->segs[i].type == SEG_PARAM && w->segs[i].len == 1
+            && w->text.buf[w->segs[i].off] == '?')
+            return 1;
+    return 0;
+}
+
+static int words_read_status(struct word **words, size_t len)
+{
+    for (size_t i = 0; words && i < len; i++)
+        if (word_reads_status(words[i]))
+            return 1;
+    return 0;
+}
+
+/* True if anything in n may expand $? (conservative: the whole subtree) */
+static int reads_status(const struct ast *n)
+{
+    if (!n)
+        return 0;
+    switch (n->type) {
+    case AST_SIMPLE: {
+        const struct ast_simple *s = &n->as.simple;
+        size_t argc = 0;
+        while (s->argv[argc])
+            argc++;
+        return words_read_status(s->words, argc)
+               || words_read_status(s->redir_words, s->redir_len);
+    }
+    case AST_LIST:
+        for (size_t i = 0; i < n->as.list.len; i++)
+            if (reads_status(n->as.list.items[i]))
+                return 1;
+        return 0;
+    case AST_IF:
+        for (size_t i = 0; i < n->as.ifnode.elif_len; i++)
+            if (reads_status(n->as.ifnode.elif_conds[i])
+                || reads_status(n->as.ifnode.elif_thens[i]))
+                return 1;
+        return reads_status(n->as.ifnode.cond) || reads_status(n->as.ifnode.then_branch)
+               || reads_status(n->as.ifnode.else_branch);
+    case AST_PIPELINE:
+        for (size_t i = 0; i < n->as.pipeline.len; i++)
+            if (reads_status(n->as.pipeline.commands[i]))
+                return 1;
+        return 0;
+    case AST_WHILE:
+        return reads_status(n->as.whilenode.cond) || reads_status(n->as.whilenode.body);
+    case AST_REDIRECT:
+        return reads_status(n->as.redirect.body)
+               || words_read_status(n->as.redirect.redir_words, n->as.redirect.redir_len);
+    case AST_CASE: {
+        const struct ast_case *c = &n->as.casenode;
+        if (word_reads_status(c->subject_word))
+            return 1;
+        for (size_t i = 0; i < c->npatterns; i++)
+            if (word_reads_status(c->patterns[i].word))
+                return 1;
+        for (size_t i = 0; i < c->len; i++)
+            if (reads_status(c->bodies[i]))
+                return 1;
+        return 0;
+    }
+    case AST_SUBSHELL:
+        return reads_status(n->as.subshell.body);
+    }
+    return 1;
+}
+
+/* Status n always returns without side effects, or -1 */
+static int const_status(const struct ast *n)
+{
+    if (!n)
+        return -1;
+    if (n->type == AST_LIST) {
+        int st = -1;
+        for (size_t i = 0; i < n->as.list.len; i++)
+            if ((st = const_status(n->as.list.items[i])) < 0)
+                return -1;
+        return st;
+    }
+    if (n->type != AST_SIMPLE)
+        return -1;
+    const struct ast_simple *s = &n->as.simple;
+    if (!s->frozen || s->redir_len > 0 || s->assign_len > 0 || !s->argv[0])
+        return -1;
+    switch (s->builtin - 1) {
+    case BUILTIN_TRUE:
+        return 0;
+    case BUILTIN_FALSE:
+        return 1;
+    case BUILTIN_TEST:
+    case BUILTIN_BRACKET:
+        return test_constant(s->argv);
+    default:
+        return -1;
+    }
+}
+
+/* Stands for a construct that runs nothing and returns 0 */
+static struct ast *noop(void)
+{
+    char **argv = calloc(2, sizeof(char *));
+    if (!argv)
+        abort();
+    argv[0] = (char *)intern_cstr("true");
+    struct ast *n = ast_new_simple(argv);
+    n->as.simple.name_interned = 1;
+    n->as.simple.frozen = 1;
+    n->as.simple.builtin = BUILTIN_TRUE + 1;
+    return n;
+}
+
+static void bind_simple(struct ast_simple *s)
+{
+    s->frozen = !s->words && !s->globs && !s->redir_words;
+    bind_command(s);
+}
+
+static struct ast *fold_if(struct ast *n)
+{
+    struct ast_if *f = &n->as.ifnode;
+    struct ast *out = n;
+    size_t total = f->elif_len + 1;
+    struct ast **conds = malloc(total * sizeof(*conds));
+    struct ast **thens = malloc(total * sizeof(*thens));
+    if (!conds || !thens)
+        abort();
+    conds[0] = f->cond;
+    thens[0] = f->then_branch;
+    for (size_t i = 1; i < total; i++) {
+        conds[i] = f->elif_conds[i - 1];
+        thens[i] = f->elif_thens[i - 1];
+    }
+
+    // the arm a folded condition selects would see its status in $?
+    for (size_t i = 0; i < total; i++)
+        if (const_status(conds[i]) >= 0 && (reads_status(thens[i]) || reads_status(f->else_branch)))
+            goto keep;
+
+    size_t kept = 0;
+    for (size_t i = 0; i < total; i++) {
+        int st = const_status(conds[i]);
+        if (st < 0) {
+            conds[kept] = conds[i];
+            thens[kept++] = thens[i];
+            continue;
+        }
+        ast_free(conds[i]);
+        if (st > 0) {
+            ast_free(thens[i]);
+            continue;
+        }
+        // always taken: it is the else of what is left, later arms are dead
+        ast_free(f->else_branch);
+        f->else_branch = thens[i];
+        for (size_t k = i + 1; k < total; k++) {
+            ast_free(conds[k]);
+            ast_free(thens[k]);
+        }
+        break;
+    }
+
+    if (kept == 0) {
+        out = f->else_branch ? f->else_branch : noop();
+        free(f->elif_conds);
+        free(f->elif_thens);
+        free(n);
+    } else {
+        f->cond = conds[0];
+        f->then_branch = thens[0];
+        f->elif_len = kept - 1;
+        for (size_t i = 1; i < kept; i++) {
+            f->elif_conds[i - 1] = conds[i];
+            f->elif_thens[i - 1] = thens[i];
+        }
+    }
+keep:
+    free(conds);
+    free(thens);
+    return out;
+}
+
+static struct ast *fold_list(struct ast *n)
+{
+    struct ast_list *l = &n->as.list;
+    size_t len = 0;
+    for (size_t i = 0; i < l->len; i++)
+        len += l->items[i]->type == AST_LIST ? l->items[i]->as.list.len : 1;
+
+    // nested lists (left by folded branches) are spliced in
+    struct ast **items = malloc(len * sizeof(*items));
+    if (!items)
+        abort();
+    size_t k = 0;
+    for (size_t i = 0; i < l->len; i++) {
+        struct ast *it = l->items[i];
+        if (it->type != AST_LIST) {
+            items[k++] = it;
+            continue;
+        }
+        memcpy(items + k, it->as.list.items, it->as.list.len * sizeof(*items));
+        k += it->as.list.len;
+        free(it->as.list.items);
+        free(it);
+    }
+
+    // a constant command before another one only sets $?
+    size_t out = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (i + 1 < len && const_status(items[i]) >= 0 && !reads_status(items[i + 1]))
+            ast_free(items[i]);
+        else
+            items[out++] = items[i];
+    }
+    free(l->items);
+    if (out == 1) {
+        struct ast *only = items[0];
+        free(items);
+        free(n);
+        return only;
+    }
+    l->items = items;
+    l->len = out;
+    return n;
+}
+
+struct ast *optimize_ast(struct ast *n)
+{
+    if (!n)
+        return NULL;
+    switch (n->type) {
+    case AST_SIMPLE:
+        bind_simple(&n->as.simple);
+        return n;
+    case AST_LIST:
+        for (size_t i = 0; i < n->as.list.len; i++)
+            n->as.list.items[i] = optimize_ast(n->as.list.items[i]);
+        return fold_list(n);
+    case AST_IF: {
+        struct ast_if *f = &n->as.ifnode;
+        f->cond = optimize_ast(f->cond);
+        f->then_branch = optimize_ast(f->then_branch);
+        for (size_t i = 0; i < f->elif_len; i++) {
+            f->elif_conds[i] = optimize_ast(f->elif_conds[i]);
+            f->elif_thens[i] = optimize_ast(f->elif_thens[i]);
+        }
+        f->else_branch = optimize_ast(f->else_branch);
+        return fold_if(n);
+    }
+    case AST_PIPELINE:
+        for (size_t i = 0; i < n->as.pipeline.len; i++)
+            n->as.pipeline.commands[i] = optimize_ast(n->as.pipeline.commands[i]);
+        return n;
+    case AST_WHILE: {
+        struct ast_while *w = &n->as.whilenode;
+        w->cond = optimize_ast(w->cond);
+        w->body = optimize_ast(w->body);
+        int st = const_status(w->cond);
+        if (st >= 0 && (st == 0) == w->until) {
+            ast_free(n); // the body never runs
+            return noop();
+        }
+        return n;
+    }
+    case AST_REDIRECT:
+        n->as.redirect.body = optimize_ast(n->as.redirect.body);
+        return n;
+    case AST_CASE:
+        for (size_t i = 0; i < n->as.casenode.len; i++)
+            n->as.casenode.bodies[i] = optimize_ast(n->as.casenode.bodies[i]);
+        return n;
+    case AST_SUBSHELL:
+        n->as.subshell.body = optimize_ast(n->as.subshell.body);
+        return n;
+    }
+    return n;
+}
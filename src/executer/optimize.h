@@ -0,0 +1,17 @@
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+
+#include "parser/ast.h"
+
+/*
+ * Optional rewrite of a parsed tree before it runs. Conditions made only
+ * of true, false and tests that compare words are folded, and the if arms
+ * and loops that can never run are dropped; one-command lists are
+ * unwrapped; simple commands are marked when their argv needs no
+ * expansion and bound to their builtin. A fold is skipped whenever the
+ * code it would move reads $?, which would see a different status.
+ * Returns the new root; the nodes taken out are freed.
+ */
+struct ast *optimize_ast(struct ast *root);
+
+#endif
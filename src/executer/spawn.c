@@ -0,0 +1,275 @@
+#include "spawn.h"
+#include "sys.h"
+#include "util/fdpass.h"
+#include "util/str.h"
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+extern char **environ;
+
+/* shell -> helper, followed by cwd \0 argv... envp... and 3 fds */
+struct spawn_req {
+    uint32_t argc;
+    uint32_t envc;
+    uint64_t payload_len;
+};
+
+enum spawn_kind {
+    SPAWN_STARTED,  /* reply to a request: pid, or -1 and errno in status */
+    SPAWN_EXITED,   /* a child ended: pid and its wait status */
+};
+
+/* helper -> shell */
+struct spawn_msg {
+    int32_t kind;
+    int32_t pid;
+    int32_t status;
+};
+
+struct spawn_done {
+    pid_t pid;
+    int status;
+};
+
+static int helper_sock = -1;
+
+/* Exits reported while we were waiting for something else */
+static struct spawn_done *done;
+static size_t done_len;
+static size_t done_cap;
+
+/* ---------- helper side ---------- */
+
+static char **take_strings(char **p, const char *end, uint32_t n)
+{
+    char **arr = calloc((size_t)n + 1, sizeof(char *));
+    if (!arr)
+        abort();
+    for (uint32_t i = 0; i < n && *p < end; i++) {
+        arr[i] = *p;
+        *p += strlen(*p) + 1;
+    }
+    return arr;
+}
+
+static void send_msg(int sock, int kind, pid_t pid, int status)
+{
+    struct spawn_msg m = { kind, pid, status };
+    fd_write_all(sock, &m, sizeof(m));
+}
+
+static void reap(int sock)
+{
+    int ws;
+    pid_t pid;
+    while ((pid = sys_waitpid(STATS_SPAWN, -1, &ws, WNOHANG)) > 0)
+        send_msg(sock, SPAWN_EXITED, pid, ws);
+}
+
+static int serve_request(int sock, const sigset_t *child_mask)
+{
+    struct spawn_req h;
+    int fds[3];
+    if (fd_recv(sock, &h, sizeof(h), fds, 3) < 0)
+        return -1;
+
+    char *payload = malloc(h.payload_len + 1);
+    if (!payload)
+        abort();
+    if (fd_read_all(sock, payload, h.payload_len) < 0)
+        return -1;
+    payload[h.payload_len] = '\0';
+    const char *end = payload + h.payload_len;
+
+    char *p = payload;
+    const char *cwd = p;
+    p += strlen(p) + 1;
+    char **argv = take_strings(&p, end, h.argc);
+    char **envp = take_strings(&p, end, h.envc);
+
+    pid_t pid = sys_fork(STATS_SPAWN);
+    if (pid == 0) {
+        sigprocmask(SIG_SETMASK, child_mask, NULL);
+        for (int i = 0; i < 3; i++)
+            sys_dup2(STATS_SPAWN, fds[i], i);
+        if (chdir(cwd) < 0)
+            perror(cwd);
+        environ = envp;
+        sys_execvp(STATS_SPAWN, argv[0], argv);
+        perror(argv[0]);
+        _exit(127);
+    }
+    int err = errno;
+
+    for (int i = 0; i < 3; i++)
+        sys_close(STATS_SPAWN, fds[i]);
+    free(argv);
+    free(envp);
+    free(payload);
+    send_msg(sock, SPAWN_STARTED, pid, pid < 0 ? err : 0);
+    return 0;
+}
+
+static void helper_main(int sock)
+{
+    // received descriptors must never land on 0-2 and be clobbered by dup2
+    int fd;
+    while ((fd = sys_open(STATS_SPAWN, "/dev/null", O_RDWR, 0)) >= 0 && fd < 3)
+        ;
+    if (fd >= 3)
+        sys_close(STATS_SPAWN, fd);
+
+    sigset_t mask, old;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    signal(SIGCHLD, SIG_DFL);
+    sigprocmask(SIG_BLOCK, &mask, &old);
+    int sfd = signalfd(-1, &mask, SFD_CLOEXEC);
+    if (sfd < 0)
+        _exit(1);
+
+    struct pollfd pfd[2] = { { sock, POLLIN, 0 }, { sfd, POLLIN, 0 } };
+    for (;;) {
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (pfd[1].revents & POLLIN) {
+            struct signalfd_siginfo si;
+            if (read(sfd, &si, sizeof(si)) > 0)
+                reap(sock);
+        }
+        if (pfd[0].revents && serve_request(sock, &old) < 0)
+            break;
+    }
+    _exit(0);
+}
+
+/* ---------- shell side ---------- */
+
+int spawn_helper_start(void)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0)
+        return -1;
+
+    pid_t pid = sys_fork(STATS_SPAWN);
+    if (pid < 0) {
+        sys_close(STATS_SPAWN, sv[0]);
+        sys_close(STATS_SPAWN, sv[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        sys_close(STATS_SPAWN, sv[0]);
+        helper_main(sv[1]);
+    }
+    sys_close(STATS_SPAWN, sv[1]);
+    helper_sock = sv[0];
+    return 0;
+}
+
+int spawn_helper_active(void)
+{
+    return helper_sock >= 0;
+}
+
+static void helper_lost(void)
+{
+    fprintf(stderr, "42sh: spawn helper exited, forking directly\n");
+    sys_close(STATS_SPAWN, helper_sock);
+    helper_sock = -1;
+}
+
+static void remember(pid_t pid, int status)
+{
+    if (done_len == done_cap) {
+        done_cap = done_cap ? done_cap * 2 : 16;
+        done = realloc(done, done_cap * sizeof(*done));
+        if (!done)
+            abort();
+    }
+    done[done_len].pid = pid;
+    done[done_len].status = status;
+    done_len++;
+}
+
+static void push_cstr(struct str *s, const char *p)
+{
+    str_appendn(s, p, strlen(p) + 1);
+}
+
+pid_t spawn_helper_spawn(char **argv, const int fds[3])
+{
+    if (helper_sock < 0)
+        return -1;
+
+    struct spawn_req h;
+    memset(&h, 0, sizeof(h));
+    struct str msg;
+    str_init(&msg);
+    str_appendn(&msg, (const char *)&h, sizeof(h));
+
+    char cwd[PATH_MAX];
+    push_cstr(&msg, getcwd(cwd, sizeof(cwd)) ? cwd : ".");
+    for (; argv[h.argc]; h.argc++)
+        push_cstr(&msg, argv[h.argc]);
+    for (char **e = environ; e && *e; e++, h.envc++)
+        push_cstr(&msg, *e);
+    h.payload_len = msg.len - sizeof(h);
+    memcpy(msg.buf, &h, sizeof(h));
+
+    int rc = fd_send(helper_sock, msg.buf, msg.len, fds, 3);
+    str_free(&msg);
+    if (rc < 0) {
+        helper_lost();
+        return -1;
+    }
+
+    struct spawn_msg m;
+    while (fd_read_all(helper_sock, &m, sizeof(m)) == 0) {
+        if (m.kind == SPAWN_EXITED) {
+            remember(m.pid, m.status);
+            continue;
+        }
+        if (m.pid < 0)
+            errno = m.status;
+        return m.pid;
+    }
+    helper_lost();
+    return -1;
+}
+
+int spawn_helper_wait(pid_t pid)
+{
+    for (size_t i = 0; i < done_len; i++) {
+        if (done[i].pid == pid) {
+            int st = done[i].status;
+            done[i] = done[--done_len];
+            return st;
+        }
+    }
+
+    struct spawn_msg m;
+    while (helper_sock >= 0 && fd_read_all(helper_sock, &m, sizeof(m)) == 0) {
+        if (m.kind != SPAWN_EXITED)
+            continue;
+        if (m.pid == pid)
+            return m.status;
+        remember(m.pid, m.status);
+    }
+    if (helper_sock >= 0)
+        helper_lost();
+    return -1;
+}
@@ -0,0 +1,23 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include <sys/types.h>
+
+/*
+ * Optional spawn helper ("zygote"). A small process forked at startup,
+ * before any script is loaded, forks and execs commands on the shell's
+ * behalf, so spawning costs the same however large the shell grows.
+ * Its children are not ours: they are waited for through the helper.
+ */
+
+/* Forks the helper; returns -1 and leaves it disabled on failure */
+int spawn_helper_start(void);
+int spawn_helper_active(void);
+
+/* Runs argv with fds[0..2] as its stdio, the current cwd and environ */
+pid_t spawn_helper_spawn(char **argv, const int fds[3]);
+
+/* Blocks until pid (spawned by the helper) ends; returns its wait status */
+int spawn_helper_wait(pid_t pid);
+
+#endif
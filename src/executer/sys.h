@@ -0,0 +1,68 @@
+#ifndef SYS_H
+#define SYS_H
+
+#include "util/stats.h"
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Process and fd syscalls of the executer, counted per subsystem for --stats */
+
+static inline pid_t sys_fork(enum stats_sub sub)
+{
+    STATS_COUNT(sub, STATS_FORK);
+    return fork();
+}
+
+static inline int sys_execvp(enum stats_sub sub, const char *file, char *const argv[])
+{
+    STATS_COUNT(sub, STATS_EXECVP);
+    return execvp(file, argv);
+}
+
+static inline int sys_execv(enum stats_sub sub, const char *path, char *const argv[])
+{
+    STATS_COUNT(sub, STATS_EXECVP);
+    return execv(path, argv);
+}
+
+static inline int sys_pipe(enum stats_sub sub, int fds[2])
+{
+    STATS_COUNT(sub, STATS_PIPE);
+    return pipe(fds);
+}
+
+#ifdef _GNU_SOURCE
+static inline int sys_pipe2(enum stats_sub sub, int fds[2], int flags)
+{
+    STATS_COUNT(sub, STATS_PIPE);
+    return pipe2(fds, flags);
+}
+#endif
+
+static inline int sys_dup2(enum stats_sub sub, int oldfd, int newfd)
+{
+    STATS_COUNT(sub, STATS_DUP2);
+    return dup2(oldfd, newfd);
+}
+
+static inline int sys_open(enum stats_sub sub, const char *path, int flags, mode_t mode)
+{
+    STATS_COUNT(sub, STATS_OPEN);
+    return open(path, flags, mode);
+}
+
+static inline int sys_close(enum stats_sub sub, int fd)
+{
+    STATS_COUNT(sub, STATS_CLOSE);
+    return close(fd);
+}
+
+static inline pid_t sys_waitpid(enum stats_sub sub, pid_t pid, int *status, int options)
+{
+    STATS_COUNT(sub, STATS_WAITPID);
+    return waitpid(pid, status, options);
+}
+
+#endif
@@ -0,0 +1,89 @@
+#include "casetab.h"
+#include "util/intern.h"
+#include "util/stats.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct case_slot {
+    const char *s;          // NULL for an empty slot
+    size_t len;
+    size_t hash;
+    size_t arm;
+};
+
+struct case_index {
+    struct case_slot *slots;
+    size_t cap;             // power of two, at most half full
+    size_t used;
+};
+
+static void put(struct case_index *ix, struct case_slot e)
+{
+    size_t mask = ix->cap - 1;
+    size_t i = e.hash & mask;
+    while (ix->slots[i].s) {
+        struct case_slot *o = &ix->slots[i];
+        if (o->hash == e.hash && o->len == e.len && memcmp(o->s, e.s, e.len) == 0)
+            return; // an earlier arm already has this string
+        i = (i + 1) & mask;
+    }
+    ix->slots[i] = e;
+    ix->used++;
+}
+
+static void resize(struct case_index *ix, size_t cap)
+{
+    struct case_slot *old = ix->slots;
+    size_t old_cap = ix->cap;
+    ix->slots = calloc(cap, sizeof(*ix->slots));
+    if (!ix->slots)
+        abort();
+    STATS_ALLOC(STATS_EXPAND, cap * sizeof(*ix->slots));
+    ix->cap = cap;
+    ix->used = 0;
+    for (size_t i = 0; i < old_cap; i++)
+        if (old[i].s)
+            put(ix, old[i]);
+    free(old);
+}
+
+struct case_index *case_index_new(size_t hint)
+{
+    struct case_index *ix = calloc(1, sizeof(*ix));
+    if (!ix)
+        abort();
+    STATS_ALLOC(STATS_EXPAND, sizeof(*ix));
+    size_t cap = 8;
+    while (cap < hint * 2)
+        cap *= 2;
+    resize(ix, cap);
+    return ix;
+}
+
+void case_index_add(struct case_index *ix, const char *s, size_t len, size_t arm)
+{
+    if ((ix->used + 1) * 2 > ix->cap)
+        resize(ix, ix->cap * 2);
+    struct case_slot e = { s, len, intern_hash_bytes(s, len), arm };
+    put(ix, e);
+}
+
+long case_index_find(const struct case_index *ix, const char *s, size_t len)
+{
+    size_t h = intern_hash_bytes(s, len);
+    size_t mask = ix->cap - 1;
+    for (size_t i = h & mask; ix->slots[i].s; i = (i + 1) & mask) {
+        const struct case_slot *e = &ix->slots[i];
+        if (e->hash == h && e->len == len && memcmp(e->s, s, len) == 0)
+            return (long)e->arm;
+    }
+    return -1;
+}
+
+void case_index_free(struct case_index *ix)
+{
+    if (!ix)
+        return;
+    free(ix->slots);
+    free(ix);
+}
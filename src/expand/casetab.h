@@ -0,0 +1,22 @@
+#ifndef CASETAB_H
+#define CASETAB_H
+
+#include <stddef.h>
+
+/*
+ * Literal arms of a case command: a hash of the pattern bytes to the first
+ * arm listing them, so a dispatch over hundreds of literal arms is one
+ * probe. Patterns with metacharacters or parameters are matched in order
+ * by the executer, and only up to the arm the table found.
+ */
+
+struct case_index;
+
+struct case_index *case_index_new(size_t hint);
+/* Keeps the first arm added for a given string; s must outlive the table */
+void case_index_add(struct case_index *ix, const char *s, size_t len, size_t arm);
+/* Arm of the literal pattern equal to s, or -1 */
+long case_index_find(const struct case_index *ix, const char *s, size_t len);
+void case_index_free(struct case_index *ix);
+
+#endif
@@ -0,0 +1,274 @@
+#define _GNU_SOURCE
+
+#include "cmdtable.h"
+#include "dircache.h"
+#include "util/intern.h"
+#include "util/str.h"
+#include "util/stats.h"
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CMDTABLE_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB \
+                         | IN_DELETE_SELF | IN_MOVE_SELF)
+
+struct cmd_entry {
+    const char *name;       // interned
+    int dir;                // index in dirs
+};
+
+struct cmd_dir {
+    char *path;
+    int fd;                 // O_PATH, for fstatat on its entries
+};
+
+static char *path_var;      // $PATH the table was built from
+static struct cmd_dir *dirs;
+static int ndirs;
+static struct cmd_entry *cmds;
+static size_t ncmds, cmds_cap;
+static int ino_fd = -1;
+static int stale = 1;
+static unsigned long generation;
+static struct str full;     // last path handed out by cmdtable_lookup
+
+static int is_executable(int dir, const char *name)
+{
+    struct stat st;
+    return dirs[dir].fd >= 0 && fstatat(dirs[dir].fd, name, &st, 0) == 0
+           && S_ISREG(st.st_mode) && (st.st_mode & 0111);
+}
+
+static int cmp_entries(const void *a, const void *b)
+{
+    const struct cmd_entry *x = a, *y = b;
+    int c = strcmp(x->name, y->name);
+    return c ? c : x->dir - y->dir;
+}
+
+/* Index of the first entry whose name is >= key */
+static size_t lower_bound(const char *key)
+{
+    size_t lo = 0, hi = ncmds;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strcmp(cmds[mid].name, key) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Index of the first entry whose first n bytes are >= prefix */
+static size_t prefix_bound(const char *prefix, size_t n)
+{
+    size_t lo = 0, hi = ncmds;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strncmp(cmds[mid].name, prefix, n) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void push_entry(const char *name, int dir)
+{
+    if (ncmds == cmds_cap) {
+        cmds_cap = cmds_cap ? cmds_cap * 2 : 1024;
+        cmds = realloc(cmds, cmds_cap * sizeof(*cmds));
+        if (!cmds)
+            abort();
+        STATS_ALLOC(STATS_EXPAND, cmds_cap * sizeof(*cmds));
+    }
+    cmds[ncmds].name = name;
+    cmds[ncmds].dir = dir;
+    ncmds++;
+}
+
+static void drop_dirs(void)
+{
+    for (int i = 0; i < ndirs; i++) {
+        if (dirs[i].fd >= 0)
+            close(dirs[i].fd);
+        free(dirs[i].path);
+    }
+    free(dirs);
+    dirs = NULL;
+    ndirs = 0;
+    if (ino_fd >= 0)
+        close(ino_fd);
+    ino_fd = -1;
+    ncmds = 0;
+}
+
+static void add_dir(const char *p, size_t n)
+{
+    dirs = realloc(dirs, (ndirs + 1) * sizeof(*dirs));
+    if (!dirs)
+        abort();
+    struct cmd_dir *d = &dirs[ndirs++];
+    d->path = n ? strndup(p, n) : strdup(".");
+    if (!d->path)
+        abort();
+    d->fd = open(d->path, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (ino_fd >= 0)
+        inotify_add_watch(ino_fd, d->path, CMDTABLE_EVENTS);
+}
+
+static void rebuild(void)
+{
+    drop_dirs();
+    free(path_var);
+    const char *path = getenv("PATH");
+    path_var = strdup(path ? path : "");
+    if (!path_var)
+        abort();
+    ino_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    for (const char *p = path_var;; ) {
+        const char *colon = strchr(p, ':');
+        size_t n = colon ? (size_t)(colon - p) : strlen(p);
+        add_dir(p, n);
+        if (!colon)
+            break;
+        p = colon + 1;
+    }
+
+    for (int i = 0; i < ndirs; i++) {
+        const struct dircache_dir *d = dircache_get(dirs[i].path);
+        for (size_t k = 0; d && k < d->len; k++) {
+            const char *name = dircache_name(d, k);
+            if (is_executable(i, name))
+                push_entry(intern_cstr(name), i);
+        }
+    }
+
+    // sorted by name then PATH order: keep the first of each name
+    qsort(cmds, ncmds, sizeof(*cmds), cmp_entries);
+    size_t out = 0;
+    for (size_t i = 0; i < ncmds; i++)
+        if (out == 0 || cmds[out - 1].name != cmds[i].name)
+            cmds[out++] = cmds[i];
+    ncmds = out;
+    stale = 0;
+    generation++;
+}
+
+/* Re-resolves one name after an event in any PATH directory */
+static void update_name(const char *name)
+{
+    int dir = -1;
+    for (int i = 0; i < ndirs && dir < 0; i++)
+        if (is_executable(i, name))
+            dir = i;
+
+    size_t at = lower_bound(name);
+    int present = at < ncmds && strcmp(cmds[at].name, name) == 0;
+    if (present && dir == cmds[at].dir)
+        return;
+
+    if (present && dir < 0) {
+        memmove(cmds + at, cmds + at + 1, (ncmds - at - 1) * sizeof(*cmds));
+        ncmds--;
+    } else if (present) {
+        cmds[at].dir = dir;
+    } else if (dir >= 0) {
+        push_entry(NULL, 0);
+        memmove(cmds + at + 1, cmds + at, (ncmds - at - 1) * sizeof(*cmds));
+        cmds[at].name = intern_cstr(name);
+        cmds[at].dir = dir;
+    } else {
+        return;
+    }
+    generation++;
+}
+
+static void read_events(void)
+{
+    char buf[8192] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+    while ((n = read(ino_fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + n;) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            p += sizeof(*ev) + ev->len;
+            if (ev->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                stale = 1;
+                return;
+            }
+            if (ev->len)
+                update_name(ev->name);
+        }
+    }
+}
+
+void cmdtable_refresh(void)
+{
+    const char *path = getenv("PATH");
+    if (stale || !path_var || strcmp(path_var, path ? path : "") != 0) {
+        rebuild();
+        return;
+    }
+    if (ino_fd >= 0)
+        read_events();
+    if (stale)
+        rebuild();
+}
+
+const char *cmdtable_lookup(const char *name)
+{
+    cmdtable_refresh();
+    size_t at = lower_bound(name);
+    if (at >= ncmds || strcmp(cmds[at].name, name) != 0)
+        return NULL;
+    full.len = 0;
+    str_append(&full, dirs[cmds[at].dir].path);
+    str_pushc(&full, '/');
+    str_append(&full, name);
+    return full.buf;
+}
+
+size_t cmdtable_prefix(const char *prefix, size_t len, size_t *first)
+{
+    cmdtable_refresh();
+    size_t lo = prefix_bound(prefix, len);
+    size_t hi = lo;
+    while (hi < ncmds && strncmp(cmds[hi].name, prefix, len) == 0)
+        hi++;
+    *first = lo;
+    return hi - lo;
+}
+
+const char *cmdtable_name(size_t i)
+{
+    return cmds[i].name;
+}
+
+size_t cmdtable_len(void)
+{
+    return ncmds;
+}
+
+unsigned long cmdtable_generation(void)
+{
+    return generation;
+}
+
+void cmdtable_clear(void)
+{
+    drop_dirs();
+    free(cmds);
+    cmds = NULL;
+    cmds_cap = 0;
+    free(path_var);
+    path_var = NULL;
+    str_free(&full);
+    stale = 1;
+}
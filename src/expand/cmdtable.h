@@ -0,0 +1,30 @@
+#ifndef CMDTABLE_H
+#define CMDTABLE_H
+
+#include <stddef.h>
+
+/*
+ * Executables found along $PATH, one entry per name (the first directory
+ * wins), sorted by name so that exact lookups and prefix completion are
+ * both a binary search. Directories are listed through the dircache and
+ * watched with inotify: a change updates the names it touches instead of
+ * rescanning, and a new $PATH rebuilds the table.
+ */
+
+/* Applies pending changes; cheap when nothing happened */
+void cmdtable_refresh(void);
+
+/* Full path of the command name, or NULL; valid until the next refresh */
+const char *cmdtable_lookup(const char *name);
+
+/* Number of names starting with prefix; *first is the index of the first one */
+size_t cmdtable_prefix(const char *prefix, size_t len, size_t *first);
+const char *cmdtable_name(size_t i);
+size_t cmdtable_len(void);
+
+/* Changes whenever any entry does */
+unsigned long cmdtable_generation(void);
+
+void cmdtable_clear(void);
+
+#endif
@@ -0,0 +1,233 @@
+#include "dircache.h"
+#include "util/stats.h"
+#include <sys/syscall.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DIRCACHE_BUCKETS 256
+#define DIRCACHE_READ_BUF 32768
+/* Two scheduler ticks: a directory changed this recently may change again
+ * without its mtime moving, so its listing is not trusted. */
+#define DIRCACHE_RACY_NS 20000000LL
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+static struct dircache_dir *buckets[DIRCACHE_BUCKETS];
+
+static size_t hash_path(const char *s)
+{
+    size_t h = 1469598103934665603ULL;
+    for (; *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= 1099511628211ULL;
+    }
+    return h % DIRCACHE_BUCKETS;
+}
+
+static void free_listing(struct dircache_dir *d)
+{
+    free(d->names);
+    free(d->offs);
+    free(d->types);
+    d->names = NULL;
+    d->offs = NULL;
+    d->types = NULL;
+    d->names_len = 0;
+    d->len = 0;
+}
+
+static int is_racy(const struct stat *st)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    long long diff = (long long)(now.tv_sec - st->st_mtim.tv_sec) * 1000000000LL
+                     + (now.tv_nsec - st->st_mtim.tv_nsec);
+    return diff < DIRCACHE_RACY_NS;
+}
+
+static int read_listing(struct dircache_dir *d)
+{
+    const char *p = d->path[0] ? d->path : ".";
+    int fd = open(p, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    size_t names_cap = 4096, ents_cap = 64;
+    char *names = malloc(names_cap);
+    size_t *offs = malloc(ents_cap * sizeof(size_t));
+    unsigned char *types = malloc(ents_cap);
+    if (!names || !offs || !types)
+        abort();
+    STATS_ALLOC(STATS_EXPAND, names_cap);
+    STATS_ALLOC(STATS_EXPAND, ents_cap * sizeof(size_t));
+    STATS_ALLOC(STATS_EXPAND, ents_cap);
+    size_t names_len = 0, len = 0;
+
+    char buf[DIRCACHE_READ_BUF];
+    while (1) {
+        long n = syscall(SYS_getdents64, fd, buf, sizeof(buf));
+        if (n < 0) {
+            free(names);
+            free(offs);
+            free(types);
+            close(fd);
+            return -1;
+        }
+        if (n == 0)
+            break;
+
+        for (long pos = 0; pos < n;) {
+            struct linux_dirent64 *e = (struct linux_dirent64 *)(buf + pos);
+            pos += e->d_reclen;
+
+            const char *nm = e->d_name;
+            if (nm[0] == '.' && (nm[1] == '\0' || (nm[1] == '.' && nm[2] == '\0')))
+                continue;
+
+            size_t nl = strlen(nm) + 1;
+            if (names_len + nl > names_cap) {
+                while (names_len + nl > names_cap)
+                    names_cap *= 2;
+                names = realloc(names, names_cap);
+                if (!names)
+                    abort();
+                STATS_ALLOC(STATS_EXPAND, names_cap);
+            }
+            if (len == ents_cap) {
+                ents_cap *= 2;
+                offs = realloc(offs, ents_cap * sizeof(size_t));
+                types = realloc(types, ents_cap);
+                if (!offs || !types)
+                    abort();
+                STATS_ALLOC(STATS_EXPAND, ents_cap * sizeof(size_t));
+                STATS_ALLOC(STATS_EXPAND, ents_cap);
+            }
+            memcpy(names + names_len, nm, nl);
+            offs[len] = names_len;
+            types[len] = e->d_type;
+            names_len += nl;
+            len++;
+        }
+    }
+    close(fd);
+
+    free_listing(d);
+    d->names = names;
+    d->names_len = names_len;
+    d->offs = offs;
+    d->types = types;
+    d->len = len;
+    d->mtime_sec = st.st_mtim.tv_sec;
+    d->mtime_nsec = st.st_mtim.tv_nsec;
+    d->ino = st.st_ino;
+    d->racy = is_racy(&st);
+    return 0;
+}
+
+static int still_valid(struct dircache_dir *d)
+{
+    if (d->racy)
+        return 0;
+    struct stat st;
+    if (stat(d->path[0] ? d->path : ".", &st) < 0)
+        return 0;
+    return st.st_mtim.tv_sec == d->mtime_sec && st.st_mtim.tv_nsec == d->mtime_nsec
+           && st.st_ino == d->ino;
+}
+
+const struct dircache_dir *dircache_get(const char *path)
+{
+    size_t b = hash_path(path);
+    struct dircache_dir *d = buckets[b];
+    while (d && strcmp(d->path, path) != 0)
+        d = d->next;
+
+    if (d) {
+        if (still_valid(d))
+            return d;
+        if (read_listing(d) < 0)
+            return NULL;
+        return d;
+    }
+
+    d = calloc(1, sizeof(*d));
+    if (!d)
+        abort();
+    STATS_ALLOC(STATS_EXPAND, sizeof(*d));
+    d->path = strdup(path);
+    if (!d->path)
+        abort();
+    STATS_ALLOC(STATS_EXPAND, strlen(path) + 1);
+    if (read_listing(d) < 0) {
+        free(d->path);
+        free(d);
+        return NULL;
+    }
+    d->next = buckets[b];
+    buckets[b] = d;
+    return d;
+}
+
+const char *dircache_name(const struct dircache_dir *d, size_t i)
+{
+    return d->names + d->offs[i];
+}
+
+int dircache_is_dir(const struct dircache_dir *d, size_t i)
+{
+    if (d->types[i] == DT_DIR)
+        return 1;
+    if (d->types[i] != DT_UNKNOWN && d->types[i] != DT_LNK)
+        return 0;
+
+    const char *name = dircache_name(d, i);
+    size_t pl = strlen(d->path), nl = strlen(name);
+    char *full = malloc(pl + nl + 2);
+    if (!full)
+        abort();
+    STATS_ALLOC(STATS_EXPAND, pl + nl + 2);
+    memcpy(full, d->path, pl);
+    size_t k = pl;
+    if (pl > 0 && d->path[pl - 1] != '/')
+        full[k++] = '/';
+    memcpy(full + k, name, nl + 1);
+
+    struct stat st;
+    int r = stat(full, &st) == 0 && S_ISDIR(st.st_mode);
+    free(full);
+    return r;
+}
+
+void dircache_clear(void)
+{
+    for (size_t b = 0; b < DIRCACHE_BUCKETS; b++) {
+        struct dircache_dir *d = buckets[b];
+        while (d) {
+            struct dircache_dir *next = d->next;
+            free_listing(d);
+            free(d->path);
+            free(d);
+            d = next;
+        }
+        buckets[b] = NULL;
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef DIRCACHE_H
+#define DIRCACHE_H
+
+#include <stddef.h>
+
+/*
+ * Cached directory listings, shared by pathname expansion and completion.
+ * Entries are read with getdents64 and keep their d_type, so callers only
+ * need a stat() for DT_UNKNOWN / DT_LNK entries. A listing is revalidated
+ * against the directory mtime on every lookup and re-read when it changed.
+ */
+
+struct dircache_dir {
+    char *path;
+    long long mtime_sec;
+    long mtime_nsec;
+    unsigned long long ino;
+    int racy;                /* mtime too close to read time to trust */
+
+    char *names;             /* NUL-separated entry names */
+    size_t names_len;
+    size_t *offs;            /* offset of each name in names */
+    unsigned char *types;    /* d_type of each entry */
+    size_t len;
+
+    struct dircache_dir *next;
+};
+
+/* Returns the listing of path ("" means "."), or NULL if it cannot be read */
+const struct dircache_dir *dircache_get(const char *path);
+const char *dircache_name(const struct dircache_dir *d, size_t i);
+
+/* 1 if entry i is a directory (follows symlinks), 0 otherwise */
+int dircache_is_dir(const struct dircache_dir *d, size_t i);
+
+void dircache_clear(void);
+
+#endif
@@ -0,0 +1,395 @@
+#include "expand.h"
+#include "glob.h"
+#include "vars.h"
+#include "lexer/word.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IFS_DEFAULT " \t\n"
+
+struct field {
+    int started;    /* a field is open, possibly still empty */
+    size_t start;   /* its offset in sc->text */
+    int use_pat;    /* the word may need pathname expansion */
+    int magic;      /* the field has an unquoted metacharacter */
+};
+
+void expand_scratch_init(struct expand_scratch *sc)
+{
+    str_init(&sc->text);
+    vec_init(&sc->fields);
+    str_init(&sc->kinds);
+    vec_init(&sc->targets);
+    str_init(&sc->pat);
+    vec_init(&sc->owned);
+    sc->ifs_key[0] = '\0';
+    sc->ifs_ready = 0;
+}
+
+static int is_meta(char c)
+{
+    return c == '*' || c == '?' || c == '[';
+}
+
+static int is_ifs_ws(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n';
+}
+
+static void load_ifs(struct expand_scratch *sc)
+{
+    size_t len;
+    const char *v = vars_lookup("IFS", 3, &len);
+    if (!v) {
+        v = IFS_DEFAULT;
+        len = strlen(IFS_DEFAULT);
+    }
+    if (sc->ifs_ready && strlen(sc->ifs_key) == len && memcmp(sc->ifs_key, v, len) == 0)
+        return;
+
+    memset(sc->ifs, 0, sizeof(sc->ifs));
+    for (size_t i = 0; i < len; i++)
+        sc->ifs[(unsigned char)v[i]] = 1;
+
+    // IFS values too long to remember are simply rebuilt on the next split
+    sc->ifs_ready = len < sizeof(sc->ifs_key);
+    if (sc->ifs_ready) {
+        memcpy(sc->ifs_key, v, len);
+        sc->ifs_key[len] = '\0';
+    }
+}
+
+static size_t next_ifs(const struct expand_scratch *sc, const char *v, size_t n, size_t pos)
+{
+    if (sc->ifs_ready && sc->ifs_key[0] && !sc->ifs_key[1]) {
+        const char *hit = memchr(v + pos, sc->ifs_key[0], n - pos);
+        return hit ? (size_t)(hit - v) : n;
+    }
+    while (pos < n && !sc->ifs[(unsigned char)v[pos]])
+        pos++;
+    return pos;
+}
+
+static void open_field(struct expand_scratch *sc, struct field *f)
+{
+    if (f->started)
+        return;
+    f->started = 1;
+    f->start = sc->text.len;
+    f->magic = 0;
+    sc->pat.len = 0;
+}
+
+static void add_bytes(struct expand_scratch *sc, struct field *f, const char *p, size_t n,
+                      int quoted)
+{
+    open_field(sc, f);
+    str_appendn(&sc->text, p, n);
+    if (!f->use_pat)
+        return;
+    for (size_t i = 0; i < n; i++) {
+        if (p[i] == '\\' || (quoted && is_meta(p[i])))
+            str_pushc(&sc->pat, '\\');
+        else if (is_meta(p[i]))
+            f->magic = 1;
+        str_pushc(&sc->pat, p[i]);
+    }
+}
+
+static void push_offset(struct vec *v, struct str *kinds, size_t off)
+{
+    vec_push(v, (void *)(uintptr_t)off);
+    if (kinds)
+        str_pushc(kinds, 1);
+}
+
+static void push_pointer(struct expand_scratch *sc, char *p)
+{
+    vec_push(&sc->fields, p);
+    str_pushc(&sc->kinds, 0);
+}
+
+static void close_field(struct expand_scratch *sc, struct field *f)
+{
+    if (!f->started)
+        return;
+    f->started = 0;
+
+    if (f->magic) {
+        struct glob_pat *g = glob_compile(sc->pat.buf ? sc->pat.buf : "");
+        size_t before = sc->owned.len;
+        size_t found = glob_expand(g, &sc->owned);
+        glob_free(g);
+        if (found > 0) {
+            sc->text.len = f->start;
+            for (size_t k = before; k < sc->owned.len; k++)
+                push_pointer(sc, vec_get(&sc->owned, k));
+            return;
+        }
+    }
+
+    str_pushc(&sc->text, '\0');
+    push_offset(&sc->fields, &sc->kinds, f->start);
+}
+
+static void split_value(struct expand_scratch *sc, struct field *f, const char *v, size_t n)
+{
+    size_t pos = 0;
+    while (pos < n) {
+        size_t i = next_ifs(sc, v, n, pos);
+        if (i > pos)
+            add_bytes(sc, f, v + pos, i - pos, 0);
+        if (i >= n)
+            break;
+
+        // one delimiter: IFS whitespace around at most one other IFS byte
+        int hard = !is_ifs_ws(v[i]);
+        size_t j = i + 1;
+        while (j < n && sc->ifs[(unsigned char)v[j]] && is_ifs_ws(v[j]))
+            j++;
+        if (!hard && j < n && sc->ifs[(unsigned char)v[j]]) {
+            hard = 1;
+            j++;
+            while (j < n && sc->ifs[(unsigned char)v[j]] && is_ifs_ws(v[j]))
+                j++;
+        }
+
+        if (hard)
+            open_field(sc, f);
+        close_field(sc, f);
+        pos = j;
+    }
+}
+
+static int is_quoted_at(const struct word_seg *s, const char *p)
+{
+    return s->type == SEG_PARAM && s->quoted && s->len == 1 && p[0] == '@';
+}
+
+/* True if the word is "$@" with nothing else but empty quotes: no arguments, no field */
+static int only_quoted_at(const struct word *w)
+{
+    int at = 0;
+    for (size_t i = 0; i < w->nsegs; i++) {
+        const struct word_seg *s = &w->segs[i];
+        if (is_quoted_at(s, w->text.buf + s->off))
+            at = 1;
+        else if (s->type != SEG_LIT || s->len > 0)
+            return 0;
+    }
+    return at;
+}
+
+/* "$@": each positional parameter is a field, the first and last joined to what is around */
+static void add_positional(struct expand_scratch *sc, struct field *f)
+{
+    int n = vars_argc();
+    for (int k = 1; k <= n; k++) {
+        const char *a = vars_arg(k);
+        if (k > 1) {
+            open_field(sc, f);
+            close_field(sc, f);
+        }
+        add_bytes(sc, f, a, strlen(a), 1);
+    }
+}
+
+/* Unquoted $@ and $*: each positional parameter is split on its own, never joined to the next */
+static void split_positional(struct expand_scratch *sc, struct field *f)
+{
+    int n = vars_argc();
+    for (int k = 1; k <= n; k++) {
+        if (k > 1)
+            close_field(sc, f);
+        const char *a = vars_arg(k);
+        split_value(sc, f, a, strlen(a));
+    }
+}
+
+/* Expands one word into zero or more fields appended to sc->fields */
+static void expand_fields(struct expand_scratch *sc, const struct word *w)
+{
+    struct field f;
+    memset(&f, 0, sizeof(f));
+    f.use_pat = 1;
+    load_ifs(sc);
+    if (vars_argc() == 0 && only_quoted_at(w))
+        return;
+
+    for (size_t i = 0; i < w->nsegs; i++) {
+        const struct word_seg *s = &w->segs[i];
+        const char *p = w->text.buf + s->off;
+
+        if (s->type == SEG_LIT) {
+            add_bytes(sc, &f, p, s->len, s->quoted);
+            continue;
+        }
+        if (is_quoted_at(s, p)) {
+            add_positional(sc, &f);
+            continue;
+        }
+        if (!s->quoted && s->len == 1 && (p[0] == '@' || p[0] == '*')) {
+            split_positional(sc, &f);
+            continue;
+        }
+
+        size_t vl;
+        const char *v = vars_lookup(p, s->len, &vl);
+        if (s->quoted)
+            add_bytes(sc, &f, v ? v : "", vl, 1);
+        else if (v)
+            split_value(sc, &f, v, vl);
+    }
+    close_field(sc, &f);
+}
+
+/* Expands one word into a single string (no splitting, no globbing) */
+static size_t expand_string(struct expand_scratch *sc, const struct word *w)
+{
+    size_t start = sc->text.len;
+    for (size_t i = 0; i < w->nsegs; i++) {
+        const struct word_seg *s = &w->segs[i];
+        const char *p = w->text.buf + s->off;
+        if (s->type == SEG_LIT) {
+            str_appendn(&sc->text, p, s->len);
+            continue;
+        }
+        size_t vl;
+        const char *v = vars_lookup(p, s->len, &vl);
+        if (v)
+            str_appendn(&sc->text, v, vl);
+    }
+    str_pushc(&sc->text, '\0');
+    return start;
+}
+
+static void push_targets(struct expand_scratch *sc, struct redirection *redirs, size_t len,
+                         struct word **words)
+{
+    for (size_t i = 0; i < len; i++) {
+        size_t off;
+        if (words[i]) {
+            off = expand_string(sc, words[i]);
+        } else {
+            off = sc->text.len;
+            str_append(&sc->text, redirs[i].target);
+            str_pushc(&sc->text, '\0');
+        }
+        push_offset(&sc->targets, NULL, off);
+    }
+}
+
+static void fix_targets(struct expand_scratch *sc)
+{
+    for (size_t i = 0; i < sc->targets.len; i++)
+        sc->targets.data[i] = sc->text.buf + (uintptr_t)sc->targets.data[i];
+}
+
+char **expand_command(struct expand_scratch *sc, struct ast_simple *simple, char ***targets)
+{
+    *targets = NULL;
+    if (!simple->words && !simple->globs && !simple->redir_words)
+        return simple->argv;
+
+    for (size_t i = 0; simple->argv[i]; i++) {
+        // assignments are one field each, never split or globbed
+        if (i < simple->assign_len) {
+            if (simple->words && simple->words[i])
+                push_offset(&sc->fields, &sc->kinds, expand_string(sc, simple->words[i]));
+            else
+                push_pointer(sc, simple->argv[i]);
+            continue;
+        }
+        if (simple->words && simple->words[i]) {
+            expand_fields(sc, simple->words[i]);
+            continue;
+        }
+        if (simple->globs && simple->globs[i]) {
+            size_t before = sc->owned.len;
+            if (glob_expand(simple->globs[i], &sc->owned) > 0) {
+                for (size_t k = before; k < sc->owned.len; k++)
+                    push_pointer(sc, vec_get(&sc->owned, k));
+                continue;
+            }
+        }
+        push_pointer(sc, simple->argv[i]);
+    }
+
+    if (simple->redir_words)
+        push_targets(sc, simple->redirs, simple->redir_len, simple->redir_words);
+
+    // the text buffer no longer moves: turn offsets into pointers
+    for (size_t i = 0; i < sc->fields.len; i++) {
+        if (sc->kinds.buf[i])
+            sc->fields.data[i] = sc->text.buf + (uintptr_t)sc->fields.data[i];
+    }
+    fix_targets(sc);
+
+    vec_push(&sc->fields, NULL);
+    if (simple->redir_words)
+        *targets = (char **)sc->targets.data;
+    return (char **)sc->fields.data;
+}
+
+char **expand_redirs(struct expand_scratch *sc, struct redirection *redirs, size_t len,
+                     struct word **words)
+{
+    if (!words)
+        return NULL;
+    push_targets(sc, redirs, len, words);
+    fix_targets(sc);
+    return (char **)sc->targets.data;
+}
+
+const char *expand_word(struct expand_scratch *sc, const struct word *w, size_t *len)
+{
+    size_t off = expand_string(sc, w);
+    *len = sc->text.len - off - 1;
+    return sc->text.buf + off;
+}
+
+const char *expand_pattern(struct expand_scratch *sc, const struct word *w)
+{
+    struct field f;
+    memset(&f, 0, sizeof(f));
+    f.use_pat = 1;
+    size_t start = sc->text.len;
+    open_field(sc, &f);
+    for (size_t i = 0; i < w->nsegs; i++) {
+        const struct word_seg *s = &w->segs[i];
+        const char *p = w->text.buf + s->off;
+        if (s->type == SEG_LIT) {
+            add_bytes(sc, &f, p, s->len, s->quoted);
+            continue;
+        }
+        size_t vl;
+        const char *v = vars_lookup(p, s->len, &vl);
+        add_bytes(sc, &f, v ? v : "", v ? vl : 0, s->quoted); // unquoted values stay patterns
+    }
+    sc->text.len = start;
+    str_pushc(&sc->pat, '\0');
+    return sc->pat.buf;
+}
+
+void expand_release(struct expand_scratch *sc)
+{
+    for (size_t i = 0; i < sc->owned.len; i++)
+        free(vec_get(&sc->owned, i));
+    sc->owned.len = 0;
+    sc->text.len = 0;
+    sc->fields.len = 0;
+    sc->kinds.len = 0;
+    sc->targets.len = 0;
+}
+
+void expand_scratch_free(struct expand_scratch *sc)
+{
+    expand_release(sc);
+    str_free(&sc->text);
+    vec_free(&sc->fields);
+    str_free(&sc->kinds);
+    vec_free(&sc->targets);
+    str_free(&sc->pat);
+    vec_free(&sc->owned);
+}
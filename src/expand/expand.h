@@ -0,0 +1,45 @@
+#ifndef EXPAND_H
+#define EXPAND_H
+
+#include "parser/ast.h"
+#include "util/str.h"
+#include "util/vec.h"
+
+/*
+ * One-pass argv construction. Every field is written straight into a
+ * reusable scratch buffer; IFS splitting works on views of the parameter
+ * values, so no intermediate string is built per word or per field.
+ */
+
+struct expand_scratch {
+    struct str text;        /* assembled fields, each NUL-terminated */
+    struct vec fields;      /* argv entries: offset in text, or pointer */
+    struct str kinds;       /* 1 if fields[i] is an offset in text */
+    struct vec targets;     /* expanded redirection targets (offsets) */
+    struct str pat;         /* pattern form of the current field */
+    struct vec owned;       /* pathname expansion results */
+
+    unsigned char ifs[256]; /* IFS membership, rebuilt when IFS changes */
+    char ifs_key[32];
+    int ifs_ready;
+};
+
+void expand_scratch_init(struct expand_scratch *sc);
+
+/*
+ * Returns the argv to run; *targets gets per-redirection targets (or NULL
+ * when no target needs expansion). Both stay valid until expand_release.
+ */
+char **expand_command(struct expand_scratch *sc, struct ast_simple *simple, char ***targets);
+
+/* Targets of a compound command's redirections, or NULL if all are static */
+char **expand_redirs(struct expand_scratch *sc, struct redirection *redirs, size_t len,
+                     struct word **words);
+/* One string, never split or globbed (e.g. a case subject); valid until expand_release */
+const char *expand_word(struct expand_scratch *sc, const struct word *w, size_t *len);
+/* Pattern with parameters substituted, quoted metacharacters escaped; valid until the next call */
+const char *expand_pattern(struct expand_scratch *sc, const struct word *w);
+void expand_release(struct expand_scratch *sc);
+void expand_scratch_free(struct expand_scratch *sc);
+
+#endif
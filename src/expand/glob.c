@@ -0,0 +1,434 @@
+#include "glob.h"
+#include "dircache.h"
+#include "util/str.h"
+#include "util/stats.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+enum atom_type {
+    ATOM_LIT,   /* run of literal bytes */
+    ATOM_ANY,   /* ? */
+    ATOM_SET,   /* [...] */
+    ATOM_STAR   /* * */
+};
+
+struct glob_atom {
+    enum atom_type type;
+    size_t off;                 /* ATOM_LIT: offset in comp->lit */
+    size_t len;                 /* ATOM_LIT: length */
+    unsigned char set[32];      /* ATOM_SET: 256-bit membership */
+};
+
+struct glob_comp {
+    int literal;                /* no metacharacter: joined without readdir */
+    char *lit;                  /* unescaped literal bytes */
+    size_t lit_len;
+
+    struct glob_atom *atoms;
+    size_t natoms;
+    size_t min_len;             /* bytes consumed by non-star atoms */
+    int has_star;
+    size_t prefix_len;          /* leading literal run, checked with memcmp */
+    size_t suffix_len;          /* trailing literal run after the last star */
+    int dot_explicit;           /* pattern starts with a literal '.' */
+};
+
+struct glob_pat {
+    int absolute;
+    int dir_only;               /* pattern ended with '/' */
+    struct glob_comp *comps;
+    size_t ncomps;
+};
+
+static void set_add(unsigned char *set, unsigned char c)
+{
+    set[c >> 3] |= (unsigned char)(1u << (c & 7));
+}
+
+static int set_has(const unsigned char *set, unsigned char c)
+{
+    return (set[c >> 3] >> (c & 7)) & 1;
+}
+
+static int class_add(unsigned char *set, const char *name, size_t len)
+{
+    static const struct {
+        const char *name;
+        int (*fn)(int);
+    } classes[] = {
+        { "alnum", isalnum }, { "alpha", isalpha }, { "blank", isblank },
+        { "cntrl", iscntrl }, { "digit", isdigit }, { "graph", isgraph },
+        { "lower", islower }, { "print", isprint }, { "punct", ispunct },
+        { "space", isspace }, { "upper", isupper }, { "xdigit", isxdigit },
+    };
+    for (size_t i = 0; i < sizeof(classes) / sizeof(classes[0]); i++) {
+        if (strlen(classes[i].name) == len && memcmp(classes[i].name, name, len) == 0) {
+            for (int c = 0; c < 256; c++)
+                if (classes[i].fn(c))
+                    set_add(set, (unsigned char)c);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Parses a bracket expression starting after '['. Returns the number of
+ * pattern bytes consumed (up to and including ']'), or 0 if unterminated,
+ * in which case the '[' is an ordinary character.
+ */
+static size_t parse_bracket(const char *p, size_t n, unsigned char *set)
+{
+    size_t i = 0;
+    int negate = 0;
+    memset(set, 0, 32);
+
+    if (i < n && (p[i] == '!' || p[i] == '^')) {
+        negate = 1;
+        i++;
+    }
+
+    int first = 1;
+    while (i < n) {
+        unsigned char c = (unsigned char)p[i];
+        if (c == ']' && !first) {
+            i++;
+            if (negate)
+                for (int k = 0; k < 32; k++)
+                    set[k] = (unsigned char)~set[k];
+            return i;
+        }
+        first = 0;
+
+        if (c == '[' && i + 1 < n && p[i + 1] == ':') {
+            const char *end = strstr(p + i + 2, ":]");
+            if (end && (size_t)(end - p) < n
+                && class_add(set, p + i + 2, (size_t)(end - (p + i + 2)))) {
+                i = (size_t)(end - p) + 2;
+                continue;
+            }
+        }
+
+        if (c == '\\' && i + 1 < n) {
+            c = (unsigned char)p[++i];
+        }
+        i++;
+
+        if (i + 1 < n && p[i] == '-' && p[i + 1] != ']') {
+            unsigned char hi = (unsigned char)p[i + 1];
+            i += 2;
+            if (hi == '\\' && i < n)
+                hi = (unsigned char)p[i++];
+            for (unsigned v = c; v <= hi; v++)
+                set_add(set, (unsigned char)v);
+        } else {
+            set_add(set, c);
+        }
+    }
+    return 0;
+}
+
+static void push_atom(struct glob_comp *c, size_t *cap, struct glob_atom a)
+{
+    if (c->natoms == *cap) {
+        *cap = *cap ? *cap * 2 : 8;
+        c->atoms = realloc(c->atoms, *cap * sizeof(struct glob_atom));
+        if (!c->atoms)
+            abort();
+        STATS_ALLOC(STATS_EXPAND, *cap * sizeof(struct glob_atom));
+    }
+    c->atoms[c->natoms++] = a;
+}
+
+static void compile_comp(struct glob_comp *c, const char *p, size_t n)
+{
+    struct str lit;
+    str_init(&lit);
+    size_t cap = 0;
+    int magic = 0;
+
+    memset(c, 0, sizeof(*c));
+
+    for (size_t i = 0; i < n; i++) {
+        char ch = p[i];
+        struct glob_atom a;
+        memset(&a, 0, sizeof(a));
+
+        if (ch == '\\' && i + 1 < n) {
+            ch = p[++i];
+        } else if (ch == '*') {
+            magic = 1;
+            if (c->natoms > 0 && c->atoms[c->natoms - 1].type == ATOM_STAR)
+                continue;
+            a.type = ATOM_STAR;
+            push_atom(c, &cap, a);
+            c->has_star = 1;
+            continue;
+        } else if (ch == '?') {
+            magic = 1;
+            a.type = ATOM_ANY;
+            push_atom(c, &cap, a);
+            c->min_len++;
+            continue;
+        } else if (ch == '[') {
+            size_t used = parse_bracket(p + i + 1, n - i - 1, a.set);
+            if (used > 0) {
+                magic = 1;
+                a.type = ATOM_SET;
+                push_atom(c, &cap, a);
+                c->min_len++;
+                i += used;
+                continue;
+            }
+        }
+
+        /* literal byte: extend the previous run or start a new one */
+        if (c->natoms > 0 && c->atoms[c->natoms - 1].type == ATOM_LIT
+            && c->atoms[c->natoms - 1].off + c->atoms[c->natoms - 1].len == lit.len) {
+            c->atoms[c->natoms - 1].len++;
+        } else {
+            a.type = ATOM_LIT;
+            a.off = lit.len;
+            a.len = 1;
+            push_atom(c, &cap, a);
+        }
+        str_pushc(&lit, ch);
+        c->min_len++;
+    }
+
+    c->lit_len = lit.len;
+    c->lit = str_take(&lit);
+    c->literal = !magic;
+
+    if (c->natoms > 0 && c->atoms[0].type == ATOM_LIT) {
+        c->prefix_len = c->atoms[0].len;
+        c->dot_explicit = c->lit[0] == '.';
+    }
+    if (c->has_star && c->natoms > 0 && c->atoms[c->natoms - 1].type == ATOM_LIT)
+        c->suffix_len = c->atoms[c->natoms - 1].len;
+}
+
+static int atom_eq(const struct glob_comp *c, const struct glob_atom *a,
+                   const char *s, size_t n, size_t si)
+{
+    switch (a->type) {
+        case ATOM_LIT:
+            return si + a->len <= n && memcmp(s + si, c->lit + a->off, a->len) == 0;
+        case ATOM_ANY:
+            return si < n;
+        case ATOM_SET:
+            return si < n && set_has(a->set, (unsigned char)s[si]);
+        default:
+            return 0;
+    }
+}
+
+static size_t atom_width(const struct glob_atom *a)
+{
+    return a->type == ATOM_LIT ? a->len : 1;
+}
+
+static int comp_match(const struct glob_comp *c, const char *s, size_t n)
+{
+    if (n < c->min_len || (!c->has_star && n != c->min_len))
+        return 0;
+    if (s[0] == '.' && !c->dot_explicit)
+        return 0;
+    if (c->prefix_len && memcmp(s, c->lit, c->prefix_len) != 0)
+        return 0;
+    if (c->suffix_len) {
+        const struct glob_atom *last = &c->atoms[c->natoms - 1];
+        if (memcmp(s + n - last->len, c->lit + last->off, last->len) != 0)
+            return 0;
+    }
+
+    /* greedy matching: only the most recent star is ever retried */
+    size_t ai = 0, si = 0;
+    size_t star_ai = (size_t)-1, star_si = 0;
+    while (si < n) {
+        if (ai < c->natoms && c->atoms[ai].type == ATOM_STAR) {
+            star_ai = ++ai;
+            star_si = si;
+            continue;
+        }
+        if (ai < c->natoms && atom_eq(c, &c->atoms[ai], s, n, si)) {
+            si += atom_width(&c->atoms[ai]);
+            ai++;
+            continue;
+        }
+        if (star_ai != (size_t)-1) {
+            ai = star_ai;
+            si = ++star_si;
+            continue;
+        }
+        return 0;
+    }
+    while (ai < c->natoms && c->atoms[ai].type == ATOM_STAR)
+        ai++;
+    return ai == c->natoms;
+}
+
+struct glob_pat *glob_compile(const char *pattern)
+{
+    struct glob_pat *p = calloc(1, sizeof(*p));
+    if (!p)
+        abort();
+    STATS_ALLOC(STATS_EXPAND, sizeof(*p));
+
+    size_t n = strlen(pattern);
+    p->absolute = n > 0 && pattern[0] == '/';
+    p->dir_only = n > 1 && pattern[n - 1] == '/';
+
+    size_t cap = 0;
+    size_t i = 0;
+    while (i < n) {
+        while (i < n && pattern[i] == '/')
+            i++;
+        if (i >= n)
+            break;
+        size_t start = i;
+        while (i < n && pattern[i] != '/') {
+            if (pattern[i] == '\\' && i + 1 < n)
+                i++;
+            i++;
+        }
+        if (p->ncomps == cap) {
+            cap = cap ? cap * 2 : 4;
+            p->comps = realloc(p->comps, cap * sizeof(struct glob_comp));
+            if (!p->comps)
+                abort();
+            STATS_ALLOC(STATS_EXPAND, cap * sizeof(struct glob_comp));
+        }
+        compile_comp(&p->comps[p->ncomps++], pattern + start, i - start);
+    }
+    return p;
+}
+
+struct glob_pat *glob_compile_match(const char *pattern)
+{
+    struct glob_pat *p = calloc(1, sizeof(*p));
+    if (!p)
+        abort();
+    STATS_ALLOC(STATS_EXPAND, sizeof(*p) + sizeof(struct glob_comp));
+    p->comps = malloc(sizeof(struct glob_comp));
+    if (!p->comps)
+        abort();
+    p->ncomps = 1;
+    compile_comp(&p->comps[0], pattern, strlen(pattern));
+    p->comps[0].dot_explicit = 1; // a leading dot is an ordinary byte here
+    return p;
+}
+
+int glob_match(const struct glob_pat *p, const char *s, size_t n)
+{
+    const struct glob_comp *c = &p->comps[0];
+    if (c->literal)
+        return n == c->lit_len && (n == 0 || memcmp(s, c->lit, n) == 0);
+    return comp_match(c, s, n);
+}
+
+void glob_free(struct glob_pat *p)
+{
+    if (!p)
+        return;
+    for (size_t i = 0; i < p->ncomps; i++) {
+        free(p->comps[i].lit);
+        free(p->comps[i].atoms);
+    }
+    free(p->comps);
+    free(p);
+}
+
+static void path_join(struct str *path, const char *name, size_t len)
+{
+    if (path->len > 0 && path->buf[path->len - 1] != '/')
+        str_pushc(path, '/');
+    for (size_t i = 0; i < len; i++)
+        str_pushc(path, name[i]);
+}
+
+static void path_truncate(struct str *path, size_t len)
+{
+    path->len = len;
+    if (path->buf)
+        path->buf[len] = '\0';
+}
+
+static void emit(const struct glob_pat *p, struct str *path, struct vec *out)
+{
+    struct str s;
+    str_init(&s);
+    str_append(&s, path->buf ? path->buf : "");
+    if (p->dir_only)
+        str_pushc(&s, '/');
+    vec_push(out, str_take(&s));
+}
+
+static void walk(const struct glob_pat *p, size_t ci, struct str *path, int need_check,
+                 struct vec *out)
+{
+    if (ci == p->ncomps) {
+        /* trailing literal components were never read from disk */
+        if (need_check && access(path->buf, F_OK) != 0)
+            return;
+        emit(p, path, out);
+        return;
+    }
+
+    const struct glob_comp *c = &p->comps[ci];
+    size_t saved = path->len;
+
+    if (c->literal) {
+        path_join(path, c->lit, c->lit_len);
+        walk(p, ci + 1, path, 1, out);
+        path_truncate(path, saved);
+        return;
+    }
+
+    const struct dircache_dir *d = dircache_get(path->buf ? path->buf : "");
+    if (!d)
+        return;
+
+    int want_dir = ci + 1 < p->ncomps || p->dir_only;
+    for (size_t i = 0; i < d->len; i++) {
+        const char *name = dircache_name(d, i);
+        if (!comp_match(c, name, strlen(name)))
+            continue;
+        if (want_dir && !dircache_is_dir(d, i))
+            continue;
+        path_join(path, name, strlen(name));
+        walk(p, ci + 1, path, 0, out);
+        path_truncate(path, saved);
+    }
+}
+
+static int cmp_str(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+int glob_is_literal(const struct glob_pat *p)
+{
+    for (size_t i = 0; i < p->ncomps; i++)
+        if (!p->comps[i].literal)
+            return 0;
+    return 1;
+}
+
+size_t glob_expand(const struct glob_pat *p, struct vec *out)
+{
+    struct str path;
+    str_init(&path);
+    if (p->absolute)
+        str_pushc(&path, '/');
+
+    size_t before = out->len;
+    walk(p, 0, &path, 0, out);
+    str_free(&path);
+
+    size_t found = out->len - before;
+    qsort(out->data + before, found, sizeof(void *), cmp_str);
+    return found;
+}
@@ -0,0 +1,35 @@
+#ifndef EXPAND_GLOB_H
+#define EXPAND_GLOB_H
+
+#include "util/vec.h"
+
+/*
+ * Pathname expansion. A pattern is compiled once (per AST word) into a list
+ * of path components; literal components are joined without reading the
+ * directory, the others become small matchers run against cached listings.
+ *
+ * In the pattern text a backslash makes the next character literal, which
+ * is how the lexer marks quoted metacharacters.
+ */
+
+struct glob_pat;
+
+struct glob_pat *glob_compile(const char *pattern);
+void glob_free(struct glob_pat *p);
+
+/*
+ * Whole-string matching, as for case patterns: '/' and a leading '.' are
+ * ordinary bytes. The matcher checks the length bounds and the literal
+ * prefix and suffix before it walks the pattern, and retries only the
+ * last star, so it never backtracks more than once per byte.
+ */
+struct glob_pat *glob_compile_match(const char *pattern);
+int glob_match(const struct glob_pat *p, const char *s, size_t n);
+
+/* No component has a live metacharacter (e.g. a lone '['): expands to itself */
+int glob_is_literal(const struct glob_pat *p);
+
+/* Pushes the sorted matches (malloc'd) to out; returns how many were found */
+size_t glob_expand(const struct glob_pat *p, struct vec *out);
+
+#endif
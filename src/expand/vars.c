@@ -0,0 +1,278 @@
+#include "vars.h"
+#include "util/intern.h"
+#include "util/stats.h"
+#include "util/str.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+extern char **environ;
+
+static int last_status;
+static int pos_argc;
+static char **pos_argv;     /* pos_argv[0] is $0 */
+
+static char status_buf[16];
+static int status_buf_for = -1;
+static char num_buf[24];
+static pid_t shell_pid;     /* $$: the shell the script started in, not a subshell */
+static struct str joined;   /* cache for $@ / $* */
+static int joined_valid;
+static int joined_sep;      /* byte joined was built with, -1 for none */
+
+/* Shell variables: open addressing on the interned name */
+struct shell_var {
+    const char *name;       // interned, NULL for an empty slot
+    struct str value;
+    int set;                // 0 once unset; the slot stays
+    int exported;           // came from the environment, which follows its changes
+    unsigned saved_in;      // snapshot whose undo log already holds this variable
+};
+
+static struct shell_var *table;
+static size_t table_cap;
+static size_t table_used;
+
+/* State of a variable before the innermost snapshot first changed it */
+struct var_undo {
+    const char *name;
+    struct str value;
+    int set;
+    int exported;
+};
+
+static struct var_undo *undo;
+static size_t undo_len, undo_cap;
+static unsigned snap_active;    // innermost snapshot, 0 if none
+static unsigned snap_next;
+
+void vars_set_status(int status)
+{
+    last_status = status;
+}
+
+int vars_status(void)
+{
+    return last_status;
+}
+
+void vars_set_positional(int argc, char **argv)
+{
+    pos_argc = argc;
+    pos_argv = argv;
+    joined_valid = 0;
+    shell_pid = getpid();
+}
+
+int vars_argc(void)
+{
+    return pos_argc > 0 ? pos_argc - 1 : 0;
+}
+
+const char *vars_arg(int i)
+{
+    return i > 0 && i < pos_argc ? pos_argv[i] : NULL;
+}
+
+static struct shell_var *slot_for(const char *name)
+{
+    size_t mask = table_cap - 1;
+    size_t i = intern_hash(name) & mask;
+    while (table[i].name && table[i].name != name)
+        i = (i + 1) & mask;
+    return &table[i];
+}
+
+static void grow_table(void)
+{
+    struct shell_var *old = table;
+    size_t old_cap = table_cap;
+    table_cap = table_cap ? table_cap * 2 : 64;
+    table = calloc(table_cap, sizeof(*table));
+    if (!table)
+        abort();
+    STATS_ALLOC(STATS_EXPAND, table_cap * sizeof(*table));
+    for (size_t i = 0; i < old_cap; i++)
+        if (old[i].name)
+            *slot_for(old[i].name) = old[i];
+    free(old);
+}
+
+static const char *from_env(const char *name, size_t len, size_t *out_len)
+{
+    for (char **e = environ; e && *e; e++) {
+        if ((*e)[0] == name[0] && strncmp(*e, name, len) == 0 && (*e)[len] == '=') {
+            const char *v = *e + len + 1;
+            *out_len = strlen(v);
+            return v;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * The slot of a name, created the first time the name is seen: the
+ * environment is scanned once per name, later changes go through vars_set.
+ */
+static struct shell_var *get_var(const char *name, size_t len)
+{
+    if ((table_used + 1) * 2 > table_cap)
+        grow_table();
+    const char *key = intern(name, len);
+    struct shell_var *v = slot_for(key);
+    if (v->name)
+        return v;
+    v->name = key;
+    str_init(&v->value);
+    size_t vl;
+    const char *env = from_env(name, len, &vl);
+    if (env) {
+        str_appendn(&v->value, env, vl);
+        v->set = v->exported = 1;
+    }
+    table_used++;
+    return v;
+}
+
+static void remember(struct shell_var *v)
+{
+    if (!snap_active || v->saved_in == snap_active)
+        return;
+    if (undo_len == undo_cap) {
+        undo_cap = undo_cap ? undo_cap * 2 : 16;
+        undo = realloc(undo, undo_cap * sizeof(*undo));
+        if (!undo)
+            abort();
+        STATS_ALLOC(STATS_EXPAND, undo_cap * sizeof(*undo));
+    }
+    struct var_undo *u = &undo[undo_len++];
+    u->name = v->name;
+    str_init(&u->value);
+    str_appendn(&u->value, v->value.buf ? v->value.buf : "", v->value.len);
+    u->set = v->set;
+    u->exported = v->exported;
+    v->saved_in = snap_active;
+}
+
+void vars_snapshot(struct vars_snapshot *s)
+{
+    s->mark = undo_len;
+    s->outer = snap_active;
+    s->id = snap_active = ++snap_next;
+}
+
+void vars_restore(const struct vars_snapshot *s)
+{
+    while (undo_len > s->mark) {
+        struct var_undo *u = &undo[--undo_len];
+        struct shell_var *v = slot_for(u->name);
+        str_free(&v->value);
+        v->value = u->value;
+        v->set = u->set;
+        if (u->exported && u->set)
+            setenv(v->name, v->value.buf ? v->value.buf : "", 1);
+        else if (v->exported)
+            unsetenv(v->name);
+        v->exported = u->exported;
+        v->saved_in = 0;
+    }
+    snap_active = s->outer;
+}
+
+void vars_set(const char *name, size_t len, const char *value, size_t value_len)
+{
+    struct shell_var *v = get_var(name, len);
+    remember(v);
+    v->value.len = 0;
+    str_appendn(&v->value, value, value_len);
+    v->set = 1;
+
+    // exported variables keep the environment in step for child processes
+    if (v->exported)
+        setenv(v->name, v->value.buf ? v->value.buf : "", 1);
+}
+
+void vars_unset(const char *name, size_t len)
+{
+    struct shell_var *v = get_var(name, len);
+    remember(v);
+    if (v->exported)
+        unsetenv(v->name);
+    v->set = 0;
+    v->exported = 0;
+}
+
+size_t vars_assign_name_len(const char *word)
+{
+    if (!(isalpha((unsigned char)word[0]) || word[0] == '_'))
+        return 0;
+    size_t i = 1;
+    while (isalnum((unsigned char)word[i]) || word[i] == '_')
+        i++;
+    return word[i] == '=' ? i : 0;
+}
+
+const char *vars_lookup(const char *name, size_t len, size_t *out_len)
+{
+    *out_len = 0;
+    if (len == 0)
+        return NULL;
+
+    if (len == 1) {
+        char c = name[0];
+        if (c == '?') {
+            if (status_buf_for != last_status) {
+                snprintf(status_buf, sizeof(status_buf), "%d", last_status);
+                status_buf_for = last_status;
+            }
+            *out_len = strlen(status_buf);
+            return status_buf;
+        }
+        if (c == '#') {
+            snprintf(num_buf, sizeof(num_buf), "%d", pos_argc > 0 ? pos_argc - 1 : 0);
+            *out_len = strlen(num_buf);
+            return num_buf;
+        }
+        if (c == '$') {
+            snprintf(num_buf, sizeof(num_buf), "%ld", (long)(shell_pid ? shell_pid : getpid()));
+            *out_len = strlen(num_buf);
+            return num_buf;
+        }
+        if (c >= '0' && c <= '9') {
+            int i = c - '0';
+            if (i >= pos_argc)
+                return NULL;
+            *out_len = strlen(pos_argv[i]);
+            return pos_argv[i];
+        }
+        if (c == '@' || c == '*') {
+            // "$*" joins with the first byte of IFS; $@ in a single string with a space
+            int sep = ' ';
+            if (c == '*') {
+                struct shell_var *ifs = get_var("IFS", 3);
+                if (ifs->set)
+                    sep = ifs->value.len ? (unsigned char)ifs->value.buf[0] : -1;
+            }
+            if (!joined_valid || joined_sep != sep) {
+                str_free(&joined);
+                for (int i = 1; i < pos_argc; i++) {
+                    if (i > 1 && sep >= 0)
+                        str_pushc(&joined, (char)sep);
+                    str_append(&joined, pos_argv[i]);
+                }
+                joined_valid = 1;
+                joined_sep = sep;
+            }
+            *out_len = joined.len;
+            return joined.buf;
+        }
+    }
+
+    struct shell_var *v = get_var(name, len);
+    if (!v->set)
+        return NULL;
+    *out_len = v->value.len;
+    return v->value.buf ? v->value.buf : "";
+}
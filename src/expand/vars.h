@@ -0,0 +1,45 @@
+#ifndef VARS_H
+#define VARS_H
+
+#include <stddef.h>
+
+/*
+ * Parameter lookup for expansion: special parameters ($?, $#, $$, $0-$9,
+ * $@, $*) and shell variables. The environment is read once per name,
+ * the first time the name is used; assignments to names that came from it
+ * are exported again. The returned view is valid until the next call that
+ * changes the same parameter.
+ */
+
+const char *vars_lookup(const char *name, size_t len, size_t *out_len);
+
+/* Shell variables; a name that is in the environment is updated there too */
+void vars_set(const char *name, size_t len, const char *value, size_t value_len);
+void vars_unset(const char *name, size_t len);
+
+/* Length of the NAME in a NAME=value word, or 0 if it is not an assignment */
+size_t vars_assign_name_len(const char *word);
+
+/*
+ * Undo points for subshells run in place: every variable changed after
+ * vars_snapshot has its previous state copied the first time it changes,
+ * and vars_restore puts those copies back. Snapshots nest.
+ */
+struct vars_snapshot {
+    size_t mark;            // undo log length when taken
+    unsigned id;
+    unsigned outer;         // snapshot active before this one, 0 if none
+};
+
+void vars_snapshot(struct vars_snapshot *s);
+void vars_restore(const struct vars_snapshot *s);
+
+void vars_set_status(int status);
+int vars_status(void);
+/* Also makes this process the one $$ names, as a script starts in it */
+void vars_set_positional(int argc, char **argv);
+/* $#, and $1... one at a time (NULL past the last) */
+int vars_argc(void);
+const char *vars_arg(int i);
+
+#endif
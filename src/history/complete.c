@@ -0,0 +1,82 @@
+#include "complete.h"
+#include "expand/cmdtable.h"
+#include "expand/dircache.h"
+#include "util/str.h"
+#include <stdlib.h>
+#include <string.h>
+
+static int is_blank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+/* A word in command position follows the start of the line or a separator */
+static int in_command_position(const char *line, size_t start)
+{
+    while (start > 0 && is_blank(line[start - 1]))
+        start--;
+    return start == 0 || strchr(";|&(", line[start - 1]);
+}
+
+static int cmp_strings(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void complete_command(const char *word, size_t len, struct vec *out)
+{
+    size_t first;
+    size_t n = cmdtable_prefix(word, len, &first);
+    for (size_t i = 0; i < n; i++) {
+        char *s = strdup(cmdtable_name(first + i));
+        if (!s)
+            abort();
+        vec_push(out, s);
+    }
+}
+
+static void complete_file(const char *word, size_t len, struct vec *out)
+{
+    const char *slash = memchr(word, '/', len) ? word + len : NULL;
+    while (slash && slash[-1] != '/')
+        slash--;
+    size_t dir_len = slash ? (size_t)(slash - word) : 0;
+
+    struct str dir;
+    str_init(&dir);
+    str_appendn(&dir, word, dir_len);
+    const struct dircache_dir *d = dircache_get(dir.buf ? dir.buf : "");
+
+    const char *base = word + dir_len;
+    size_t base_len = len - dir_len;
+    for (size_t i = 0; d && i < d->len; i++) {
+        const char *name = dircache_name(d, i);
+        // hidden entries only when asked for
+        if (strncmp(name, base, base_len) != 0 || (name[0] == '.' && base[0] != '.'))
+            continue;
+        struct str s;
+        str_init(&s);
+        str_appendn(&s, word, dir_len);
+        str_append(&s, name);
+        if (dircache_is_dir(d, i))
+            str_pushc(&s, '/');
+        vec_push(out, str_take(&s));
+    }
+    str_free(&dir);
+    qsort(out->data, out->len, sizeof(void *), cmp_strings);
+}
+
+void complete_candidates(const char *line, size_t len, size_t *word_start, struct vec *out)
+{
+    size_t start = len;
+    while (start > 0 && !is_blank(line[start - 1]) && !strchr(";|&<>", line[start - 1]))
+        start--;
+    *word_start = start;
+
+    const char *word = line + start;
+    size_t wlen = len - start;
+    if (in_command_position(line, start) && !memchr(word, '/', wlen))
+        complete_command(word, wlen, out);
+    else
+        complete_file(word, wlen, out);
+}
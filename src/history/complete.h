@@ -0,0 +1,20 @@
+#ifndef COMPLETE_H
+#define COMPLETE_H
+
+#include <stddef.h>
+#include "util/vec.h"
+
+/*
+ * Tab completion for the line editor. The first word of a command is
+ * completed from the PATH command table, any other word (or one with a
+ * '/') from the directory cache.
+ */
+
+/*
+ * Candidates for the word ending at line[len]. *word_start is where that
+ * word begins; out gets malloced replacement words, sorted, directories
+ * with a trailing '/'.
+ */
+void complete_candidates(const char *line, size_t len, size_t *word_start, struct vec *out);
+
+#endif
@@ -0,0 +1,265 @@
+#include "edit.h"
+#include "complete.h"
+#include "history.h"
+#include "util/fdpass.h"
+#include "util/str.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define KEY_CTRL(c) ((c) & 0x1f)
+
+struct editor {
+    const char *prompt;
+    struct str line;
+    struct str query;       // Ctrl-R search text
+    int searching;
+    size_t pos;             // history position of the shown entry
+    int tabs;               // Tab presses in a row; the second one lists
+};
+
+#define EDIT_LIST_MAX 100
+
+static void set_line(struct str *s, const char *p, size_t n)
+{
+    s->len = 0;
+    str_appendn(s, p, n);
+}
+
+static void redraw(struct editor *ed)
+{
+    struct str out;
+    str_init(&out);
+    str_append(&out, "\r\033[K");
+    if (ed->searching) {
+        str_append(&out, "(reverse-i-search)`");
+        str_appendn(&out, ed->query.buf, ed->query.len);
+        str_append(&out, "': ");
+    } else {
+        str_append(&out, ed->prompt);
+    }
+    str_appendn(&out, ed->line.buf, ed->line.len);
+    fd_write_all(STDOUT_FILENO, out.buf, out.len);
+    str_free(&out);
+}
+
+/* Looks for the query in entries older than from */
+static void search(struct editor *ed, size_t from)
+{
+    size_t pos = from, len;
+    const char *e = history_search(ed->query.buf, ed->query.len, &pos, &len);
+    if (e) {
+        ed->pos = pos;
+        set_line(&ed->line, e, len);
+    }
+}
+
+static int read_key(void)
+{
+    unsigned char c;
+    ssize_t n = read(STDIN_FILENO, &c, 1);
+    return n == 1 ? c : -1;
+}
+
+/* Up and Down; every other escape sequence is dropped */
+static int read_escape(void)
+{
+    int a = read_key();
+    if (a != '[')
+        return 0;
+    int b = read_key();
+    return b == 'A' || b == 'B' ? b : 0;
+}
+
+static void browse(struct editor *ed, int older)
+{
+    size_t pos = ed->pos, len;
+    const char *e = older ? history_prev(&pos, &len) : history_next(&pos, &len);
+    if (e) {
+        ed->pos = pos;
+        set_line(&ed->line, e, len);
+    } else if (!older) {
+        ed->pos = HISTORY_END;
+        ed->line.len = 0;
+    }
+}
+
+static void list_candidates(struct vec *c)
+{
+    struct str out;
+    str_init(&out);
+    str_append(&out, "\r\n");
+    for (size_t i = 0; i < c->len && i < EDIT_LIST_MAX; i++) {
+        str_append(&out, vec_get(c, i));
+        str_append(&out, "  ");
+    }
+    if (c->len > EDIT_LIST_MAX) {
+        char more[64];
+        snprintf(more, sizeof(more), "... (%zu more)", c->len - EDIT_LIST_MAX);
+        str_append(&out, more);
+    }
+    str_append(&out, "\r\n");
+    fd_write_all(STDOUT_FILENO, out.buf, out.len);
+    str_free(&out);
+}
+
+static void complete(struct editor *ed)
+{
+    struct vec c;
+    vec_init(&c);
+    size_t start;
+    complete_candidates(ed->line.buf ? ed->line.buf : "", ed->line.len, &start, &c);
+
+    if (c.len > 0) {
+        // longest prefix shared by every candidate
+        const char *first = vec_get(&c, 0);
+        size_t common = strlen(first);
+        for (size_t i = 1; i < c.len; i++) {
+            const char *s = vec_get(&c, i);
+            size_t k = 0;
+            while (k < common && s[k] == first[k])
+                k++;
+            common = k;
+        }
+        if (common > ed->line.len - start || c.len == 1) {
+            ed->line.len = start;
+            str_appendn(&ed->line, first, common);
+            if (c.len == 1 && first[common - 1] != '/')
+                str_pushc(&ed->line, ' ');
+        } else if (ed->tabs > 1) {
+            list_candidates(&c);
+        }
+    }
+    for (size_t i = 0; i < c.len; i++)
+        free(vec_get(&c, i));
+    vec_free(&c);
+}
+
+/* Returns 1 when the line is done, -1 at end of input, 0 to keep going */
+static int handle_key(struct editor *ed, int c)
+{
+    if (c < 0 || (c == KEY_CTRL('D') && ed->line.len == 0 && !ed->searching))
+        return -1;
+
+    if (ed->searching) {
+        if (c == KEY_CTRL('R')) {
+            search(ed, ed->pos);
+            return 0;
+        }
+        if (c == 127 || c == '\b') {
+            if (ed->query.len)
+                ed->query.len--;
+            search(ed, HISTORY_END);
+            return 0;
+        }
+        if (c >= ' ' && c != 127) {
+            str_pushc(&ed->query, (char)c);
+            search(ed, HISTORY_END);
+            return 0;
+        }
+        ed->searching = 0; // any other key takes the match and is handled below
+        if (c == KEY_CTRL('G') || c == 27)
+            return 0;
+    }
+
+    ed->tabs = c == '\t' ? ed->tabs + 1 : 0;
+    switch (c) {
+    case '\t':
+        complete(ed);
+        return 0;
+    case '\r':
+    case '\n':
+        return 1;
+    case KEY_CTRL('C'):
+        ed->line.len = 0;
+        return 1;
+    case KEY_CTRL('R'):
+        ed->searching = 1;
+        ed->query.len = 0;
+        ed->pos = HISTORY_END;
+        return 0;
+    case 127:
+    case '\b':
+        if (ed->line.len)
+            ed->line.len--;
+        return 0;
+    case 27:
+        c = read_escape();
+        if (c)
+            browse(ed, c == 'A');
+        return 0;
+    default:
+        if (c >= ' ')
+            str_pushc(&ed->line, (char)c);
+        return 0;
+    }
+}
+
+static char *read_plain(const char *prompt)
+{
+    fputs(prompt, stderr);
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t n = getline(&line, &cap, stdin);
+    if (n < 0) {
+        free(line);
+        return NULL;
+    }
+    if (n && line[n - 1] == '\n')
+        line[n - 1] = '\0';
+    return line;
+}
+
+char *edit_line(const char *prompt)
+{
+    struct termios old, raw;
+    if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &old) < 0)
+        return read_plain(prompt);
+    raw = old;
+    raw.c_lflag &= ~(ICANON | ECHO | ISIG | IEXTEN);
+    raw.c_iflag &= ~(IXON | ICRNL);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSANOW, &raw); // keep type-ahead
+
+    struct editor ed;
+    ed.prompt = prompt;
+    ed.searching = 0;
+    ed.pos = HISTORY_END;
+    ed.tabs = 0;
+    str_init(&ed.line);
+    str_init(&ed.query);
+    int done;
+    redraw(&ed);
+    while ((done = handle_key(&ed, read_key())) == 0)
+        redraw(&ed);
+    ed.searching = 0;
+    redraw(&ed);
+    fd_write_all(STDOUT_FILENO, "\r\n", 2);
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &old);
+
+    str_free(&ed.query);
+    if (done < 0) {
+        str_free(&ed.line);
+        return NULL;
+    }
+    str_appendn(&ed.line, "", 0); // backspace leaves the old terminator behind
+    return str_take(&ed.line);
+}
+
+int edit_refill(void *ctx, struct str *in)
+{
+    struct edit_prompt *p = ctx;
+    char *line = edit_line(p->continued ? p->ps2 : p->ps1);
+    if (!line)
+        return 0;
+    p->continued = 1;
+    size_t len = strlen(line);
+    history_add(line, len);
+    str_appendn(in, line, len);
+    str_pushc(in, '\n');
+    free(line);
+    return 1;
+}
@@ -0,0 +1,30 @@
+#ifndef EDIT_H
+#define EDIT_H
+
+/*
+ * Minimal line editor for interactive use: typing, backspace, Up/Down
+ * through the history, Ctrl-R reverse incremental search and Tab
+ * completion. Falls back to plain line reading when stdin is not a
+ * terminal.
+ */
+
+/* Returns the malloced line without its newline, NULL at end of input */
+char *edit_line(const char *prompt);
+
+struct str;
+
+/* ps1 for the first line of a command, ps2 for the lines continuing it */
+struct edit_prompt {
+    const char *ps1;
+    const char *ps2;
+    int continued;          // cleared by the caller before each command
+};
+
+/*
+ * Lexer refill (lexer/lexer.h) with ctx an edit_prompt: reads a line at
+ * the prompt due, records it in the history and appends it with its
+ * newline. Returns 0 at end of input.
+ */
+int edit_refill(void *ctx, struct str *in);
+
+#endif
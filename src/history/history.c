@@ -0,0 +1,268 @@
+#define _GNU_SOURCE
+
+#include "history.h"
+#include "util/str.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define HIST_BLOCK 4096
+#define HIST_BLOOM_BITS 2048
+#define HIST_BLOOM_WORDS (HIST_BLOOM_BITS / 64)
+#define HIST_NONE ((size_t)-1)
+
+/*
+ * Filter of the trigrams in the entries starting in one block: 256 bytes
+ * per 4 KiB of history, filled in the first time a search scans the block.
+ */
+struct hist_block {
+    uint64_t bloom[HIST_BLOOM_WORDS];
+    int indexed;
+};
+
+static int hist_fd = -1;
+static const char *map;
+static size_t map_len;
+static struct hist_block *blocks;
+static size_t nblocks;
+
+int history_open(const char *path)
+{
+    if (hist_fd >= 0)
+        return 0;
+    struct str def;
+    str_init(&def);
+    if (!path)
+        path = getenv("HISTFILE");
+    if (!path || !*path) {
+        const char *home = getenv("HOME");
+        if (!home)
+            return -1;
+        str_append(&def, home);
+        str_append(&def, "/.42sh_history");
+        path = def.buf;
+    }
+    hist_fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    str_free(&def);
+    return hist_fd < 0 ? -1 : 0;
+}
+
+int history_is_open(void)
+{
+    return hist_fd >= 0;
+}
+
+void history_close(void)
+{
+    if (map)
+        munmap((void *)map, map_len);
+    if (hist_fd >= 0)
+        close(hist_fd);
+    free(blocks);
+    map = NULL;
+    map_len = 0;
+    blocks = NULL;
+    nblocks = 0;
+    hist_fd = -1;
+}
+
+/* Picks up what this and other sessions appended since the last call */
+static void refresh(void)
+{
+    struct stat st;
+    if (hist_fd < 0 || fstat(hist_fd, &st) < 0 || (size_t)st.st_size == map_len)
+        return;
+    if (map)
+        munmap((void *)map, map_len);
+    map = NULL;
+    map_len = 0;
+    if (st.st_size == 0)
+        return;
+    void *m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, hist_fd, 0);
+    if (m == MAP_FAILED)
+        return;
+    map = m;
+    map_len = (size_t)st.st_size;
+
+    size_t n = map_len / HIST_BLOCK;
+    if (n > nblocks) {
+        blocks = realloc(blocks, n * sizeof(*blocks));
+        if (!blocks)
+            abort();
+        memset(blocks + nblocks, 0, (n - nblocks) * sizeof(*blocks));
+        nblocks = n;
+    }
+}
+
+int history_add(const char *line, size_t len)
+{
+    if (hist_fd < 0)
+        return -1;
+    if (len && line[len - 1] == '\n')
+        len--;
+    size_t blank = 0;
+    while (blank < len && (line[blank] == ' ' || line[blank] == '\t' || line[blank] == '\n'))
+        blank++;
+    if (blank == len)
+        return 0;
+
+    char *buf = malloc(len + 1);
+    if (!buf)
+        abort();
+    for (size_t i = 0; i < len; i++)
+        buf[i] = line[i] == '\n' ? ' ' : line[i];
+    buf[len] = '\n';
+    // one write: O_APPEND keeps it in one piece next to other sessions
+    ssize_t n = write(hist_fd, buf, len + 1);
+    free(buf);
+    return n == (ssize_t)(len + 1) ? 0 : -1;
+}
+
+static const char *entry_at(size_t off, size_t *len)
+{
+    const char *nl = memchr(map + off, '\n', map_len - off);
+    *len = (size_t)((nl ? nl : map + map_len) - (map + off));
+    return map + off;
+}
+
+const char *history_entry(size_t pos, size_t *len)
+{
+    refresh();
+    if (!map || pos >= map_len)
+        return NULL;
+    return entry_at(pos, len);
+}
+
+/* First entry starting at or after off; HIST_NONE if the line is not complete yet */
+static size_t entry_start_at(size_t off)
+{
+    if (off == 0)
+        return 0;
+    if (off > map_len)
+        return HIST_NONE;
+    const char *nl = memchr(map + off - 1, '\n', map_len - (off - 1));
+    return nl ? (size_t)(nl - map) + 1 : HIST_NONE;
+}
+
+static size_t limit_of(size_t pos)
+{
+    return pos == HISTORY_END || pos > map_len ? map_len : pos;
+}
+
+const char *history_prev(size_t *pos, size_t *len)
+{
+    refresh();
+    size_t limit = limit_of(*pos);
+    if (!map || limit == 0)
+        return NULL;
+    size_t last = limit - 1;
+    if (map[last] == '\n' && last > 0)
+        last--;
+    else if (map[last] == '\n')
+        return NULL;
+    const char *nl = memrchr(map, '\n', last + 1);
+    *pos = nl ? (size_t)(nl - map) + 1 : 0;
+    return entry_at(*pos, len);
+}
+
+const char *history_next(size_t *pos, size_t *len)
+{
+    refresh();
+    if (!map || *pos == HISTORY_END || *pos >= map_len)
+        return NULL;
+    const char *nl = memchr(map + *pos, '\n', map_len - *pos);
+    if (!nl || (size_t)(nl - map) + 1 >= map_len) {
+        *pos = HISTORY_END;
+        return NULL;
+    }
+    *pos = (size_t)(nl - map) + 1;
+    return entry_at(*pos, len);
+}
+
+static unsigned trigram_bit(const char *p)
+{
+    const unsigned char *u = (const unsigned char *)p;
+    uint32_t v = u[0] | (uint32_t)u[1] << 8 | (uint32_t)u[2] << 16;
+    return (v * 2654435761u) >> (32 - 11);
+}
+
+static void index_block(struct hist_block *b, size_t start, size_t end)
+{
+    for (size_t i = start; i + 2 < end; i++) {
+        if (map[i] == '\n' || map[i + 1] == '\n' || map[i + 2] == '\n')
+            continue;
+        unsigned bit = trigram_bit(map + i);
+        b->bloom[bit / 64] |= (uint64_t)1 << (bit % 64);
+    }
+    b->indexed = 1;
+}
+
+static int may_contain(const struct hist_block *b, const char *q, size_t qlen)
+{
+    for (size_t i = 0; i + 2 < qlen; i++) {
+        unsigned bit = trigram_bit(q + i);
+        if (!(b->bloom[bit / 64] & ((uint64_t)1 << (bit % 64))))
+            return 0;
+    }
+    return 1;
+}
+
+/* Start of the newest entry in [start, end) that begins before limit and contains q */
+static size_t scan_range(size_t start, size_t end, size_t limit, const char *q, size_t qlen)
+{
+    size_t found = HIST_NONE;
+    const char *p = map + start;
+    const char *stop = map + end;
+    const char *hit;
+    while (p < stop && (hit = memmem(p, (size_t)(stop - p), q, qlen))) {
+        const char *nl = memrchr(map + start, '\n', (size_t)(hit - (map + start)));
+        size_t s = nl ? (size_t)(nl - map) + 1 : start;
+        if (s >= limit)
+            break;
+        found = s;
+        nl = memchr(hit, '\n', (size_t)(stop - hit));
+        if (!nl)
+            break;
+        p = nl + 1;
+    }
+    return found;
+}
+
+const char *history_search(const char *q, size_t qlen, size_t *pos, size_t *len)
+{
+    refresh();
+    size_t limit = limit_of(*pos);
+    if (!map || limit == 0 || qlen == 0 || memchr(q, '\n', qlen))
+        return NULL;
+
+    for (size_t i = (limit - 1) / HIST_BLOCK + 1; i-- > 0;) {
+        size_t start = entry_start_at(i * HIST_BLOCK);
+        if (start == HIST_NONE || start >= limit)
+            continue;
+        size_t end = entry_start_at((i + 1) * HIST_BLOCK);
+        // a block is final once the entry crossing its end is complete
+        int complete = i < nblocks && end != HIST_NONE;
+        if (end == HIST_NONE)
+            end = map_len;
+        if (start >= end)
+            continue; // one long entry covers the whole block
+
+        if (complete && qlen >= 3) {
+            struct hist_block *b = &blocks[i];
+            if (!b->indexed)
+                index_block(b, start, end);
+            if (!may_contain(b, q, qlen))
+                continue;
+        }
+        size_t found = scan_range(start, end, limit, q, qlen);
+        if (found != HIST_NONE) {
+            *pos = found;
+            return entry_at(found, len);
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,43 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+
+/*
+ * Command history kept in an append-only file, one entry per line.
+ * Entries are added with a single O_APPEND write, so concurrent sessions
+ * sharing the file interleave whole lines. The file is mapped, never read
+ * in, and grows into the map as other sessions append.
+ *
+ * Search walks the file newest first, one block at a time. A block keeps
+ * a small trigram filter once it has been scanned, so later searches skip
+ * the blocks that cannot contain the query without touching them.
+ *
+ * Positions are byte offsets of entry starts; HISTORY_END is past the
+ * newest entry. Returned entries point into the map, without the newline,
+ * and stay valid until the next history call.
+ */
+
+#define HISTORY_END ((size_t)-1)
+
+/* path NULL: $HISTFILE, else ~/.42sh_history. Returns -1 if it cannot be opened */
+int history_open(const char *path);
+int history_is_open(void);
+void history_close(void);
+
+/* Appends line (newlines become spaces); blank lines are not recorded */
+int history_add(const char *line, size_t len);
+
+/* The entry starting at pos */
+const char *history_entry(size_t pos, size_t *len);
+
+/* Newest entry starting before *pos; updates *pos. NULL if there is none */
+const char *history_prev(size_t *pos, size_t *len);
+
+/* Entry after the one at *pos; updates *pos. NULL past the newest */
+const char *history_next(size_t *pos, size_t *len);
+
+/* Like history_prev(), for the newest entry that contains q */
+const char *history_search(const char *q, size_t qlen, size_t *pos, size_t *len);
+
+#endif
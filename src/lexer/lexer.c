@@ -1,79 +1,175 @@
 #include "lexer.h"
+#include "scan.h"
 #include "util/str.h"
 #include "util/error.h"
+#include "util/intern.h"
+#include "util/stats.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <ctype.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
-static struct token make_tok(struct lexer *lx, enum token_type type, char *val, int line, int col)
+static struct token make_tok(struct lexer *lx, enum token_type type, char *val, size_t at)
 {
     struct token t;
     t.type = type;
     t.value = val;
-    t.line = line;
-    t.col = col;
+    t.word = NULL;
+    t.off = lx->pos;
+    t.len = 0;
+    t.at = at;
     return t;
 }
 
+/* A word's own copy of its text: only names are worth interning */
+static char *own_text(const char *s, size_t len)
+{
+    char *p = malloc(len + 1);
+    if (!p)
+        abort();
+    STATS_ALLOC(STATS_LEXER, len + 1);
+    memcpy(p, s, len);
+    p[len] = '\0';
+    return p;
+}
+
 void token_free(struct token *t)
 {
-    if (t->type == TOK_WORD)
+    // reserved words point at the interned keyword; words own their text
+    if (t->type == TOK_WORD || t->type == TOK_IONUMBER)
         free(t->value);
+    if (t->type == TOK_WORD)
+        word_free(t->word);
     t->value = NULL;
+    t->word = NULL;
+}
+
+int token_as_word(struct token *t)
+{
+    if (t->type == TOK_WORD)
+        return 1;
+    if (t->type < TOK_IF || t->type > TOK_RBRACE)
+        return 0;
+    t->type = TOK_WORD; // reserved words never expand: the spelling is all there is
+    t->value = own_text(t->value, strlen(t->value));
+    return 1;
 }
 
 static int is_word_break(int c)
 {
     return c == EOF || c == ';' || c == '\n' || c == ' ' || c == '\t'
-           || c == '<' || c == '>' || c == '|';
+           || c == '<' || c == '>' || c == '|' || c == '(' || c == ')';
+}
+
+/* More input at the end of buf: offsets stay valid, pointers into buf do not */
+static int lx_refill(struct lexer *lx)
+{
+    if (!lx->refill)
+        return 0;
+    size_t before = lx->input.len;
+    if (!lx->refill(lx->refill_ctx, &lx->input))
+        lx->refill = NULL; // never read past the end again, a terminal would block
+    lx->buf = lx->input.buf;
+    lx->len = lx->input.len;
+    return lx->len > before;
 }
 
 static int lx_getc(struct lexer *lx)
 {
-    int c = fgetc(lx->in);
-    if (c == '\n') {
-        lx->line++;
-        lx->col = 0;
-    } else if (c != EOF) {
-        lx->col++;
-    }
-    return c;
+    if (lx->pos >= lx->len && !lx_refill(lx))
+        return EOF;
+    return (unsigned char)lx->buf[lx->pos++];
 }
 
 static void lx_ungetc(struct lexer *lx, int c)
 {
-    if (c == EOF)
-        return;
-    ungetc(c, lx->in);
-    if (c == '\n') {
-        // approximate (rarely used)
-        lx->line--;
-        lx->col = 0;
-    } else {
-        lx->col--;
+    if (c != EOF)
+        lx->pos--;
+}
+
+void lexer_position(struct lexer *lx, size_t at, int *line, int *col)
+{
+    if (at > lx->len)
+        at = lx->len;
+    if (at < lx->known_at) {
+        lx->known_at = lx->known_bol = 0;
+        lx->known_line = 1;
+    }
+    const char *p = lx->buf + lx->known_at;
+    const char *end = lx->buf + at;
+    const char *nl;
+    while (p < end && (nl = memchr(p, '\n', (size_t)(end - p)))) {
+        lx->known_line++;
+        p = nl + 1;
+        lx->known_bol = (size_t)(p - lx->buf);
     }
+    lx->known_at = at;
+    *line = lx->known_line;
+    *col = (int)(at - lx->known_bol);
 }
 
-static enum token_type reserved_type(const char *w)
+void lexer_error(struct lexer *lx, size_t at, const char *msg)
 {
-    if (strcmp(w, "if") == 0) return TOK_IF;
-    if (strcmp(w, "then") == 0) return TOK_THEN;
-    if (strcmp(w, "elif") == 0) return TOK_ELIF;
-    if (strcmp(w, "else") == 0) return TOK_ELSE;
-    if (strcmp(w, "fi") == 0) return TOK_FI;
+    int line, col;
+    lexer_position(lx, at, &line, &col);
+    syntax_error(line, col, msg);
+}
+
+static const char *kw_if, *kw_then, *kw_elif, *kw_else, *kw_fi;
+static const char *kw_while, *kw_until, *kw_do, *kw_done, *kw_case, *kw_esac;
+static const char *kw_lbrace, *kw_rbrace;
+static pthread_once_t kw_once = PTHREAD_ONCE_INIT;
+
+static void intern_keywords(void)
+{
+    kw_if = intern_cstr("if");
+    kw_then = intern_cstr("then");
+    kw_elif = intern_cstr("elif");
+    kw_else = intern_cstr("else");
+    kw_fi = intern_cstr("fi");
+    kw_while = intern_cstr("while");
+    kw_until = intern_cstr("until");
+    kw_do = intern_cstr("do");
+    kw_done = intern_cstr("done");
+    kw_case = intern_cstr("case");
+    kw_esac = intern_cstr("esac");
+    kw_lbrace = intern_cstr("{");
+    kw_rbrace = intern_cstr("}");
+}
+
+/*
+ * Reserved words are recognised by pointer: a word that is one is already
+ * in the intern table, and looking it up adds nothing. *kw gets the
+ * interned spelling.
+ */
+static enum token_type reserved_type(const char *s, size_t len, const char **kw)
+{
+    pthread_once(&kw_once, intern_keywords);
+    const char *w = intern_find(s, len);
+    *kw = w;
+    if (!w) return TOK_WORD;
+    if (w == kw_if) return TOK_IF;
+    if (w == kw_then) return TOK_THEN;
+    if (w == kw_elif) return TOK_ELIF;
+    if (w == kw_else) return TOK_ELSE;
+    if (w == kw_fi) return TOK_FI;
+    if (w == kw_while) return TOK_WHILE;
+    if (w == kw_until) return TOK_UNTIL;
+    if (w == kw_do) return TOK_DO;
+    if (w == kw_done) return TOK_DONE;
+    if (w == kw_case) return TOK_CASE;
+    if (w == kw_esac) return TOK_ESAC;
+    if (w == kw_lbrace) return TOK_LBRACE;
+    if (w == kw_rbrace) return TOK_RBRACE;
     return TOK_WORD;
 }
 
 static void skip_spaces(struct lexer *lx)
 {
-    int c;
-    while (1) {
-        c = lx_getc(lx);
-        if (c == ' ' || c == '\t')
-            continue;
-        lx_ungetc(lx, c);
-        return;
-    }
+    while (lx->pos < lx->len && (lx->buf[lx->pos] == ' ' || lx->buf[lx->pos] == '\t'))
+        lx->pos++;
 }
 
 static int skip_comment_if_any(struct lexer *lx)
@@ -86,117 +182,250 @@ static int skip_comment_if_any(struct lexer *lx)
     }
 
     // consume until newline or EOF
-    while (1) {
-        c = lx_getc(lx);
-        if (c == EOF)
-            return 1;
-        if (c == '\n') {
-            return 2;
+    const char *nl = memchr(lx->buf + lx->pos, '\n', lx->len - lx->pos);
+    if (!nl) {
+        lx->pos = lx->len;
+        return 1;
+    }
+    lx->pos = (size_t)(nl - lx->buf) + 1;
+    return 2;
+}
+
+static void read_single_quotes(struct lexer *lx, struct str *sb, struct word *w, size_t at)
+{
+    // we have already consumed the opening quote
+    word_begin_quote(w);
+    size_t from = lx->pos;
+    const char *q;
+    while (!(q = memchr(lx->buf + from, '\'', lx->len - from))) {
+        from = lx->len; // the quote spans lines: only the new ones are searched
+        if (!lx_refill(lx))
+            lexer_error(lx, at, "unterminated single quote");
+    }
+    const char *p = lx->buf + lx->pos;
+    str_appendn(sb, p, (size_t)(q - p));
+    word_add_span(w, p, (size_t)(q - p), 1);
+    lx->pos = (size_t)(q - lx->buf) + 1;
+}
+
+static int is_name_char(int c)
+{
+    return isalnum(c) || c == '_';
+}
+
+static void read_param(struct lexer *lx, struct str *sb, struct word *w, int quoted)
+{
+    // we have already consumed the '$'; the name is a view of the input
+    size_t at = lx->pos;
+    size_t dollar = lx->pos - 1;
+    size_t start = lx->pos;
+    size_t end;
+    int c = lx_getc(lx);
+
+    if (c == '{') {
+        start = lx->pos;
+        while (1) {
+            c = lx_getc(lx);
+            if (c == '}')
+                break;
+            int first = lx->pos - 1 == start;
+            if (!is_name_char(c) && !(first && c != EOF && c && strchr("?#$@*", c)))
+                lexer_error(lx, at, "bad substitution");
         }
+        end = lx->pos - 1;
+        if (end == start)
+            lexer_error(lx, at, "bad substitution");
+    } else if (isalpha(c) || c == '_') {
+        while (lx->pos < lx->len && is_name_char((unsigned char)lx->buf[lx->pos]))
+            lx->pos++;
+        end = lx->pos;
+    } else if (c != EOF && c && (isdigit(c) || strchr("?#$@*", c))) {
+        end = lx->pos;
+    } else {
+        // a lone '$' is literal
+        lx_ungetc(lx, c);
+        str_pushc(sb, '$');
+        word_add_char(w, '$', quoted);
+        return;
     }
+
+    str_appendn(sb, lx->buf + dollar, lx->pos - dollar);
+    word_add_param(w, lx->buf + start, end - start, quoted);
 }
 
-static void read_single_quotes(struct lexer *lx, struct str *sb, int start_line, int start_col)
+static void read_double_quotes(struct lexer *lx, struct str *sb, struct word *w, size_t at)
 {
     // we have already consumed the opening quote
     int c;
+    word_begin_quote(w);
     while (1) {
+        size_t run = scan_special(lx->buf, lx->pos, lx->len);
+        str_appendn(sb, lx->buf + lx->pos, run - lx->pos);
+        word_add_span(w, lx->buf + lx->pos, run - lx->pos, 1);
+        lx->pos = run;
+
         c = lx_getc(lx);
         if (c == EOF)
-            syntax_error(start_line, start_col, "unterminated single quote");
-        if (c == '\'')
+            lexer_error(lx, at, "unterminated double quote");
+        if (c == '"')
             return;
+        if (c == '$') {
+            read_param(lx, sb, w, 1);
+            continue;
+        }
+        if (c == '\\') {
+            int n = lx_getc(lx);
+            if (n == EOF)
+                lexer_error(lx, at, "unterminated double quote");
+            if (n == '\n')
+                continue; // line continuation
+            if (n != '$' && n != '`' && n != '"' && n != '\\') {
+                str_pushc(sb, '\\');
+                word_add_char(w, '\\', 1);
+            }
+            c = n;
+        }
         str_pushc(sb, (char)c);
+        word_add_char(w, (char)c, 1);
     }
 }
 
+static struct token lex_word(struct lexer *lx);
+
 static struct token lex_redir_or_ionumber(struct lexer *lx)
 {
     int c = lx_getc(lx);
-    int line = lx->line;
-    int col = lx->col;
+    size_t at = lx->pos;
 
     /* Check for IO number: [0-9]+ followed by a redirection operator */
     if (isdigit(c)) {
-        struct str num;
-        str_init(&num);
-        str_pushc(&num, (char)c);
+        size_t start = lx->pos - 1;
 
         int next;
         while (1) {
             next = lx_getc(lx);
-            if (isdigit(next)) {
-                str_pushc(&num, (char)next);
-            } else {
+            if (!isdigit(next)) {
                 lx_ungetc(lx, next);
                 break;
             }
         }
+        if (!is_word_break(next)) {
+            /* the digits only start a word, as in 0.5 */
+            lx->pos = start;
+            return lex_word(lx);
+        }
+        char *num = own_text(lx->buf + start, lx->pos - start);
 
         /* Check if next char is a redirection operator */
         next = lx_getc(lx);
+        lx_ungetc(lx, next);
+        lx->at_cmd_start = 0;
+        struct token t;
         if (next == '<' || next == '>') {
             /* This is an IO number */
-            lx_ungetc(lx, next);
-            char *ionum = str_take(&num);
-            str_free(&num);
-            lx->at_cmd_start = 0;
-            return make_tok(lx, TOK_IONUMBER, ionum, line, col);
+            t = make_tok(lx, TOK_IONUMBER, num, at);
         } else {
             /* Not an IO number, treat as word */
-            lx_ungetc(lx, next);
-            char *word = str_take(&num);
-            str_free(&num);
-            lx->at_cmd_start = 0;
-            return make_tok(lx, TOK_WORD, word, line, col);
+            t = make_tok(lx, TOK_WORD, num, at);
         }
+        t.off = start;
+        t.len = lx->pos - start;
+        return t;
     } else if (c == '<') {
         /* < or <& or <> */
         int next = lx_getc(lx);
         if (next == '&') {
             lx->at_cmd_start = 0;
-            return make_tok(lx, TOK_REDIR_IN_ERR, NULL, line, col);
+            return make_tok(lx, TOK_REDIR_IN_ERR, NULL, at);
         } else if (next == '>') {
             lx->at_cmd_start = 0;
-            return make_tok(lx, TOK_REDIR_RDWR, NULL, line, col);
+            return make_tok(lx, TOK_REDIR_RDWR, NULL, at);
         } else {
             lx_ungetc(lx, next);
             lx->at_cmd_start = 0;
-            return make_tok(lx, TOK_REDIR_IN, NULL, line, col);
+            return make_tok(lx, TOK_REDIR_IN, NULL, at);
         }
     } else if (c == '>') {
         /* > or >> or >& or >| */
         int next = lx_getc(lx);
         if (next == '>') {
             lx->at_cmd_start = 0;
-            return make_tok(lx, TOK_REDIR_APPEND, NULL, line, col);
+            return make_tok(lx, TOK_REDIR_APPEND, NULL, at);
         } else if (next == '&') {
             lx->at_cmd_start = 0;
-            return make_tok(lx, TOK_REDIR_OUT_ERR, NULL, line, col);
+            return make_tok(lx, TOK_REDIR_OUT_ERR, NULL, at);
         } else if (next == '|') {
             lx->at_cmd_start = 0;
-            return make_tok(lx, TOK_REDIR_CLOBBER, NULL, line, col);
+            return make_tok(lx, TOK_REDIR_CLOBBER, NULL, at);
         } else {
             lx_ungetc(lx, next);
             lx->at_cmd_start = 0;
-            return make_tok(lx, TOK_REDIR_OUT, NULL, line, col);
+            return make_tok(lx, TOK_REDIR_OUT, NULL, at);
         }
     }
 
     lx_ungetc(lx, c);
-    syntax_error(line, col, "invalid redirection operator");
-    return make_tok(lx, TOK_EOF, NULL, line, col);
+    lexer_error(lx, at, "invalid redirection operator");
+    return make_tok(lx, TOK_EOF, NULL, at);
+}
+
+/* plain: the word was written as is, without quotes or $, so it may be a reserved word */
+static struct token make_word(struct lexer *lx, const char *w, size_t len, struct word *tw,
+                              size_t start, int plain)
+{
+    const char *kw;
+    if (plain && lx->at_cmd_start) {
+        enum token_type rt = reserved_type(w, len, &kw);
+        if (rt != TOK_WORD) {
+            lx->at_cmd_start = 1; // still at command start for following compound_list
+            struct token t = make_tok(lx, rt, (char *)kw, start); // kept for token_as_word
+            t.off = start;
+            t.len = lx->pos - start;
+            return t;
+        }
+    }
+
+    lx->at_cmd_start = 0;
+    struct token t = make_tok(lx, TOK_WORD, own_text(w, len), start);
+    t.word = tw;
+    t.off = start;
+    t.len = lx->pos - start;
+    return t;
+}
+
+static void drop_word(void *arg)
+{
+    word_free(arg);
 }
 
 static struct token lex_word(struct lexer *lx)
 {
-    int start_line = lx->line;
-    int start_col = lx->col;
+    size_t start = lx->pos;
 
-    struct str sb;
-    str_init(&sb);
+    // fast path: nothing to unquote or expand, the text is copied straight from the input
+    size_t end = scan_special(lx->buf, start, lx->len);
+    if (end > start && (end == lx->len || is_word_break((unsigned char)lx->buf[end]))) {
+        lx->pos = end;
+        return make_word(lx, lx->buf + start, end - start, NULL, start, 1);
+    }
+
+    struct str *sb = &lx->scratch;
+    sb->len = 0;
+    struct word *tw = calloc(1, sizeof(struct word));
+    if (!tw)
+        abort();
+    STATS_ALLOC(STATS_LEXER, sizeof(struct word));
+    word_init(tw);
+    struct syntax_undo undo; // an unterminated quote or a bad ${ } strands the template
+    syntax_undo_push(&undo, drop_word, tw);
 
     while (1) {
+        // bytes with no meaning go in as one run
+        size_t run = scan_special(lx->buf, lx->pos, lx->len);
+        str_appendn(sb, lx->buf + lx->pos, run - lx->pos);
+        word_add_span(tw, lx->buf + lx->pos, run - lx->pos, 0);
+        lx->pos = run;
+
         int c = lx_getc(lx);
         if (c == EOF) {
             break;
@@ -205,38 +434,41 @@ static struct token lex_word(struct lexer *lx)
             lx_ungetc(lx, c);
             break;
         }
-        if (c == '#') {
-            // '#' inside a word is literal
-            str_pushc(&sb, '#');
+        if (c == '\'') {
+            read_single_quotes(lx, sb, tw, start);
             continue;
         }
-        if (c == '\'') {
-            read_single_quotes(lx, &sb, start_line, start_col);
+        if (c == '"') {
+            read_double_quotes(lx, sb, tw, start);
+            continue;
+        }
+        if (c == '$') {
+            read_param(lx, sb, tw, 0);
             continue;
         }
-        str_pushc(&sb, (char)c);
+        // '#' inside a word is literal
+        str_pushc(sb, (char)c);
+        word_add_char(tw, (char)c, 0);
     }
 
-    char *w = str_take(&sb);
-    str_free(&sb);
-
-    if (lx->at_cmd_start) {
-        enum token_type rt = reserved_type(w);
-        if (rt != TOK_WORD) {
-            free(w);
-            lx->at_cmd_start = 1; // still at command start for following compound_list
-            return make_tok(lx, rt, NULL, start_line, start_col);
-        }
+    syntax_undo_pop(&undo);
+    // only words that expand keep their template
+    if (!tw->has_param && !tw->has_glob) {
+        word_free(tw);
+        tw = NULL;
     }
 
-    lx->at_cmd_start = 0;
-    return make_tok(lx, TOK_WORD, w, start_line, start_col);
+    return make_word(lx, sb->buf ? sb->buf : "", sb->len, tw, start, 0);
 }
 
 static struct token lex_one(struct lexer *lx)
 {
     int comment_res;
 
+    // a whole new line: blanks and comments are then skipped within it
+    if (lx->pos >= lx->len)
+        lx_refill(lx);
+
     /* 1. Skip whitespace AND comments as long as they appear */
     while (1) {
         skip_spaces(lx);
@@ -246,33 +478,42 @@ static struct token lex_one(struct lexer *lx)
             break;
 
         if (comment_res == 2) {
-            return make_tok(lx, TOK_NL, NULL, lx->line, lx->col);
+            lx->at_cmd_start = 1;
+            return make_tok(lx, TOK_NL, NULL, lx->pos);
         }
         /* comment without newline → continue */
     }
 
     int c = lx_getc(lx);
-    int line = lx->line;
-    int col = lx->col;
+    size_t at = lx->pos;
 
     if (c == EOF)
-        return make_tok(lx, TOK_EOF, NULL, line, col);
+        return make_tok(lx, TOK_EOF, NULL, at);
 
     if (c == ';') {
         lx->at_cmd_start = 1;
-        return make_tok(lx, TOK_SEMI, NULL, line, col);
+        if (lx->pos < lx->len && lx->buf[lx->pos] == ';') {
+            lx_getc(lx);
+            return make_tok(lx, TOK_DSEMI, NULL, at);
+        }
+        return make_tok(lx, TOK_SEMI, NULL, at);
+    }
+
+    if (c == '(' || c == ')') {
+        lx->at_cmd_start = 1;
+        return make_tok(lx, c == '(' ? TOK_LPAREN : TOK_RPAREN, NULL, at);
     }
 
     if (c == '\n') {
         lx->at_cmd_start = 1;
-        return make_tok(lx, TOK_NL, NULL, line, col);
+        return make_tok(lx, TOK_NL, NULL, at);
     }
 
     if (c == '|') {
         /* Check if it's part of >| */
         /* This case should not happen here because >| is handled in lex_redir_or_ionumber */
-        lx->at_cmd_start = 0;
-        return make_tok(lx, TOK_PIPE, NULL, line, col);
+        lx->at_cmd_start = 1; // the next stage may be a compound command
+        return make_tok(lx, TOK_PIPE, NULL, at);
     }
 
     /* Check for redirections or IO numbers */
@@ -285,15 +526,75 @@ static struct token lex_one(struct lexer *lx)
     return lex_word(lx);
 }
 
-void lexer_init(struct lexer *lx, FILE *in)
+void lexer_init_mem(struct lexer *lx, const char *buf, size_t len)
 {
-    lx->in = in;
-    lx->line = 1;
-    lx->col = 0;
+    lx->buf = buf;
+    lx->len = len;
+    lx->pos = 0;
+    lx->map_len = 0;
+    lx->owns_buf = 0;
+    lx->refill = NULL;
+    lx->refill_ctx = NULL;
+    str_init(&lx->input);
+    str_init(&lx->scratch);
+    lx->known_at = 0;
+    lx->known_bol = 0;
+    lx->known_line = 1;
     lx->at_cmd_start = 1;
     lx->has_peek = 0;
 }
 
+void lexer_init_refill(struct lexer *lx, lexer_refill_fn fn, void *ctx)
+{
+    lexer_init_mem(lx, NULL, 0);
+    lx->refill = fn;
+    lx->refill_ctx = ctx;
+}
+
+/* Maps regular files, reads anything else whole: streams that must not be read ahead are the caller's */
+void lexer_init(struct lexer *lx, FILE *in)
+{
+    int fd = fileno(in);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0
+        && ftello(in) == 0) {
+        void *m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m != MAP_FAILED) {
+            lexer_init_mem(lx, m, (size_t)st.st_size);
+            lx->map_len = (size_t)st.st_size;
+            return;
+        }
+    }
+
+    struct str all;
+    str_init(&all);
+    char chunk[8192];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), in)) > 0)
+        str_appendn(&all, chunk, n);
+
+    size_t len = all.len;
+    lexer_init_mem(lx, str_take(&all), len);
+    lx->owns_buf = 1;
+}
+
+void lexer_destroy(struct lexer *lx)
+{
+    if (lx->has_peek)
+        token_free(&lx->peeked);
+    lx->has_peek = 0;
+    if (lx->map_len)
+        munmap((void *)lx->buf, lx->map_len);
+    else if (lx->owns_buf)
+        free((void *)lx->buf);
+    lx->buf = NULL;
+    lx->len = 0;
+    lx->map_len = 0;
+    lx->owns_buf = 0;
+    str_free(&lx->input);
+    str_free(&lx->scratch);
+}
+
 struct token lexer_peek(struct lexer *lx)
 {
     if (!lx->has_peek) {
@@ -311,3 +612,32 @@ struct token lexer_next(struct lexer *lx)
     }
     return lex_one(lx);
 }
+
+int lexer_resync(struct lexer *lx)
+{
+    if (lx->has_peek) {
+        token_free(&lx->peeked);
+        lx->has_peek = 0;
+    }
+    // the offending token may already have eaten the newline
+    if (lx->pos < lx->len && (lx->pos == 0 || lx->buf[lx->pos - 1] != '\n')) {
+        const char *nl = memchr(lx->buf + lx->pos, '\n', lx->len - lx->pos);
+        lx->pos = nl ? (size_t)(nl - lx->buf) + 1 : lx->len;
+    }
+    lx->at_cmd_start = 1;
+    return lx->pos < lx->len;
+}
+
+void lexer_forget(struct lexer *lx)
+{
+    if (lx->pos == 0 || lx->buf != lx->input.buf)
+        return;
+    int line, col;
+    lexer_position(lx, lx->pos, &line, &col); // count the lines being dropped
+    memmove(lx->input.buf, lx->input.buf + lx->pos, lx->input.len - lx->pos);
+    lx->input.len -= lx->pos;
+    lx->known_at -= lx->pos;
+    lx->known_bol -= lx->pos; // wraps if the line started earlier: columns still subtract right
+    lx->pos = 0;
+    lx->len = lx->input.len;
+}
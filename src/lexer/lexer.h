@@ -3,18 +3,50 @@
 
 #include <stdio.h>
 #include "token.h"
+#include "word.h"
+#include "util/str.h"
+
+/* Appends the next whole line(s) to in; returns 0 once the input has ended */
+typedef int (*lexer_refill_fn)(void *ctx, struct str *in);
 
 struct lexer {
-    FILE *in;
-    int line;
-    int col;
+    const char *buf;      // whole input, read or mapped once, or what was refilled so far
+    size_t len;
+    size_t pos;
+    size_t map_len;       // non-zero if buf is an mmap of the script
+    int owns_buf;
+    lexer_refill_fn refill; // called at the end of buf, NULL once the input has ended
+    void *refill_ctx;
+    struct str input;     // what refill appended to, buf while refilling
+    struct str scratch;   // reused to cook quoted words
+    size_t known_at;      // line and column are only counted for errors,
+    size_t known_bol;     // resuming from the last offset asked for
+    int known_line;
     int at_cmd_start;     // pour reconnaître les mots réservés
     int has_peek;
     struct token peeked;
 };
 
 void lexer_init(struct lexer *lx, FILE *in);
+void lexer_init_mem(struct lexer *lx, const char *buf, size_t len);
+/* Input read on demand: fn is only called once the lexer has used up what it gave */
+void lexer_init_refill(struct lexer *lx, lexer_refill_fn fn, void *ctx);
+void lexer_destroy(struct lexer *lx);
 struct token lexer_peek(struct lexer *lx);
 struct token lexer_next(struct lexer *lx);
 
+/* Line and column of an offset, counted from the newlines before it */
+void lexer_position(struct lexer *lx, size_t at, int *line, int *col);
+/* syntax_error() at the position of an offset */
+void lexer_error(struct lexer *lx, size_t at, const char *msg);
+
+/* After a syntax error: drop the rest of the line. Returns 0 at end of input */
+int lexer_resync(struct lexer *lx);
+
+/*
+ * For a refilled lexer, between two commands (nothing peeked): frees the
+ * input already lexed. Positions in later errors still count from the start.
+ */
+void lexer_forget(struct lexer *lx);
+
 #endif
@@ -0,0 +1,137 @@
+#include "scan.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+/*
+ * Classification by nibbles: each high nibble that has bytes in the set
+ * gets a bit, and lo[n] holds the bits of the high nibbles whose group has
+ * low nibble n. A byte is in the set iff hi[c >> 4] & lo[c & 15].
+ */
+struct scan_set {
+    uint8_t hi[16];
+    uint8_t lo[16];
+    const char *bytes;      // the same set, for byte compares
+};
+
+static const struct scan_set special_set = {
+    .hi = { [0x0] = 1, [0x2] = 2, [0x3] = 4, [0x5] = 8, [0x7] = 16 },
+    .lo = {
+        [0x0] = 2,              // ' '
+        [0x2] = 2,              // '"'
+        [0x4] = 2,              // '$'
+        [0x7] = 2,              // '\''
+        [0x8] = 2,              // '('
+        [0x9] = 1 | 2,          // '\t' ')'
+        [0xA] = 1 | 2,          // '\n' '*'
+        [0xB] = 4 | 8,          // ';' '['
+        [0xC] = 4 | 8 | 16,     // '<' '\\' '|'
+        [0xE] = 4,              // '>'
+        [0xF] = 4,              // '?'
+    },
+    .bytes = " \t\n;<>|()'\"$\\*?[",
+};
+
+static const struct scan_set structure_set = {
+    .hi = { [0x0] = 1, [0x2] = 2, [0x3] = 4, [0x7] = 8 },
+    .lo = {
+        [0x2] = 2,              // '"'
+        [0x3] = 2,              // '#'
+        [0x7] = 2,              // '\''
+        [0x8] = 2,              // '('
+        [0x9] = 2,              // ')'
+        [0xA] = 1,              // '\n'
+        [0xB] = 4,              // ';'
+        [0xC] = 8,              // '|'
+    },
+    .bytes = "\n;|()'\"#",
+};
+
+static int in_set(const struct scan_set *set, unsigned char c)
+{
+    return (set->hi[c >> 4] & set->lo[c & 15]) != 0;
+}
+
+int scan_is_special(unsigned char c)
+{
+    return in_set(&special_set, c);
+}
+
+static size_t scan_scalar(const char *buf, size_t pos, size_t len, const struct scan_set *set)
+{
+    while (pos < len && !in_set(set, (unsigned char)buf[pos]))
+        pos++;
+    return pos;
+}
+
+#ifdef SCAN_X86
+static size_t scan_sse2(const char *buf, size_t pos, size_t len, const struct scan_set *set)
+{
+    __m128i want[16];
+    size_t n = strlen(set->bytes);
+    for (size_t k = 0; k < n; k++)
+        want[k] = _mm_set1_epi8(set->bytes[k]);
+
+    for (; pos + 16 <= len; pos += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(buf + pos));
+        __m128i hit = _mm_cmpeq_epi8(v, want[0]);
+        for (size_t k = 1; k < n; k++)
+            hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, want[k]));
+        unsigned mask = (unsigned)_mm_movemask_epi8(hit);
+        if (mask)
+            return pos + (size_t)__builtin_ctz(mask);
+    }
+    return scan_scalar(buf, pos, len, set);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_avx2(const char *buf, size_t pos, size_t len, const struct scan_set *set)
+{
+    const __m256i hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)set->hi));
+    const __m256i lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)set->lo));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+
+    for (; pos + 32 <= len; pos += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(buf + pos));
+        __m256i h = _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+        __m256i l = _mm256_shuffle_epi8(lo, _mm256_and_si256(v, nibble));
+        __m256i quiet = _mm256_cmpeq_epi8(_mm256_and_si256(h, l), zero);
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8(quiet);
+        if (mask)
+            return pos + (size_t)__builtin_ctz(mask);
+    }
+    return scan_sse2(buf, pos, len, set);
+}
+#endif
+
+typedef size_t (*scan_fn)(const char *, size_t, size_t, const struct scan_set *);
+
+static size_t scan_resolve(const char *buf, size_t pos, size_t len, const struct scan_set *set);
+static scan_fn scan_impl = scan_resolve;
+
+/* Picks the implementation on first use; every thread picks the same one */
+static size_t scan_resolve(const char *buf, size_t pos, size_t len, const struct scan_set *set)
+{
+    scan_fn fn = scan_scalar;
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    fn = __builtin_cpu_supports("avx2") ? scan_avx2 : scan_sse2;
+#endif
+    __atomic_store_n(&scan_impl, fn, __ATOMIC_RELAXED);
+    return fn(buf, pos, len, set);
+}
+
+size_t scan_special(const char *buf, size_t pos, size_t len)
+{
+    return __atomic_load_n(&scan_impl, __ATOMIC_RELAXED)(buf, pos, len, &special_set);
+}
+
+size_t scan_structure(const char *buf, size_t pos, size_t len)
+{
+    return __atomic_load_n(&scan_impl, __ATOMIC_RELAXED)(buf, pos, len, &structure_set);
+}
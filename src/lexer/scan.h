@@ -0,0 +1,20 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+
+/*
+ * Index of the first byte at or after pos that a plain word cannot hold:
+ * blanks, newline, ;|<>(), quotes, $, backslash and the glob characters
+ * *?[. Returns len if there is none. Uses AVX2 or SSE2 when the CPU has
+ * them (checked once), and a table otherwise.
+ */
+size_t scan_special(const char *buf, size_t pos, size_t len);
+
+/* The same test for one byte */
+int scan_is_special(unsigned char c);
+
+/* Next byte that can decide where a command ends: newline, ;|(), quotes, # */
+size_t scan_structure(const char *buf, size_t pos, size_t len);
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
+#include <stddef.h>
+
 enum token_type {
     TOK_WORD,
     TOK_IF,
@@ -8,9 +10,20 @@ enum token_type {
     TOK_ELIF,
     TOK_ELSE,
     TOK_FI,
+    TOK_WHILE,
+    TOK_UNTIL,
+    TOK_DO,
+    TOK_DONE,
+    TOK_CASE,
+    TOK_ESAC,
+    TOK_LBRACE,         /* { at command start */
+    TOK_RBRACE,         /* } at command start */
     TOK_SEMI,
     TOK_NL,
     TOK_PIPE,           /* | */
+    TOK_DSEMI,          /* ;; */
+    TOK_LPAREN,         /* ( */
+    TOK_RPAREN,         /* ) */
     /* Redirections */
     TOK_REDIR_IN,       /* < */
     TOK_REDIR_OUT,      /* > */
@@ -23,13 +36,20 @@ enum token_type {
     TOK_EOF
 };
 
+struct word;
+
 struct token {
     enum token_type type;
-    char *value;   // only for TOK_WORD
-    int line;
-    int col;
+    char *value;   // words and TOK_IONUMBER: owned text; reserved words: the interned keyword
+    size_t off;    // raw span of the token in the input
+    size_t len;
+    struct word *word; // expansion template, only if the word has $ or unquoted *?[
+    size_t at;     // where errors point, see lexer_position
 };
 
 void token_free(struct token *t);
+/* A reserved word where only a word can go (a case subject or pattern)
+ * becomes a plain word. Returns 0 if t is no word at all */
+int token_as_word(struct token *t);
 
 #endif
@@ -0,0 +1,101 @@
+#include "word.h"
+#include "util/stats.h"
+#include <stdlib.h>
+#include <string.h>
+
+void word_init(struct word *w)
+{
+    str_init(&w->text);
+    w->segs = NULL;
+    w->nsegs = 0;
+    w->cap = 0;
+    w->has_param = 0;
+    w->has_glob = 0;
+}
+
+static struct word_seg *push_seg(struct word *w, enum word_seg_type type, int quoted)
+{
+    if (w->nsegs == w->cap) {
+        w->cap = w->cap ? w->cap * 2 : 4;
+        w->segs = realloc(w->segs, w->cap * sizeof(struct word_seg));
+        if (!w->segs)
+            abort();
+        STATS_ALLOC(STATS_LEXER, w->cap * sizeof(struct word_seg));
+    }
+    struct word_seg *s = &w->segs[w->nsegs++];
+    s->type = type;
+    s->quoted = quoted;
+    s->off = w->text.len;
+    s->len = 0;
+    return s;
+}
+
+void word_begin_quote(struct word *w)
+{
+    push_seg(w, SEG_LIT, 1);
+}
+
+/* The literal segment to extend: the last one if its quote state matches */
+static struct word_seg *lit_seg(struct word *w, int quoted)
+{
+    if (w->nsegs > 0) {
+        struct word_seg *s = &w->segs[w->nsegs - 1];
+        if (s->type == SEG_LIT && s->quoted == quoted)
+            return s;
+    }
+    return push_seg(w, SEG_LIT, quoted);
+}
+
+void word_add_char(struct word *w, char c, int quoted)
+{
+    struct word_seg *s = lit_seg(w, quoted);
+    if (!quoted && (c == '*' || c == '?' || c == '['))
+        w->has_glob = 1;
+    str_pushc(&w->text, c);
+    s->len++;
+}
+
+void word_add_span(struct word *w, const char *p, size_t n, int quoted)
+{
+    if (n == 0)
+        return;
+    struct word_seg *s = lit_seg(w, quoted);
+    if (!quoted && (memchr(p, '*', n) || memchr(p, '?', n) || memchr(p, '[', n)))
+        w->has_glob = 1;
+    str_appendn(&w->text, p, n);
+    s->len += n;
+}
+
+void word_add_param(struct word *w, const char *name, size_t len, int quoted)
+{
+    struct word_seg *s = push_seg(w, SEG_PARAM, quoted);
+    for (size_t i = 0; i < len; i++)
+        str_pushc(&w->text, name[i]);
+    s->len = len;
+    w->has_param = 1;
+}
+
+char *word_pattern(const struct word *w)
+{
+    struct str pat;
+    str_init(&pat);
+    for (size_t i = 0; i < w->nsegs; i++) {
+        const struct word_seg *s = &w->segs[i];
+        for (size_t k = 0; k < s->len; k++) {
+            char c = w->text.buf[s->off + k];
+            if (c == '\\' || (s->quoted && (c == '*' || c == '?' || c == '[')))
+                str_pushc(&pat, '\\');
+            str_pushc(&pat, c);
+        }
+    }
+    return str_take(&pat);
+}
+
+void word_free(struct word *w)
+{
+    if (!w)
+        return;
+    str_free(&w->text);
+    free(w->segs);
+    free(w);
+}
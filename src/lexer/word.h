@@ -0,0 +1,47 @@
+#ifndef WORD_H
+#define WORD_H
+
+#include <stddef.h>
+#include "util/str.h"
+
+/*
+ * Precompiled word template built by the lexer: a list of literal spans and
+ * parameter references, each with its quote state. Expansion walks the
+ * segments once; it never re-parses the word text.
+ */
+
+enum word_seg_type {
+    SEG_LIT,    /* literal bytes */
+    SEG_PARAM   /* $name, ${name}, $1, $?, ... (span is the name) */
+};
+
+struct word_seg {
+    enum word_seg_type type;
+    int quoted;         /* inside '...' or "..." */
+    size_t off;         /* span in text */
+    size_t len;
+};
+
+struct word {
+    struct str text;    /* bytes of every segment, back to back */
+    struct word_seg *segs;
+    size_t nsegs;
+    size_t cap;
+    int has_param;
+    int has_glob;       /* unquoted *, ? or [ in a literal segment */
+};
+
+void word_init(struct word *w);
+/* Starts a quoted span, so that '' and "" still produce a field */
+void word_begin_quote(struct word *w);
+void word_add_char(struct word *w, char c, int quoted);
+/* Appends n literal bytes at once */
+void word_add_span(struct word *w, const char *p, size_t n, int quoted);
+void word_add_param(struct word *w, const char *name, size_t len, int quoted);
+
+/* Pattern form for pathname expansion: quoted metacharacters are escaped */
+char *word_pattern(const struct word *w);
+
+void word_free(struct word *w);
+
+#endif
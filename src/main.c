@@ -1,25 +1,176 @@
+#include "batch/batch.h"
+#include "check/check.h"
 #include "cli/cli.h"
 #include "lexer/lexer.h"
 #include "parser/parser.h"
 #include "parser/ast.h"
 #include "executer/executer.h"
+#include "executer/lineread.h"
+#include "executer/optimize.h"
+#include "executer/spawn.h"
+#include "expand/dircache.h"
+#include "expand/vars.h"
+#include "history/edit.h"
+#include "history/history.h"
+#include "server/server.h"
+#include "util/error.h"
+#include "util/stats.h"
+#include "util/str.h"
+#include "shell.h"
+#include <sys/stat.h>
+#include <setjmp.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
-int main(int argc, char **argv)
+/* Refills the lexer with one line of a stream, never reading past it */
+static int read_stream_line(void *ctx, struct str *in)
 {
-    struct cli_ctx ctx = cli_parse(argc, argv);
+    int r = line_read(*(int *)ctx, in);
+    if (r > 0)
+        str_pushc(in, '\n');
+    return r > 0;
+}
+
+/*
+ * The next command line, or NULL for a blank one. The setjmp stays in
+ * here, away from the caller's loop state; -1 after a syntax error, which
+ * syntax_error() has already printed.
+ */
+static int parse_next(struct lexer *lx, struct ast **root, int *eof)
+{
+    jmp_buf env;
+    *root = NULL;
+    if (setjmp(env) != 0) {
+        syntax_error_set_recover(NULL);
+        return -1;
+    }
+    syntax_error_set_recover(&env);
+    *root = parse_line(lx, eof);
+    syntax_error_set_recover(NULL);
+    return 0;
+}
+
+/*
+ * One command at a time from the terminal. A command still open at the
+ * end of a line goes on at the PS2 prompt; a syntax error only loses the
+ * command it is in.
+ */
+static int run_interactive(int optimize)
+{
+    if (history_open(NULL) < 0)
+        perror("42sh: history");
+
+    struct edit_prompt prompt = { "42sh$ ", "> ", 0 };
+    struct lexer lx;
+    lexer_init_refill(&lx, edit_refill, &prompt);
+    int status = 0, eof = 0;
+    while (!eof) {
+        struct ast *root;
+        prompt.continued = 0;
+        if (parse_next(&lx, &root, &eof) < 0) {
+            status = SHELL_ERR_SYNTAX;
+            lexer_resync(&lx); // back at PS1; at end of input the next parse sees it
+        }
+        lexer_forget(&lx);
+
+        if (root && optimize)
+            root = optimize_ast(root);
+        if (root) {
+            status = exec_ast(root);
+            ast_free(root);
+        }
+    }
+    lexer_destroy(&lx);
+    history_close();
+    return status;
+}
 
+/*
+ * Pipes and other streams are read a line at a time, and each complete
+ * command runs before the next line is read, so the script's own commands
+ * (read, cat) get the rest of the input and a streamed script starts at
+ * once. A command spanning lines is lexed as its lines arrive, once each.
+ */
+static int run_stream(int fd, int optimize)
+{
     struct lexer lx;
-    lexer_init(&lx, ctx.input);
+    lexer_init_refill(&lx, read_stream_line, &fd);
+    int status = 0, eof = 0;
+    while (!eof) {
+        struct ast *root;
+        if (parse_next(&lx, &root, &eof) < 0) {
+            status = SHELL_ERR_SYNTAX;
+            break;
+        }
+        lexer_forget(&lx);
+
+        if (root && optimize)
+            root = optimize_ast(root);
+        if (root) {
+            status = exec_ast(root);
+            ast_free(root);
+        }
+    }
+    lexer_destroy(&lx);
+    return status;
+}
 
-    struct ast *root = parse_input(&lx);
+/* Regular files and in-memory scripts are parsed whole; anything else is streamed */
+static int streamed(FILE *in)
+{
+    struct stat st;
+    int fd = fileno(in);
+    return fd >= 0 && fstat(fd, &st) == 0 && !S_ISREG(st.st_mode);
+}
+
+int main(int argc, char **argv)
+{
+    struct cli_ctx ctx = cli_parse(argc, argv);
+    if (ctx.mode == CLI_CHECK)
+        return check_files(ctx.argv, ctx.argc, stderr);
+    if (ctx.mode == CLI_BATCH)
+        return batch_run(ctx.argv[0], ctx.outdir, ctx.jobs, ctx.optimize, stdout);
+    if (ctx.mode == CLI_SERVER)
+        return server_run(ctx.socket_path);
+    if (ctx.mode == CLI_CLIENT) {
+        int status = client_run(ctx.socket_path, ctx.input, ctx.argc, ctx.argv);
+        cli_close(&ctx);
+        return status;
+    }
+
+    if (ctx.stats)
+        stats_enable();
+    // before the script is loaded, while this process is still small
+    if (ctx.zygote && spawn_helper_start() < 0)
+        perror("42sh: spawn helper");
+    vars_set_positional(ctx.argc, ctx.argv);
 
     int status = 0;
-    if (root) {
-        status = exec_ast(root);
-        ast_free(root);
+    if (ctx.input == stdin && isatty(STDIN_FILENO)) {
+        status = run_interactive(ctx.optimize);
+    } else if (streamed(ctx.input)) {
+        status = run_stream(fileno(ctx.input), ctx.optimize);
+    } else {
+        struct lexer lx;
+        lexer_init(&lx, ctx.input);
+
+        struct ast *root = parse_input_split(&lx, 0);
+        lexer_destroy(&lx); // the AST only holds interned strings
+
+        if (root && ctx.optimize)
+            root = optimize_ast(root);
+        if (root) {
+            // the last command may replace the shell, unless counters are still to print
+            status = ctx.stats ? exec_ast(root) : exec_ast_final(root);
+            ast_free(root);
+        }
     }
 
+    dircache_clear();
     cli_close(&ctx);
+    if (ctx.stats)
+        stats_dump(stderr);
     return status;
 }
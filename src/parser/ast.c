@@ -1,14 +1,67 @@
 #include "ast.h"
+#include "expand/casetab.h"
+#include "expand/glob.h"
+#include "lexer/word.h"
+#include "util/arena.h"
+#include "util/stats.h"
 #include <stdlib.h>
+#include <string.h>
 
-static void free_argv(char **argv)
+static __thread struct arena *node_arena;
+
+void ast_set_arena(struct arena *a)
+{
+    node_arena = a;
+}
+
+struct arena *ast_arena(void)
+{
+    return node_arena;
+}
+
+void *ast_alloc(size_t n, size_t size)
+{
+    if (node_arena)
+        return arena_alloc(node_arena, n * size);
+    void *p = calloc(n, size);
+    if (!p) abort();
+    return p;
+}
+
+/* skip: index of an interned string not to free, or -1 */
+static void free_argv(char **argv, long skip)
 {
     if (!argv) return;
-    for (size_t i = 0; argv[i]; i++)
-        free(argv[i]);
+    for (long i = 0; argv[i]; i++)
+        if (i != skip)
+            free(argv[i]);
     free(argv);
 }
 
+static void free_globs(struct glob_pat **globs, char **argv)
+{
+    if (!globs) return;
+    for (size_t i = 0; argv[i]; i++)
+        glob_free(globs[i]);
+    free(globs);
+}
+
+static void free_words(struct word **words, size_t len)
+{
+    if (!words) return;
+    for (size_t i = 0; i < len; i++)
+        word_free(words[i]);
+    free(words);
+}
+
+static size_t argv_len(char **argv)
+{
+    size_t n = 0;
+    while (argv && argv[n])
+        n++;
+    return n;
+}
+
 static void free_redirs(struct redirection *redirs, size_t len)
 {
     if (!redirs) return;
@@ -19,8 +72,8 @@ static void free_redirs(struct redirection *redirs, size_t len)
 
 struct ast *ast_new_simple(char **argv)
 {
-    struct ast *n = calloc(1, sizeof(*n));
-    if (!n) abort();
+    struct ast *n = ast_alloc(1, sizeof(*n));
+    STATS_ALLOC(STATS_AST, sizeof(*n));
     n->type = AST_SIMPLE;
     n->as.simple.argv = argv;
     n->as.simple.redirs = NULL;
@@ -30,8 +83,8 @@ struct ast *ast_new_simple(char **argv)
 
 struct ast *ast_new_simple_with_redirs(char **argv, struct redirection *redirs, size_t redir_len)
 {
-    struct ast *n = calloc(1, sizeof(*n));
-    if (!n) abort();
+    struct ast *n = ast_alloc(1, sizeof(*n));
+    STATS_ALLOC(STATS_AST, sizeof(*n));
     n->type = AST_SIMPLE;
     n->as.simple.argv = argv;
     n->as.simple.redirs = redirs;
@@ -41,8 +94,8 @@ struct ast *ast_new_simple_with_redirs(char **argv, struct redirection *redirs,
 
 struct ast *ast_new_list(struct ast **items, size_t len)
 {
-    struct ast *n = calloc(1, sizeof(*n));
-    if (!n) abort();
+    struct ast *n = ast_alloc(1, sizeof(*n));
+    STATS_ALLOC(STATS_AST, sizeof(*n));
     n->type = AST_LIST;
     n->as.list.items = items;
     n->as.list.len = len;
@@ -53,8 +106,8 @@ struct ast *ast_new_if(struct ast *cond, struct ast *then_branch,
                        struct ast **elif_conds, struct ast **elif_thens, size_t elif_len,
                        struct ast *else_branch)
 {
-    struct ast *n = calloc(1, sizeof(*n));
-    if (!n) abort();
+    struct ast *n = ast_alloc(1, sizeof(*n));
+    STATS_ALLOC(STATS_AST, sizeof(*n));
     n->type = AST_IF;
     n->as.ifnode.cond = cond;
     n->as.ifnode.then_branch = then_branch;
@@ -67,21 +120,91 @@ struct ast *ast_new_if(struct ast *cond, struct ast *then_branch,
 
 struct ast *ast_new_pipeline(struct ast **commands, size_t len)
 {
-    struct ast *n = calloc(1, sizeof(*n));
-    if (!n) abort();
+    struct ast *n = ast_alloc(1, sizeof(*n));
+    STATS_ALLOC(STATS_AST, sizeof(*n));
     n->type = AST_PIPELINE;
     n->as.pipeline.commands = commands;
     n->as.pipeline.len = len;
     return n;
 }
 
+struct ast *ast_new_while(struct ast *cond, struct ast *body, int until)
+{
+    struct ast *n = ast_alloc(1, sizeof(*n));
+    STATS_ALLOC(STATS_AST, sizeof(*n));
+    n->type = AST_WHILE;
+    n->as.whilenode.cond = cond;
+    n->as.whilenode.body = body;
+    n->as.whilenode.until = until;
+    return n;
+}
+
+struct ast *ast_new_subshell(struct ast *body)
+{
+    struct ast *n = ast_alloc(1, sizeof(*n));
+    STATS_ALLOC(STATS_AST, sizeof(*n));
+    n->type = AST_SUBSHELL;
+    n->as.subshell.body = body;
+    return n;
+}
+
+struct ast *ast_new_redirect(struct ast *body, struct redirection *redirs, size_t redir_len,
+                             struct word **redir_words)
+{
+    struct ast *n = ast_alloc(1, sizeof(*n));
+    STATS_ALLOC(STATS_AST, sizeof(*n));
+    n->type = AST_REDIRECT;
+    n->as.redirect.body = body;
+    n->as.redirect.redirs = redirs;
+    n->as.redirect.redir_len = redir_len;
+    n->as.redirect.redir_words = redir_words;
+    return n;
+}
+
+struct ast *ast_new_case(char *subject, struct word *subject_word,
+                         struct case_pattern *patterns, size_t npatterns,
+                         struct ast **bodies, size_t len)
+{
+    struct ast *n = ast_alloc(1, sizeof(*n));
+    STATS_ALLOC(STATS_AST, sizeof(*n));
+    n->type = AST_CASE;
+    struct ast_case *c = &n->as.casenode;
+    c->subject = subject;
+    c->subject_word = subject_word;
+    c->patterns = patterns;
+    c->npatterns = npatterns;
+    c->bodies = bodies;
+    c->len = len;
+    if (ast_arena())
+        return n; // parse-only: patterns were not kept
+
+    size_t nlit = 0;
+    for (size_t i = 0; i < npatterns; i++)
+        nlit += !patterns[i].glob && !patterns[i].word;
+    c->dynamic = ast_alloc(npatterns - nlit + 1, sizeof(size_t));
+    if (nlit > 0)
+        c->index = case_index_new(nlit);
+    for (size_t i = 0; i < npatterns; i++) {
+        struct case_pattern *p = &patterns[i];
+        if (p->glob || p->word)
+            c->dynamic[c->ndynamic++] = i;
+        else
+            case_index_add(c->index, p->text, strlen(p->text), p->arm);
+    }
+    return n;
+}
+
 void ast_free(struct ast *n)
 {
     if (!n) return;
 
     if (n->type == AST_SIMPLE) {
-        free_argv(n->as.simple.argv);
-        free_redirs(n->as.simple.redirs, n->as.simple.redir_len);
+        free_globs(n->as.simple.globs, n->as.simple.argv);
+        free_words(n->as.simple.words, argv_len(n->as.simple.argv));
+        free_words(n->as.simple.redir_words, n->as.simple.redir_len);
+        struct ast_simple *s = &n->as.simple;
+        free_argv(s->argv, s->name_interned ? (long)s->assign_len : -1);
+        free_redirs(s->redirs, s->redir_len);
     } else if (n->type == AST_LIST) {
         for (size_t i = 0; i < n->as.list.len; i++)
             ast_free(n->as.list.items[i]);
@@ -100,6 +223,30 @@ void ast_free(struct ast *n)
         for (size_t i = 0; i < n->as.pipeline.len; i++)
             ast_free(n->as.pipeline.commands[i]);
         free(n->as.pipeline.commands);
+    } else if (n->type == AST_WHILE) {
+        ast_free(n->as.whilenode.cond);
+        ast_free(n->as.whilenode.body);
+    } else if (n->type == AST_REDIRECT) {
+        ast_free(n->as.redirect.body);
+        free_words(n->as.redirect.redir_words, n->as.redirect.redir_len);
+        free_redirs(n->as.redirect.redirs, n->as.redirect.redir_len);
+    } else if (n->type == AST_CASE) {
+        struct ast_case *c = &n->as.casenode;
+        word_free(c->subject_word);
+        free(c->subject);
+        for (size_t i = 0; i < c->npatterns; i++) {
+            free(c->patterns[i].text);
+            glob_free(c->patterns[i].glob);
+            word_free(c->patterns[i].word);
+        }
+        for (size_t i = 0; i < c->len; i++)
+            ast_free(c->bodies[i]);
+        free(c->patterns);
+        free(c->dynamic);
+        free(c->bodies);
+        case_index_free(c->index);
+    } else if (n->type == AST_SUBSHELL) {
+        ast_free(n->as.subshell.body);
     }
 
     free(n);
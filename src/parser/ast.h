@@ -7,7 +7,11 @@ enum ast_type {
     AST_SIMPLE,
     AST_LIST,
     AST_IF,
-    AST_PIPELINE
+    AST_PIPELINE,
+    AST_WHILE,
+    AST_REDIRECT,
+    AST_CASE,
+    AST_SUBSHELL
 };
 
 enum redir_type {
@@ -27,6 +31,8 @@ struct redirection {
 };
 
 struct ast;
+struct glob_pat;
+struct word;
 
 struct ast_list {
     struct ast **items;
@@ -35,8 +41,18 @@ struct ast_list {
 
 struct ast_simple {
     char **argv; // NULL-terminated
+    struct glob_pat **globs; // compiled pattern per word (NULL entries if literal), or NULL
+    struct word **words;     // expansion template per word (NULL entries if static), or NULL
     struct redirection *redirs;
     size_t redir_len;
+    struct word **redir_words; // expansion template per target, or NULL
+    size_t assign_len;       // leading NAME=value words
+    int name_interned;       // argv[assign_len] is interned; other strings belong to the node
+    int frozen;              // set by the optimizer: argv and targets need no expansion
+    int builtin;             // builtin id + 1, -1 if external, 0 not bound (executer/bind.h)
+    const char *path;        // where the external command was found, interned, or NULL
+    unsigned long path_gen;  // command table generation path belongs to, 0 if never looked up
+    int path_seen;           // 1 once it ran as an external command, -1 if its name is a path
 };
 
 struct ast_if {
@@ -55,6 +71,46 @@ struct ast_pipeline {
     size_t len;             /* Number of commands */
 };
 
+struct ast_while {
+    struct ast *cond;
+    struct ast *body;
+    int until;              /* loop while cond fails */
+};
+
+/* A compound command with redirections, applied around it in the shell */
+struct ast_redirect {
+    struct ast *body;
+    struct redirection *redirs;
+    size_t redir_len;
+    struct word **redir_words; // expansion template per target, or NULL
+};
+
+struct case_pattern {
+    size_t arm;
+    char *text;              /* quotes removed */
+    struct glob_pat *glob;   /* matcher, NULL if literal or expanded at run time */
+    struct word *word;       /* template of a pattern with parameters, or NULL */
+};
+
+struct case_index;
+
+struct ast_case {
+    char *subject;           /* as written, NULL in parse-only mode */
+    struct word *subject_word; // expansion template, or NULL
+    struct case_pattern *patterns; /* every pattern, in source order */
+    size_t npatterns;
+    size_t *dynamic;         /* indices of the patterns that are not literal */
+    size_t ndynamic;
+    struct case_index *index; /* literal patterns -> first arm, or NULL */
+    struct ast **bodies;     /* per arm, NULL for an empty one */
+    size_t len;
+};
+
+/* ( list ): runs with its own copy of the shell state */
+struct ast_subshell {
+    struct ast *body;
+};
+
 struct ast {
     enum ast_type type;
     union {
@@ -62,6 +118,10 @@ struct ast {
         struct ast_list list;
         struct ast_if ifnode;
         struct ast_pipeline pipeline;
+        struct ast_while whilenode;
+        struct ast_redirect redirect;
+        struct ast_case casenode;
+        struct ast_subshell subshell;
     } as;
 };
 
@@ -72,7 +132,28 @@ struct ast *ast_new_if(struct ast *cond, struct ast *then_branch,
                        struct ast **elif_conds, struct ast **elif_thens, size_t elif_len,
                        struct ast *else_branch);
 struct ast *ast_new_pipeline(struct ast **commands, size_t len);
+struct ast *ast_new_while(struct ast *cond, struct ast *body, int until);
+/* Builds the literal index and the list of patterns matched in order */
+struct ast *ast_new_case(char *subject, struct word *subject_word,
+                         struct case_pattern *patterns, size_t npatterns,
+                         struct ast **bodies, size_t len);
+struct ast *ast_new_subshell(struct ast *body);
+struct ast *ast_new_redirect(struct ast *body, struct redirection *redirs, size_t redir_len,
+                             struct word **redir_words);
 
 void ast_free(struct ast *n);
 
+struct arena;
+
+/*
+ * Parse-only mode: while an arena is set (per thread), nodes and their
+ * arrays come from it, words are dropped instead of compiled, and the
+ * tree is released with the arena rather than ast_free().
+ */
+void ast_set_arena(struct arena *a);
+struct arena *ast_arena(void);
+
+/* Zeroed storage for n elements: from the arena if set, else the heap */
+void *ast_alloc(size_t n, size_t size);
+
 #endif
@@ -1,6 +1,10 @@
 #include "parser.h"
+#include "expand/glob.h"
+#include "expand/vars.h"
 #include "util/error.h"
+#include "util/intern.h"
 #include "util/vec.h"
+#include "util/stats.h"
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
@@ -15,6 +19,9 @@ static int is_stop(enum token_type t, int stop_then, int stop_else, int stop_fi)
     if (stop_then && t == TOK_THEN) return 1;
     if (stop_else && (t == TOK_ELIF || t == TOK_ELSE)) return 1;
     if (stop_fi && t == TOK_FI) return 1;
+    // only ever valid closing a loop, a case arm, a group or a subshell
+    if (t == TOK_DO || t == TOK_DONE || t == TOK_DSEMI || t == TOK_ESAC) return 1;
+    if (t == TOK_RBRACE || t == TOK_RPAREN) return 1;
     return 0;
 }
 
@@ -29,19 +36,41 @@ static void expect(struct lexer *lx, enum token_type type, const char *msg)
 {
     struct token t = lexer_next(lx);
     if (t.type != type) {
-        int line = t.line, col = t.col;
+        size_t at = t.at;
         token_free(&t);
-        syntax_error(line, col, msg);
+        lexer_error(lx, at, msg);
     }
     token_free(&t);
 }
 
+/*
+ * Undo callbacks for what a frame holds while it parses on: a syntax
+ * error frees it through them (util/error.h). In parse-only mode the
+ * nodes go with the arena, only the vectors are the frame's.
+ */
+static void drop_tree(void *arg)
+{
+    struct ast **n = arg;
+    if (!ast_arena())
+        ast_free(*n);
+}
+
+static void drop_trees(void *arg)
+{
+    struct vec *v = arg;
+    for (size_t i = 0; i < v->len && !ast_arena(); i++)
+        ast_free(vec_get(v, i));
+    vec_free(v);
+}
+
 static struct ast *parse_command(struct lexer *lx);
 
 static struct ast *parse_pipeline(struct lexer *lx)
 {
     struct vec commands;
     vec_init(&commands);
+    struct syntax_undo undo;
+    syntax_undo_push(&undo, drop_trees, &commands);
 
     /* Parse first command */
     struct ast *cmd = parse_command(lx);
@@ -72,6 +101,7 @@ static struct ast *parse_pipeline(struct lexer *lx)
         cmd = parse_command(lx);
         vec_push(&commands, cmd);
     }
+    syntax_undo_pop(&undo);
 
     /* If only one command, return it directly (not a pipeline) */
     if (commands.len == 1) {
@@ -81,8 +111,8 @@ static struct ast *parse_pipeline(struct lexer *lx)
     }
 
     /* Build pipeline AST */
-    struct ast **arr = calloc(commands.len, sizeof(struct ast *));
-    if (!arr) abort();
+    struct ast **arr = ast_alloc(commands.len, sizeof(struct ast *));
+    STATS_ALLOC(STATS_PARSER, commands.len * sizeof(struct ast *));
     for (size_t i = 0; i < commands.len; i++)
         arr[i] = (struct ast *)vec_get(&commands, i);
 
@@ -117,110 +147,224 @@ static int default_fd_for_redir(enum redir_type type)
     }
 }
 
+struct simple_words {
+    struct vec args;
+    struct vec globs;       /* struct glob_pat *, compiled now */
+    struct vec words;       /* struct word *, expanded at run time */
+    struct vec redirs;      /* struct redirection *, on the heap */
+    struct vec redir_words;
+    size_t assign_len;      /* leading NAME=value words */
+    int past_assigns;
+    int has_glob;
+    int has_words;
+    int has_redir_words;
+};
+
+/* Literal-only patterns are compiled once here; words with parameters
+ * keep their template for the executer. */
+static void take_word(struct simple_words *sw, struct token *t)
+{
+    int assign = !sw->past_assigns && vars_assign_name_len(t->value) > 0;
+    sw->assign_len += assign;
+    sw->past_assigns |= !assign;
+    if (ast_arena()) {
+        token_free(t); // parse-only: nothing will run, keep no argv
+        return;
+    }
+    struct glob_pat *g = NULL;
+    struct word *w = t->word;
+    if (w && assign && !w->has_param) {
+        word_free(w); // assigned values are not globbed
+        w = NULL;
+    } else if (w && !w->has_param) {
+        char *pat = word_pattern(w);
+        g = glob_compile(pat);
+        free(pat);
+        word_free(w);
+        w = NULL;
+        if (glob_is_literal(g) && !strchr(t->value, '/')) {
+            glob_free(g); // e.g. `[`: matching could only give the word back
+            g = NULL;
+        }
+    }
+    char *text = t->value; // take ownership
+    if (!assign && sw->args.len == sw->assign_len) {
+        // the command name: interned, so repeated names cost one copy in all
+        text = (char *)intern(t->value, strlen(t->value));
+        free(t->value);
+    }
+    vec_push(&sw->args, text);
+    vec_push(&sw->globs, g);
+    vec_push(&sw->words, w);
+    sw->has_glob |= g != NULL;
+    sw->has_words |= w != NULL;
+    t->value = NULL;
+    t->word = NULL;
+    token_free(t);
+}
+
+static void take_redir_word(struct simple_words *sw, struct token *t)
+{
+    struct word *w = t->word;
+    if (w && (!w->has_param || ast_arena())) {
+        word_free(w); /* redirection targets are not globbed */
+        w = NULL;
+    }
+    vec_push(&sw->redir_words, w);
+    sw->has_redir_words |= w != NULL;
+    t->word = NULL;
+}
+
+static void drop_simple(void *arg)
+{
+    struct simple_words *sw = arg;
+    for (size_t i = 0; i < sw->args.len; i++)
+        if (i != sw->assign_len) // the command name is interned
+            free(vec_get(&sw->args, i));
+    for (size_t i = 0; i < sw->globs.len; i++)
+        glob_free(vec_get(&sw->globs, i));
+    for (size_t i = 0; i < sw->words.len; i++)
+        word_free(vec_get(&sw->words, i));
+    for (size_t i = 0; i < sw->redirs.len; i++) {
+        struct redirection *r = vec_get(&sw->redirs, i);
+        free(r->target);
+        free(r);
+    }
+    for (size_t i = 0; i < sw->redir_words.len; i++)
+        word_free(vec_get(&sw->redir_words, i));
+    vec_free(&sw->args);
+    vec_free(&sw->globs);
+    vec_free(&sw->words);
+    vec_free(&sw->redirs);
+    vec_free(&sw->redir_words);
+}
+
+static void **take_array(struct vec *v, int wanted)
+{
+    if (!wanted)
+        return NULL;
+    void **arr = ast_alloc(v->len ? v->len : 1, sizeof(void *));
+    STATS_ALLOC(STATS_PARSER, (v->len ? v->len : 1) * sizeof(void *));
+    for (size_t i = 0; i < v->len; i++)
+        arr[i] = vec_get(v, i);
+    return arr;
+}
+
+/* [IONUMBER] redir-op WORD, appended to sw->redirs */
+static void take_redirection(struct lexer *lx, struct simple_words *sw)
+{
+    int ionum = -1;
+    struct token t = lexer_next(lx);
+    if (t.type == TOK_IONUMBER) {
+        ionum = atoi(t.value);
+        token_free(&t);
+        t = lexer_next(lx);
+        if (!is_redir_token(t.type)) {
+            size_t at = t.at;
+            token_free(&t);
+            lexer_error(lx, at, "expected redirection operator");
+        }
+    }
+    enum redir_type rtype = token_to_redir_type(t.type);
+    token_free(&t);
+
+    struct token target_tok = lexer_next(lx);
+    if (target_tok.type != TOK_WORD) {
+        size_t at = target_tok.at;
+        token_free(&target_tok);
+        lexer_error(lx, at, "expected redirection target");
+    }
+
+    struct redirection *r = calloc(1, sizeof(struct redirection));
+    if (!r) abort();
+    STATS_ALLOC(STATS_PARSER, sizeof(struct redirection));
+    r->type = rtype;
+    if (!ast_arena()) {
+        r->target = target_tok.value; // take ownership
+        target_tok.value = NULL;
+    }
+    take_redir_word(sw, &target_tok);
+    token_free(&target_tok);
+    r->fd = ionum >= 0 ? ionum : default_fd_for_redir(rtype);
+    vec_push(&sw->redirs, r);
+}
+
+/* Moves the heap redirections into one node array */
+static struct redirection *take_redirs(struct vec *redirs)
+{
+    if (redirs->len == 0)
+        return NULL;
+    struct redirection *arr = ast_alloc(redirs->len, sizeof(struct redirection));
+    STATS_ALLOC(STATS_PARSER, redirs->len * sizeof(struct redirection));
+    for (size_t i = 0; i < redirs->len; i++) {
+        struct redirection *src = (struct redirection *)vec_get(redirs, i);
+        arr[i] = *src;
+        free(src);  // Free the heap-allocated redirections from vector
+    }
+    return arr;
+}
+
 static struct ast *parse_simple_command(struct lexer *lx, struct token first)
 {
-    struct vec args;
-    struct vec redirs;
-    vec_init(&args);
-    vec_init(&redirs);
+    struct simple_words sw;
+    memset(&sw, 0, sizeof(sw));
+    vec_init(&sw.args);
+    vec_init(&sw.globs);
+    vec_init(&sw.words);
+    vec_init(&sw.redirs);
+    vec_init(&sw.redir_words);
 
     if (first.type != TOK_WORD) {
-        int line = first.line, col = first.col;
+        size_t at = first.at;
         token_free(&first);
-        syntax_error(line, col, "expected WORD");
+        lexer_error(lx, at, "expected WORD");
     }
-    vec_push(&args, first.value); // take ownership
-    first.value = NULL;
-    token_free(&first);
+    struct syntax_undo undo;
+    syntax_undo_push(&undo, drop_simple, &sw);
+    take_word(&sw, &first);
 
     while (1) {
         struct token t = lexer_peek(lx);
         
         if (t.type == TOK_WORD) {
             t = lexer_next(lx);
-            vec_push(&args, t.value);
-            t.value = NULL;
-            token_free(&t);
-        } else if (t.type == TOK_IONUMBER) {
-            /* IONumber redirect */
-            t = lexer_next(lx);
-            int ionum = atoi(t.value);
-            token_free(&t);
-
-            struct token redir_tok = lexer_next(lx);
-            if (!is_redir_token(redir_tok.type)) {
-                int line = redir_tok.line, col = redir_tok.col;
-                token_free(&redir_tok);
-                syntax_error(line, col, "expected redirection operator");
-            }
-
-            struct token target_tok = lexer_next(lx);
-            if (target_tok.type != TOK_WORD) {
-                int line = target_tok.line, col = target_tok.col;
-                token_free(&target_tok);
-                syntax_error(line, col, "expected redirection target");
-            }
-
-            struct redirection *r = calloc(1, sizeof(struct redirection));
-            if (!r) abort();
-            r->type = token_to_redir_type(redir_tok.type);
-            r->target = target_tok.value;
-            r->fd = ionum;
-            vec_push(&redirs, r);
-
-            token_free(&redir_tok);
-        } else if (is_redir_token(t.type)) {
-            /* Simple redirect without IONumber */
-            t = lexer_next(lx);
-            enum redir_type rtype = token_to_redir_type(t.type);
-            token_free(&t);
-
-            struct token target_tok = lexer_next(lx);
-            if (target_tok.type != TOK_WORD) {
-                int line = target_tok.line, col = target_tok.col;
-                token_free(&target_tok);
-                syntax_error(line, col, "expected redirection target");
-            }
-
-            struct redirection *r = calloc(1, sizeof(struct redirection));
-            if (!r) abort();
-            r->type = rtype;
-            r->target = target_tok.value;
-            r->fd = default_fd_for_redir(rtype);
-            vec_push(&redirs, r);
+            take_word(&sw, &t);
+        } else if (t.type == TOK_IONUMBER || is_redir_token(t.type)) {
+            take_redirection(lx, &sw);
         } else {
             break;
         }
     }
+    syntax_undo_pop(&undo);
 
     // build argv null-terminated
-    char **argv = calloc(args.len + 1, sizeof(char *));
-    if (!argv) abort();
-    for (size_t i = 0; i < args.len; i++)
-        argv[i] = (char *)vec_get(&args, i);
-    argv[args.len] = NULL;
+    char **argv = ast_alloc(sw.args.len + 1, sizeof(char *));
+    STATS_ALLOC(STATS_PARSER, (sw.args.len + 1) * sizeof(char *));
+    for (size_t i = 0; i < sw.args.len; i++)
+        argv[i] = (char *)vec_get(&sw.args, i);
+    argv[sw.args.len] = NULL;
 
     // build redirs array
-    struct redirection *redirs_arr = NULL;
-    size_t redirs_len = 0;
-    if (redirs.len > 0) {
-        redirs_arr = calloc(redirs.len, sizeof(struct redirection));
-        if (!redirs_arr) abort();
-        for (size_t i = 0; i < redirs.len; i++) {
-            struct redirection *src = (struct redirection *)vec_get(&redirs, i);
-            redirs_arr[i] = *src;
-            free(src);  // Free the heap-allocated redirections from vector
-        }
-        redirs_len = redirs.len;
-    }
-
-    vec_free(&args);
-    vec_free(&redirs);
+    size_t redirs_len = sw.redirs.len;
+    struct redirection *redirs_arr = take_redirs(&sw.redirs);
 
+    struct ast *n;
     if (redirs_len > 0)
-        return ast_new_simple_with_redirs(argv, redirs_arr, redirs_len);
+        n = ast_new_simple_with_redirs(argv, redirs_arr, redirs_len);
     else
-        return ast_new_simple(argv);
+        n = ast_new_simple(argv);
+    n->as.simple.name_interned = sw.args.len > sw.assign_len;
+    n->as.simple.assign_len = sw.assign_len;
+    n->as.simple.globs = (struct glob_pat **)take_array(&sw.globs, sw.has_glob);
+    n->as.simple.words = (struct word **)take_array(&sw.words, sw.has_words);
+    n->as.simple.redir_words = (struct word **)take_array(&sw.redir_words, sw.has_redir_words);
+
+    vec_free(&sw.args);
+    vec_free(&sw.globs);
+    vec_free(&sw.words);
+    vec_free(&sw.redirs);
+    vec_free(&sw.redir_words);
+    return n;
 }
 
 static struct ast *parse_compound_list(struct lexer *lx,
@@ -239,6 +383,8 @@ static struct ast *parse_compound_list(struct lexer *lx,
 
     struct vec items;
     vec_init(&items);
+    struct syntax_undo undo;
+    syntax_undo_push(&undo, drop_trees, &items);
 
     while (1) {
         struct token p = lexer_peek(lx);
@@ -265,11 +411,12 @@ static struct ast *parse_compound_list(struct lexer *lx,
     if (items.len == 0) {
         // if we stopped on a stopper token, empty list is syntax error
         struct token t = lexer_peek(lx);
-        syntax_error(t.line, t.col, "expected command");
+        lexer_error(lx, t.at, "expected command");
     }
+    syntax_undo_pop(&undo);
 
-    struct ast **arr = calloc(items.len, sizeof(struct ast *));
-    if (!arr) abort();
+    struct ast **arr = ast_alloc(items.len, sizeof(struct ast *));
+    STATS_ALLOC(STATS_PARSER, items.len * sizeof(struct ast *));
     for (size_t i = 0; i < items.len; i++)
         arr[i] = (struct ast *)vec_get(&items, i);
 
@@ -282,20 +429,27 @@ static struct ast *parse_if(struct lexer *lx)
 {
     // consume IF already peeked by parse_command
     struct token tif = lexer_next(lx);
-    int if_line = tif.line, if_col = tif.col;
+    size_t if_at = tif.at;
     token_free(&tif);
 
-    struct ast *cond = parse_compound_list(lx, 1, 0, 0); // stop on THEN
-    expect(lx, TOK_THEN, "expected 'then'");
-
-    struct ast *then_branch = parse_compound_list(lx, 0, 1, 1); // stop on ELIF/ELSE/FI
-
-    // elif*
+    // filled in as it is parsed, so that an error frees what is there
+    struct ast *n = ast_new_if(NULL, NULL, NULL, NULL, 0, NULL);
+    struct ast_if *in = &n->as.ifnode;
     struct vec elif_conds;
     struct vec elif_thens;
     vec_init(&elif_conds);
     vec_init(&elif_thens);
+    struct syntax_undo undo_n, undo_ec, undo_et;
+    syntax_undo_push(&undo_n, drop_tree, &n);
+    syntax_undo_push(&undo_ec, drop_trees, &elif_conds);
+    syntax_undo_push(&undo_et, drop_trees, &elif_thens);
+
+    in->cond = parse_compound_list(lx, 1, 0, 0); // stop on THEN
+    expect(lx, TOK_THEN, "expected 'then'");
+
+    in->then_branch = parse_compound_list(lx, 0, 1, 1); // stop on ELIF/ELSE/FI
 
+    // elif*
     while (1) {
         struct token p = lexer_peek(lx);
         if (p.type != TOK_ELIF)
@@ -305,49 +459,282 @@ static struct ast *parse_if(struct lexer *lx)
         token_free(&p);
 
         struct ast *ec = parse_compound_list(lx, 1, 0, 0); // stop on THEN
+        vec_push(&elif_conds, ec);
         expect(lx, TOK_THEN, "expected 'then' after elif condition");
         struct ast *et = parse_compound_list(lx, 0, 1, 1); // stop on ELIF/ELSE/FI
-
-        vec_push(&elif_conds, ec);
         vec_push(&elif_thens, et);
     }
 
     // else?
-    struct ast *else_branch = NULL;
     struct token p = lexer_peek(lx);
     if (p.type == TOK_ELSE) {
         p = lexer_next(lx);
         token_free(&p);
-        else_branch = parse_compound_list(lx, 0, 0, 1); // stop on FI
+        in->else_branch = parse_compound_list(lx, 0, 0, 1); // stop on FI
     }
 
     // fi
     struct token end = lexer_next(lx);
     if (end.type != TOK_FI) {
         token_free(&end);
-        syntax_error(if_line, if_col, "expected 'fi'");
+        lexer_error(lx, if_at, "expected 'fi'");
     }
     token_free(&end);
+    syntax_undo_pop(&undo_et);
+    syntax_undo_pop(&undo_ec);
+    syntax_undo_pop(&undo_n);
 
     // build elif arrays
-    struct ast **ec_arr = NULL;
-    struct ast **et_arr = NULL;
-    size_t n = elif_conds.len;
-
-    if (n > 0) {
-        ec_arr = calloc(n, sizeof(struct ast *));
-        et_arr = calloc(n, sizeof(struct ast *));
-        if (!ec_arr || !et_arr) abort();
-        for (size_t i = 0; i < n; i++) {
-            ec_arr[i] = (struct ast *)vec_get(&elif_conds, i);
-            et_arr[i] = (struct ast *)vec_get(&elif_thens, i);
+    size_t len = elif_conds.len;
+    if (len > 0) {
+        in->elif_conds = ast_alloc(len, sizeof(struct ast *));
+        in->elif_thens = ast_alloc(len, sizeof(struct ast *));
+        STATS_ALLOC(STATS_PARSER, len * sizeof(struct ast *));
+        STATS_ALLOC(STATS_PARSER, len * sizeof(struct ast *));
+        for (size_t i = 0; i < len; i++) {
+            in->elif_conds[i] = (struct ast *)vec_get(&elif_conds, i);
+            in->elif_thens[i] = (struct ast *)vec_get(&elif_thens, i);
         }
     }
+    in->elif_len = len;
 
     vec_free(&elif_conds);
     vec_free(&elif_thens);
+    return n;
+}
+
+static struct ast *parse_while(struct lexer *lx)
+{
+    struct token tw = lexer_next(lx);
+    int until = tw.type == TOK_UNTIL;
+    size_t at = tw.at;
+    token_free(&tw);
+
+    struct ast *n = ast_new_while(NULL, NULL, until);
+    struct syntax_undo undo;
+    syntax_undo_push(&undo, drop_tree, &n);
+    n->as.whilenode.cond = parse_compound_list(lx, 0, 0, 0); // stops on DO
+    expect(lx, TOK_DO, "expected 'do'");
+    n->as.whilenode.body = parse_compound_list(lx, 0, 0, 0); // stops on DONE
+
+    struct token end = lexer_next(lx);
+    if (end.type != TOK_DONE) {
+        token_free(&end);
+        lexer_error(lx, at, "expected 'done'");
+    }
+    token_free(&end);
+    syntax_undo_pop(&undo);
+    return n;
+}
 
-    return ast_new_if(cond, then_branch, ec_arr, et_arr, n, else_branch);
+static void skip_separators(struct lexer *lx)
+{
+    while (1) {
+        struct token t = lexer_peek(lx);
+        if (!is_sep(t.type))
+            break;
+        t = lexer_next(lx);
+        token_free(&t);
+    }
+}
+
+/* One pattern of an arm: literal (indexed), compiled matcher, or expanded at run time */
+static void take_pattern(struct vec *patterns, struct token *t, size_t arm)
+{
+    if (ast_arena()) {
+        token_free(t);
+        return;
+    }
+    struct case_pattern *p = calloc(1, sizeof(*p));
+    if (!p)
+        abort();
+    p->arm = arm;
+    p->text = t->value;
+    struct word *w = t->word;
+    if (w && w->has_param) {
+        p->word = w;
+    } else if (w) {
+        char *pat = word_pattern(w);
+        p->glob = glob_compile_match(pat);
+        free(pat);
+        word_free(w);
+        if (glob_is_literal(p->glob)) {
+            glob_free(p->glob);
+            p->glob = NULL;
+        }
+    }
+    vec_push(patterns, p);
+    t->value = NULL;
+    t->word = NULL;
+}
+
+/* What parse_case() holds until the node is built */
+struct case_parts {
+    char *subject;
+    struct word *subject_word;
+    struct vec patterns;    /* struct case_pattern *, on the heap */
+    struct vec bodies;
+};
+
+static void drop_case(void *arg)
+{
+    struct case_parts *c = arg;
+    free(c->subject);
+    word_free(c->subject_word);
+    for (size_t i = 0; i < c->patterns.len; i++) {
+        struct case_pattern *p = vec_get(&c->patterns, i);
+        free(p->text);
+        glob_free(p->glob);
+        word_free(p->word);
+        free(p);
+    }
+    vec_free(&c->patterns);
+    drop_trees(&c->bodies);
+}
+
+static struct ast *parse_case(struct lexer *lx)
+{
+    struct token tc = lexer_next(lx);
+    size_t at = tc.at;
+    token_free(&tc);
+
+    struct token subj = lexer_next(lx);
+    if (!token_as_word(&subj)) {
+        token_free(&subj);
+        lexer_error(lx, at, "expected word after 'case'");
+    }
+    struct case_parts c;
+    c.subject = ast_arena() ? NULL : subj.value; // take ownership
+    c.subject_word = subj.word;
+    if (c.subject_word && (!c.subject_word->has_param || ast_arena())) {
+        word_free(c.subject_word); // the subject is never globbed
+        c.subject_word = NULL;
+    }
+    subj.value = c.subject ? NULL : subj.value;
+    subj.word = NULL;
+    token_free(&subj);
+    vec_init(&c.patterns);
+    vec_init(&c.bodies);
+    struct syntax_undo undo;
+    syntax_undo_push(&undo, drop_case, &c);
+    skip_separators(lx);
+    struct token tin = lexer_next(lx);
+    if (tin.type != TOK_WORD || strcmp(tin.value, "in") != 0) {
+        size_t pos = tin.at;
+        token_free(&tin);
+        lexer_error(lx, pos, "expected 'in'");
+    }
+    token_free(&tin);
+    skip_separators(lx);
+
+    while (lexer_peek(lx).type != TOK_ESAC) {
+        struct token t = lexer_next(lx);
+        if (t.type == TOK_LPAREN) {
+            token_free(&t);
+            t = lexer_next(lx);
+        }
+        while (1) {
+            if (!token_as_word(&t)) {
+                size_t pos = t.at;
+                token_free(&t);
+                lexer_error(lx, pos, "expected case pattern");
+            }
+            take_pattern(&c.patterns, &t, c.bodies.len);
+            struct token sep = lexer_next(lx);
+            enum token_type st = sep.type;
+            size_t pos = sep.at;
+            token_free(&sep);
+            if (st == TOK_RPAREN)
+                break;
+            if (st != TOK_PIPE)
+                lexer_error(lx, pos, "expected ')' after case pattern");
+            t = lexer_next(lx);
+        }
+
+        skip_separators(lx);
+        enum token_type next = lexer_peek(lx).type;
+        struct ast *body = NULL;
+        if (next != TOK_DSEMI && next != TOK_ESAC)
+            body = parse_compound_list(lx, 0, 0, 0); // stops on ;; or esac
+        vec_push(&c.bodies, body);
+
+        struct token end = lexer_peek(lx);
+        if (end.type == TOK_DSEMI) {
+            end = lexer_next(lx);
+            token_free(&end);
+            skip_separators(lx);
+        } else if (end.type != TOK_ESAC) {
+            lexer_error(lx, end.at, "expected ';;' or 'esac'");
+        }
+    }
+    struct token esac = lexer_next(lx);
+    token_free(&esac);
+    syntax_undo_pop(&undo);
+
+    size_t np = c.patterns.len;
+    struct case_pattern *parr = ast_alloc(np ? np : 1, sizeof(*parr));
+    STATS_ALLOC(STATS_PARSER, (np ? np : 1) * sizeof(*parr));
+    for (size_t i = 0; i < np; i++) {
+        struct case_pattern *src = vec_get(&c.patterns, i);
+        parr[i] = *src;
+        free(src);
+    }
+    size_t len = c.bodies.len;
+    struct ast **barr = (struct ast **)take_array(&c.bodies, 1);
+    vec_free(&c.patterns);
+    vec_free(&c.bodies);
+    return ast_new_case(c.subject, c.subject_word, parr, np, barr, len);
+}
+
+/* { list } or ( list ): the closing token must follow the list */
+static struct ast *parse_group(struct lexer *lx, enum token_type close, const char *what)
+{
+    struct token open = lexer_next(lx);
+    token_free(&open);
+    struct ast *body = parse_compound_list(lx, 0, 0, 0);
+    struct syntax_undo undo;
+    syntax_undo_push(&undo, drop_tree, &body);
+    struct token end = lexer_next(lx);
+    enum token_type et = end.type;
+    size_t at = end.at;
+    token_free(&end);
+    if (et != close)
+        lexer_error(lx, at, what);
+    syntax_undo_pop(&undo);
+    return body;
+}
+
+/* Redirections after a compound command apply to all of it */
+static struct ast *parse_compound_redirs(struct lexer *lx, struct ast *body)
+{
+    struct simple_words sw;
+    memset(&sw, 0, sizeof(sw));
+    vec_init(&sw.redirs);
+    vec_init(&sw.redir_words);
+    struct syntax_undo undo_body, undo_sw;
+    syntax_undo_push(&undo_body, drop_tree, &body);
+    syntax_undo_push(&undo_sw, drop_simple, &sw);
+
+    while (1) {
+        struct token t = lexer_peek(lx);
+        if (t.type != TOK_IONUMBER && !is_redir_token(t.type))
+            break;
+        take_redirection(lx, &sw);
+    }
+    syntax_undo_pop(&undo_sw);
+    syntax_undo_pop(&undo_body);
+    if (sw.redirs.len == 0) {
+        vec_free(&sw.redirs);
+        vec_free(&sw.redir_words);
+        return body;
+    }
+
+    size_t len = sw.redirs.len;
+    struct redirection *arr = take_redirs(&sw.redirs);
+    struct word **words = (struct word **)take_array(&sw.redir_words, sw.has_redir_words);
+    vec_free(&sw.redirs);
+    vec_free(&sw.redir_words);
+    return ast_new_redirect(body, arr, len, words);
 }
 
 static struct ast *parse_command(struct lexer *lx)
@@ -355,7 +742,24 @@ static struct ast *parse_command(struct lexer *lx)
     struct token p = lexer_peek(lx);
 
     if (p.type == TOK_IF) {
-        return parse_if(lx);
+        return parse_compound_redirs(lx, parse_if(lx));
+    }
+
+    if (p.type == TOK_WHILE || p.type == TOK_UNTIL) {
+        return parse_compound_redirs(lx, parse_while(lx));
+    }
+
+    if (p.type == TOK_CASE) {
+        return parse_compound_redirs(lx, parse_case(lx));
+    }
+
+    if (p.type == TOK_LBRACE) {
+        return parse_compound_redirs(lx, parse_group(lx, TOK_RBRACE, "expected '}'"));
+    }
+
+    if (p.type == TOK_LPAREN) {
+        struct ast *body = parse_group(lx, TOK_RPAREN, "expected ')'");
+        return parse_compound_redirs(lx, ast_new_subshell(body));
     }
 
     if (p.type == TOK_WORD) {
@@ -363,18 +767,26 @@ static struct ast *parse_command(struct lexer *lx)
         return parse_simple_command(lx, p);
     }
 
-    syntax_error(p.line, p.col, "unexpected token, expected command");
+    lexer_error(lx, p.at, "unexpected token, expected command");
     return NULL;
 }
 
 struct ast *parse_input(struct lexer *lx)
 {
+    // blank lines and comments alone are an empty script
     struct token p = lexer_peek(lx);
+    while (p.type == TOK_NL) {
+        p = lexer_next(lx);
+        token_free(&p);
+        p = lexer_peek(lx);
+    }
     if (p.type == TOK_EOF)
         return NULL;
 
     // root: compound_list until EOF
     struct ast *root = parse_compound_list(lx, 0, 0, 0);
+    struct syntax_undo undo;
+    syntax_undo_push(&undo, drop_tree, &root);
 
     // allow trailing separators/newlines
     while (1) {
@@ -389,10 +801,48 @@ struct ast *parse_input(struct lexer *lx)
 
     p = lexer_next(lx);
     if (p.type != TOK_EOF) {
-        int line = p.line, col = p.col;
+        size_t at = p.at;
         token_free(&p);
-        syntax_error(line, col, "expected end of input");
+        lexer_error(lx, at, "expected end of input");
     }
     token_free(&p);
+    syntax_undo_pop(&undo);
     return root;
 }
+
+struct ast *parse_line(struct lexer *lx, int *eof)
+{
+    struct token p = lexer_peek(lx);
+    if (p.type == TOK_NL || p.type == TOK_EOF) {
+        p = lexer_next(lx);
+        *eof = p.type == TOK_EOF;
+        return NULL; // a blank line, or only a comment
+    }
+
+    struct vec items;
+    vec_init(&items);
+    struct syntax_undo undo;
+    syntax_undo_push(&undo, drop_trees, &items);
+    while (1) {
+        vec_push(&items, parse_pipeline(lx));
+        // separators up to the newline, never past it: the next line may not be written yet
+        p = lexer_peek(lx);
+        while (p.type == TOK_SEMI) {
+            p = lexer_next(lx);
+            token_free(&p);
+            p = lexer_peek(lx);
+        }
+        if (p.type == TOK_NL || p.type == TOK_EOF)
+            break;
+        if (is_stop(p.type, 1, 1, 1))
+            lexer_error(lx, p.at, "expected end of input");
+    }
+    syntax_undo_pop(&undo);
+    p = lexer_next(lx);
+    *eof = p.type == TOK_EOF;
+
+    size_t len = items.len;
+    struct ast **arr = (struct ast **)take_array(&items, 1);
+    vec_free(&items);
+    return ast_new_list(arr, len);
+}
@@ -6,4 +6,20 @@
 
 struct ast *parse_input(struct lexer *lx);
 
+/*
+ * One command line, for input that arrives as it is written: the lexer
+ * reads no further than the newline that ends the command, and is refilled
+ * while the command is unfinished. NULL for a blank line; *eof is set once
+ * the input has ended.
+ */
+struct ast *parse_line(struct lexer *lx, int *eof);
+
+/*
+ * The same tree as parse_input, for a large script held in memory: the
+ * text is cut where top-level commands end and the pieces are parsed on
+ * up to `threads` threads (0: one per CPU), then joined into one list.
+ * Small scripts, and any piece that does not parse, go through parse_input.
+ */
+struct ast *parse_input_split(struct lexer *lx, int threads);
+
 #endif
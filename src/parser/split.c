@@ -0,0 +1,296 @@
+#include "parser.h"
+#include "lexer/scan.h"
+#include "util/error.h"
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SPLIT_MIN_PIECE (1 << 20)
+
+/*
+ * Just enough of the lexer to know where a top-level command ends: quotes,
+ * comments, reserved words opening and closing compound commands, and a
+ * trailing '|' that carries a pipeline over the newline.
+ */
+struct prescan {
+    const char *buf;
+    size_t len;
+    size_t pos;
+    int depth;          // open if/while/until/case/{/(
+    int case_depth;     // open case: its pattern parentheses are not groups
+    int cmd_start;
+    int continued;      // last token was '|'
+};
+
+static int is_break(unsigned char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == ';' || c == '|' || c == '<' || c == '>'
+           || c == '(' || c == ')';
+}
+
+static int word_is(const char *w, size_t n, const char *kw)
+{
+    return strlen(kw) == n && memcmp(w, kw, n) == 0;
+}
+
+/* Offset past the quoted text opening at p, or 0 if it is left open */
+static size_t skip_quoted(const struct prescan *ps, size_t p)
+{
+    const char *buf = ps->buf;
+    if (buf[p] == '\'') {
+        const char *q = memchr(buf + p + 1, '\'', ps->len - p - 1);
+        return q ? (size_t)(q - buf) + 1 : 0;
+    }
+    for (p++; p < ps->len && buf[p] != '"'; p++)
+        if (buf[p] == '\\')
+            p++;
+    return p < ps->len ? p + 1 : 0;
+}
+
+static void reserved_word(struct prescan *ps, const char *w, size_t n)
+{
+    if (n > 5) {
+        ps->cmd_start = 0; // longer than any reserved word
+    } else if (word_is(w, n, "if") || word_is(w, n, "while") || word_is(w, n, "until")
+        || word_is(w, n, "{")) {
+        ps->depth++;
+    } else if (word_is(w, n, "case")) {
+        ps->depth++;
+        ps->case_depth++;
+        ps->cmd_start = 0; // the subject and 'in' follow
+    } else if (word_is(w, n, "fi") || word_is(w, n, "done") || word_is(w, n, "}")) {
+        ps->depth--;
+    } else if (word_is(w, n, "esac")) {
+        ps->depth--;
+        ps->case_depth--;
+    } else if (!word_is(w, n, "then") && !word_is(w, n, "else") && !word_is(w, n, "elif")
+               && !word_is(w, n, "do")) {
+        ps->cmd_start = 0;
+    }
+}
+
+/*
+ * Reads the word a command starts with, which may be a reserved word.
+ * Returns 0 if there is none before the next structural byte.
+ */
+static int command_word(struct prescan *ps)
+{
+    const char *buf = ps->buf;
+    size_t p = ps->pos;
+    while (p < ps->len && (buf[p] == ' ' || buf[p] == '\t'))
+        p++;
+    ps->pos = p;
+    if (p >= ps->len || is_break((unsigned char)buf[p]) || buf[p] == '#')
+        return 0;
+    size_t end = scan_special(buf, p, ps->len);
+    if (end < ps->len && !is_break((unsigned char)buf[end])) {
+        ps->cmd_start = 0; // quoted or expanded: not a reserved word
+        ps->continued = 0;
+        return 1;
+    }
+    ps->pos = end;
+    ps->continued = 0;
+    reserved_word(ps, buf + p, end - p);
+    return 1;
+}
+
+/*
+ * Offset just past the first newline at or after target that ends a
+ * top-level command, or len if there is none before the end. Only the
+ * first word of each command is looked at; the rest is skipped from one
+ * structural byte to the next.
+ */
+static size_t prescan_to(struct prescan *ps, size_t target)
+{
+    const char *buf = ps->buf;
+    while (ps->pos < ps->len) {
+        if (ps->cmd_start && command_word(ps))
+            continue;
+        size_t p = scan_structure(buf, ps->pos, ps->len);
+        if (p >= ps->len)
+            break;
+        char c = buf[p];
+        ps->pos = p + 1;
+        if (c == '\n') {
+            ps->cmd_start = 1;
+            if (ps->depth == 0 && !ps->continued && ps->pos >= target)
+                return ps->pos;
+        } else if (c == ';' || c == '|') {
+            ps->cmd_start = 1;
+            ps->continued = c == '|';
+        } else if (c == '(' || c == ')') {
+            if (!ps->case_depth)
+                ps->depth += c == '(' ? 1 : -1;
+            ps->cmd_start = 1;
+            ps->continued = 0;
+        } else if (c == '#') {
+            // a comment only where a word could start
+            if (p == 0 || is_break((unsigned char)buf[p - 1])) {
+                const char *nl = memchr(buf + p, '\n', ps->len - p);
+                ps->pos = nl ? (size_t)(nl - buf) : ps->len;
+            }
+        } else {
+            ps->pos = skip_quoted(ps, p);
+            if (ps->pos == 0)
+                break;
+        }
+    }
+    ps->pos = ps->len;
+    return ps->len;
+}
+
+struct split_piece {
+    const char *buf;
+    size_t len;
+    struct ast *root;
+    int failed;
+};
+
+struct split_pool {
+    struct split_piece *pieces;
+    int ready;              // pieces cut so far
+    int next;               // next piece to parse
+    int cut;                // the prescan is over
+    pthread_mutex_t lock;
+    pthread_cond_t more;
+};
+
+static void ignore_error(void *ctx, int line, int col, const char *msg)
+{
+    (void)ctx;
+    (void)line;
+    (void)col;
+    (void)msg;
+}
+
+static void parse_piece(struct split_piece *p)
+{
+    struct lexer lx;
+    lexer_init_mem(&lx, p->buf, p->len);
+    jmp_buf env;
+    syntax_error_set_reporter(ignore_error, NULL);
+    if (setjmp(env) == 0) {
+        syntax_error_set_recover(&env);
+        p->root = parse_input(&lx);
+    } else {
+        p->failed = 1; // the whole script is parsed again
+    }
+    syntax_error_set_recover(NULL);
+    syntax_error_set_reporter(NULL, NULL);
+    lexer_destroy(&lx);
+}
+
+static void *worker(void *arg)
+{
+    struct split_pool *pool = arg;
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->next >= pool->ready && !pool->cut)
+            pthread_cond_wait(&pool->more, &pool->lock);
+        if (pool->next >= pool->ready)
+            break;
+        int i = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+        parse_piece(&pool->pieces[i]);
+        pthread_mutex_lock(&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/* Hands each piece to the workers as soon as the prescan finds its end */
+static void cut_pieces(struct split_pool *pool, const struct lexer *lx, size_t want)
+{
+    struct prescan ps = { lx->buf, lx->len, 0, 0, 0, 1, 0 };
+    size_t from = 0;
+    for (size_t i = 1; i <= want && from < lx->len; i++) {
+        size_t to = i == want ? lx->len : prescan_to(&ps, lx->len / want * i);
+        if (to > from) {
+            struct split_piece *p = &pool->pieces[pool->ready];
+            p->buf = lx->buf + from;
+            p->len = to - from;
+            pthread_mutex_lock(&pool->lock);
+            pool->ready++;
+            pthread_cond_signal(&pool->more);
+            pthread_mutex_unlock(&pool->lock);
+        }
+        from = to;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->cut = 1;
+    pthread_cond_broadcast(&pool->more);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* One list of every piece's commands, in order */
+static struct ast *stitch(struct split_piece *pieces, int n)
+{
+    size_t total = 0;
+    for (int i = 0; i < n; i++)
+        if (pieces[i].root)
+            total += pieces[i].root->as.list.len;
+    if (total == 0)
+        return NULL; // only comments and blank lines
+
+    struct ast **items = ast_alloc(total, sizeof(*items));
+    size_t k = 0;
+    for (int i = 0; i < n; i++) {
+        struct ast *r = pieces[i].root;
+        if (!r)
+            continue;
+        memcpy(items + k, r->as.list.items, r->as.list.len * sizeof(*items));
+        k += r->as.list.len;
+        free(r->as.list.items);
+        free(r);
+    }
+    return ast_new_list(items, total);
+}
+
+struct ast *parse_input_split(struct lexer *lx, int threads)
+{
+    if (threads <= 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = ncpu > 0 ? (int)ncpu : 1;
+    }
+    size_t want = lx->len / SPLIT_MIN_PIECE;
+    if (want > (size_t)threads * 4)
+        want = (size_t)threads * 4; // a few per thread, to even out their sizes
+    if (want < 2 || threads < 2 || lx->pos != 0 || lx->has_peek || ast_arena())
+        return parse_input(lx);
+
+    struct split_pool pool = { calloc(want, sizeof(struct split_piece)), 0, 0, 0,
+                               PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+    pthread_t *tids = calloc(want, sizeof(pthread_t));
+    if (!pool.pieces || !tids)
+        abort();
+    // pieces are only parsed on new threads, so the caller's error recovery is left alone
+    int started = 0;
+    while (started < threads && (size_t)started < want
+           && pthread_create(&tids[started], NULL, worker, &pool) == 0)
+        started++;
+    cut_pieces(&pool, lx, want);
+    for (int t = 0; t < started; t++)
+        pthread_join(tids[t], NULL);
+    free(tids);
+
+    int n = pool.ready;
+    int failed = started == 0;
+    for (int i = 0; i < n; i++)
+        failed |= pool.pieces[i].failed;
+    struct ast *root = NULL;
+    if (failed) {
+        // a cut in the wrong place, or a real error to report from the start
+        for (int i = 0; i < n; i++)
+            ast_free(pool.pieces[i].root);
+        root = parse_input(lx);
+    } else {
+        root = stitch(pool.pieces, n);
+        lx->pos = lx->len;
+    }
+    free(pool.pieces);
+    pthread_mutex_destroy(&pool.lock);
+    pthread_cond_destroy(&pool.more);
+    return root;
+}
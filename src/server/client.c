@@ -0,0 +1,97 @@
+#include "server.h"
+#include "proto.h"
+#include "util/fdpass.h"
+#include "util/str.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+extern char **environ;
+
+static int connect_to(const char *path)
+{
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void push_cstr(struct str *s, const char *p)
+{
+    str_appendn(s, p, strlen(p) + 1);
+}
+
+int client_request(const char *path, const char *script, size_t len, int argc, char **argv,
+                   const int fds[3])
+{
+    int sock = connect_to(path);
+    if (sock < 0)
+        return -1;
+
+    struct proto_req h;
+    memset(&h, 0, sizeof(h));
+    h.magic = PROTO_MAGIC;
+    h.argc = (uint32_t)argc;
+    h.script_len = (uint32_t)len;
+
+    // header and payload go out in one buffer so the fds ride on the first sendmsg
+    struct str msg;
+    str_init(&msg);
+    str_appendn(&msg, (const char *)&h, sizeof(h));
+
+    char cwd[PATH_MAX];
+    push_cstr(&msg, getcwd(cwd, sizeof(cwd)) ? cwd : "/");
+    str_appendn(&msg, script, len);
+    str_pushc(&msg, '\0');
+    for (int i = 0; i < argc; i++)
+        push_cstr(&msg, argv[i]);
+    for (char **e = environ; e && *e; e++) {
+        push_cstr(&msg, *e);
+        h.envc++;
+    }
+    h.payload_len = msg.len - sizeof(h);
+    memcpy(msg.buf, &h, sizeof(h));
+
+    int32_t status = -1;
+    if (fd_send(sock, msg.buf, msg.len, fds, PROTO_NFDS) < 0
+        || fd_read_all(sock, &status, sizeof(status)) < 0)
+        status = -1;
+
+    str_free(&msg);
+    close(sock);
+    return status;
+}
+
+int client_run(const char *path, FILE *input, int argc, char **argv)
+{
+    struct str script;
+    str_init(&script);
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), input)) > 0)
+        str_appendn(&script, buf, n);
+
+    static const int fds[3] = { 0, 1, 2 };
+    int status = client_request(path, script.buf ? script.buf : "", script.len, argc, argv, fds);
+    str_free(&script);
+    if (status < 0) {
+        fprintf(stderr, "42sh: cannot reach server at %s\n", path);
+        return 1;
+    }
+    return status;
+}
@@ -0,0 +1,26 @@
+#ifndef PROTO_H
+#define PROTO_H
+
+#include <stdint.h>
+
+/*
+ * Wire format between `42sh --client` and `42sh --server`.
+ *
+ * request:  struct proto_req, with the client's stdin/stdout/stderr
+ *           attached as SCM_RIGHTS, then payload_len bytes:
+ *           cwd \0 script \0 argv[0] \0 ... envp[0] \0 ...
+ * response: int32_t exit status
+ */
+
+#define PROTO_MAGIC 0x34327368u /* "42sh" */
+#define PROTO_NFDS 3
+
+struct proto_req {
+    uint32_t magic;
+    uint32_t argc;
+    uint32_t envc;
+    uint32_t script_len;
+    uint64_t payload_len;
+};
+
+#endif
@@ -0,0 +1,241 @@
+#define _GNU_SOURCE
+
+#include "server.h"
+#include "proto.h"
+#include "util/fdpass.h"
+#include "shell.h"
+#include "lexer/lexer.h"
+#include "parser/parser.h"
+#include "parser/ast.h"
+#include "executer/events.h"
+#include "executer/executer.h"
+#include "expand/vars.h"
+#include "util/error.h"
+#include "util/intern.h"
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+extern char **environ;
+
+/* Parses and runs one script; syntax errors end the script, not the process */
+static int run_script(const char *script, size_t len)
+{
+    struct lexer lx;
+    lexer_init_mem(&lx, script, len);
+
+    jmp_buf env;
+    int status;
+    struct ast *root = NULL;
+    if ((status = setjmp(env)) == 0) {
+        syntax_error_set_recover(&env);
+        root = parse_input(&lx);
+    }
+    syntax_error_set_recover(NULL);
+    lexer_destroy(&lx);
+
+    if (status == 0 && root) {
+        status = exec_ast(root);
+        ast_free(root);
+    }
+    return status;
+}
+
+/* Splits n NUL-terminated strings off the payload into a NULL-terminated array */
+static char **take_strings(char **p, const char *end, uint32_t n)
+{
+    char **arr = calloc((size_t)n + 1, sizeof(char *));
+    if (!arr)
+        abort();
+    for (uint32_t i = 0; i < n; i++) {
+        if (*p >= end)
+            break;
+        arr[i] = *p;
+        *p += strlen(*p) + 1;
+    }
+    return arr;
+}
+
+static void serve_one(int conn)
+{
+    struct proto_req h;
+    int fds[PROTO_NFDS];
+    if (fd_recv(conn, &h, sizeof(h), fds, PROTO_NFDS) < 0 || h.magic != PROTO_MAGIC)
+        _exit(1);
+
+    char *payload = malloc(h.payload_len + 1);
+    if (!payload)
+        abort();
+    if (fd_read_all(conn, payload, h.payload_len) < 0)
+        _exit(1);
+    payload[h.payload_len] = '\0';
+    const char *end = payload + h.payload_len;
+
+    char *p = payload;
+    const char *cwd = p;
+    p += strlen(p) + 1;
+    if (p + h.script_len > end)
+        _exit(1);
+    const char *script = p;
+    p += h.script_len + 1;
+    char **argv = take_strings(&p, end, h.argc);
+    environ = take_strings(&p, end, h.envc);
+
+    for (int i = 0; i < PROTO_NFDS; i++) {
+        if (fds[i] != i) {
+            dup2(fds[i], i);
+            close(fds[i]);
+        }
+    }
+
+    int status;
+    if (chdir(cwd) < 0) {
+        fprintf(stderr, "42sh: cannot enter %s\n", cwd);
+        status = 1;
+    } else {
+        if (h.argc == 0 || !argv[0])
+            vars_set_positional(1, (char *[]){ "42sh", NULL });
+        else
+            vars_set_positional((int)h.argc, argv);
+        status = run_script(script, h.script_len);
+    }
+    fflush(stdout);
+    fflush(stderr);
+
+    int32_t st = status;
+    fd_write_all(conn, &st, sizeof(st));
+    _exit(0);
+}
+
+/* Only the server's own user may have scripts run as it */
+static int peer_allowed(int conn)
+{
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    return getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 && cred.uid == getuid();
+}
+
+/*
+ * Forks the next spare worker. It blocks in accept() and tells the master
+ * through notify as soon as it owns a connection, so there is always one
+ * warm process waiting.
+ */
+static pid_t spawn_worker(int lfd, int notify)
+{
+    pid_t master = getpid();
+    pid_t pid = fork();
+    if (pid != 0)
+        return pid;
+
+    // an idle spare goes away with the master; a busy worker finishes its script
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    if (getppid() != master)
+        _exit(0);
+    signal(SIGCHLD, SIG_DFL);
+    int conn;
+    for (;;) {
+        conn = accept4(lfd, NULL, NULL, SOCK_CLOEXEC);
+        if (conn < 0 && errno == EINTR)
+            continue;
+        if (conn < 0 || peer_allowed(conn))
+            break;
+        close(conn);
+    }
+    prctl(PR_SET_PDEATHSIG, 0);
+    char c = 0;
+    fd_write_all(notify, &c, 1);
+    if (conn < 0)
+        _exit(1);
+    close(lfd);
+    close(notify);
+    serve_one(conn);
+    _exit(0);
+}
+
+static void warm_up(void)
+{
+    // everything a worker would otherwise set up per request
+    static const char *const words[] = { "if", "then", "elif", "else", "fi", "echo", "true",
+                                         "false" };
+    for (size_t i = 0; i < sizeof(words) / sizeof(*words); i++)
+        intern_cstr(words[i]);
+    const char *script = "true\n";
+    run_script(script, strlen(script));
+}
+
+int server_run(const char *path)
+{
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "42sh: socket path too long: %s\n", path);
+        return 1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    int lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (lfd < 0) {
+        perror("42sh: socket");
+        return 1;
+    }
+    // a socket left by an earlier server goes; anything else at path stays
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path);
+    mode_t mask = umask(077);
+    int bound = bind(lfd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(mask);
+    if (bound < 0 || listen(lfd, 128) < 0) {
+        perror("42sh: bind");
+        close(lfd);
+        return 1;
+    }
+
+    int notify[2];
+    if (pipe2(notify, O_CLOEXEC) < 0) {
+        perror("42sh: pipe");
+        close(lfd);
+        return 1;
+    }
+
+    warm_up();
+    // workers are never waited for; their status goes back over the socket
+    signal(SIGCHLD, SIG_IGN);
+
+    for (;;) {
+        pid_t pid = spawn_worker(lfd, notify[1]);
+        if (pid < 0) {
+            perror("42sh: fork");
+            sleep(1);
+            continue;
+        }
+        // a spare that dies before it accepts is replaced, not waited on forever
+        int pidfd = events_pidfd(pid);
+        int gone = pidfd < 0 && errno == ESRCH; // already exited: only a pending notice counts
+        struct pollfd pfd[2] = { { notify[0], POLLIN, 0 }, { pidfd, POLLIN, 0 } };
+        int n;
+        do {
+            n = poll(pfd, pidfd >= 0 ? 2 : 1, gone ? 0 : -1);
+        } while (n < 0 && errno == EINTR);
+        if (pfd[1].fd >= 0)
+            close(pfd[1].fd);
+        if (n < 0)
+            break;
+        char c;
+        if ((pfd[0].revents & POLLIN) && read(notify[0], &c, 1) < 0 && errno != EINTR)
+            break;
+    }
+    close(lfd);
+    return 1;
+}
@@ -0,0 +1,24 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * Persistent shell server. The server keeps a forked worker waiting in
+ * accept(); each request runs in its own worker on the client's stdio,
+ * so a script costs one fork of an already initialised process instead
+ * of a full exec of 42sh.
+ */
+
+/* Serves forever on a unix socket at path; returns only on setup failure */
+int server_run(const char *path);
+
+/* Runs script on the server with the given stdio; returns its exit status */
+int client_request(const char *path, const char *script, size_t len, int argc, char **argv,
+                   const int fds[3]);
+
+/* Reads the whole script from input and runs it with our own stdio */
+int client_run(const char *path, FILE *input, int argc, char **argv);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/*
+ * Bump allocator: many small zeroed allocations released all at once.
+ * Not shared between threads; give each thread its own.
+ */
+
+struct arena_chunk;
+
+struct arena {
+    struct arena_chunk *head;
+};
+
+void arena_init(struct arena *a);
+void *arena_alloc(struct arena *a, size_t size);
+
+/* Forgets every allocation but keeps the newest chunk for reuse */
+void arena_reset(struct arena *a);
+void arena_free(struct arena *a);
+
+#endif
@@ -3,10 +3,55 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+static __thread jmp_buf *recover;
+static __thread syntax_error_fn reporter;
+static __thread void *reporter_ctx;
+static __thread struct syntax_undo *undo_top;
+static __thread struct syntax_undo *undo_mark; // undo_top when recover was set
+
+void syntax_error_set_recover(jmp_buf *env)
+{
+    recover = env;
+    undo_mark = undo_top;
+}
+
+void syntax_undo_push(struct syntax_undo *u, void (*fn)(void *arg), void *arg)
+{
+    u->fn = fn;
+    u->arg = arg;
+    u->prev = undo_top;
+    undo_top = u;
+}
+
+void syntax_undo_pop(struct syntax_undo *u)
+{
+    if (undo_top != u)
+        abort(); // popped out of order: an entry would outlive its frame
+    undo_top = u->prev;
+}
+
+void syntax_error_set_reporter(syntax_error_fn fn, void *ctx)
+{
+    reporter = fn;
+    reporter_ctx = ctx;
+}
+
 void syntax_error(int line, int col, const char *msg)
 {
     if (!msg)
         msg = "syntax error";
-    fprintf(stderr, "42sh: %s at %d:%d\n", msg, line, col);
+    if (reporter)
+        reporter(reporter_ctx, line, col, msg);
+    else
+        fprintf(stderr, "42sh: %s at %d:%d\n", msg, line, col);
+    if (recover) {
+        // the frames are still there: let them free what they were building
+        while (undo_top != undo_mark) {
+            struct syntax_undo *u = undo_top;
+            undo_top = u->prev;
+            u->fn(u->arg);
+        }
+        longjmp(*recover, SHELL_ERR_SYNTAX);
+    }
     exit(SHELL_ERR_SYNTAX);
 }
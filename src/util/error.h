@@ -1,6 +1,34 @@
 #ifndef ERROR_H
 #define ERROR_H
 
+#include <setjmp.h>
+
 void syntax_error(int line, int col, const char *msg);
 
+/* When set, syntax_error() longjmps there instead of exiting */
+void syntax_error_set_recover(jmp_buf *env);
+
+typedef void (*syntax_error_fn)(void *ctx, int line, int col, const char *msg);
+
+/* When set, syntax errors go to fn instead of stderr */
+void syntax_error_set_reporter(syntax_error_fn fn, void *ctx);
+
+/*
+ * Work a syntax error would strand, such as the children of a node not
+ * built yet. While a recover point is set, syntax_error() calls fn(arg)
+ * for every entry pushed since it was set, newest first, before it jumps.
+ * Entries live in the frame that pushes them and are popped in reverse
+ * order once what they guard has a new owner.
+ */
+struct syntax_undo {
+    void (*fn)(void *arg);
+    void *arg;
+    struct syntax_undo *prev;
+};
+
+void syntax_undo_push(struct syntax_undo *u, void (*fn)(void *arg), void *arg);
+void syntax_undo_pop(struct syntax_undo *u);
+
+/* All these settings are per thread */
+
 #endif
@@ -0,0 +1,20 @@
+#ifndef FDPASS_H
+#define FDPASS_H
+
+#include <stddef.h>
+
+/* Most descriptors one message can carry */
+#define FDPASS_MAX 8
+
+/* Full-length write/read, retried on EINTR and short transfers */
+int fd_write_all(int fd, const void *buf, size_t len);
+int fd_read_all(int fd, void *buf, size_t len);
+
+/*
+ * One message with exactly nfds descriptors attached (SCM_RIGHTS) over a
+ * unix socket. Received descriptors are close-on-exec.
+ */
+int fd_send(int sock, const void *buf, size_t len, const int *fds, int nfds);
+int fd_recv(int sock, void *buf, size_t len, int *fds, int nfds);
+
+#endif
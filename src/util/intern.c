@@ -0,0 +1,161 @@
+#include "intern.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INTERN_CHUNK 65536
+#define INTERN_SHARDS 16
+
+struct intern_entry {
+    struct intern_entry *next;
+    size_t hash;
+    size_t len;
+    char str[];
+};
+
+struct intern_chunk {
+    struct intern_chunk *next;
+    size_t used;
+    size_t cap;
+    char data[];
+};
+
+/* The table is split by hash so parser threads rarely wait on each other */
+struct intern_shard {
+    pthread_mutex_t lock;
+    struct intern_entry **table;
+    size_t table_cap;
+    size_t table_len;
+    struct intern_chunk *chunks;
+};
+
+static struct intern_shard shards[INTERN_SHARDS] = {
+    [0 ... INTERN_SHARDS - 1] = { .lock = PTHREAD_MUTEX_INITIALIZER },
+};
+
+static struct intern_shard *shard_of(size_t h)
+{
+    // the low bits pick the bucket, the high ones the shard
+    return &shards[h >> (sizeof(size_t) * 8 - 4)];
+}
+
+size_t intern_hash_bytes(const char *s, size_t len)
+{
+    size_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/* Entries are carved from large chunks: interning costs no malloc per string */
+static struct intern_entry *alloc_entry(struct intern_shard *sh, size_t len)
+{
+    size_t need = sizeof(struct intern_entry) + len + 1;
+    need = (need + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+    struct intern_chunk *c = sh->chunks;
+    if (!c || c->used + need > c->cap) {
+        size_t cap = need > INTERN_CHUNK ? need : INTERN_CHUNK;
+        c = malloc(sizeof(struct intern_chunk) + cap);
+        if (!c)
+            abort();
+        c->next = sh->chunks;
+        c->used = 0;
+        c->cap = cap;
+        sh->chunks = c;
+    }
+    struct intern_entry *e = (struct intern_entry *)(c->data + c->used);
+    c->used += need;
+    return e;
+}
+
+static void grow(struct intern_shard *sh)
+{
+    size_t ncap = sh->table_cap ? sh->table_cap * 2 : 256;
+    struct intern_entry **nt = calloc(ncap, sizeof(struct intern_entry *));
+    if (!nt)
+        abort();
+    for (size_t i = 0; i < sh->table_cap; i++) {
+        struct intern_entry *e = sh->table[i];
+        while (e) {
+            struct intern_entry *next = e->next;
+            size_t b = e->hash & (ncap - 1);
+            e->next = nt[b];
+            nt[b] = e;
+            e = next;
+        }
+    }
+    free(sh->table);
+    sh->table = nt;
+    sh->table_cap = ncap;
+}
+
+static struct intern_entry *lookup(struct intern_shard *sh, const char *s, size_t len, size_t h)
+{
+    if (!sh->table)
+        return NULL;
+    for (struct intern_entry *e = sh->table[h & (sh->table_cap - 1)]; e; e = e->next) {
+        if (e->hash == h && e->len == len && memcmp(e->str, s, len) == 0)
+            return e;
+    }
+    return NULL;
+}
+
+const char *intern(const char *s, size_t len)
+{
+    size_t h = intern_hash_bytes(s, len);
+    struct intern_shard *sh = shard_of(h);
+    pthread_mutex_lock(&sh->lock);
+
+    struct intern_entry *e = lookup(sh, s, len, h);
+    if (!e) {
+        if (sh->table_len >= sh->table_cap)
+            grow(sh);
+
+        e = alloc_entry(sh, len);
+        e->hash = h;
+        e->len = len;
+        memcpy(e->str, s, len);
+        e->str[len] = '\0';
+
+        size_t b = h & (sh->table_cap - 1);
+        e->next = sh->table[b];
+        sh->table[b] = e;
+        sh->table_len++;
+    }
+    pthread_mutex_unlock(&sh->lock);
+    return e->str;
+}
+
+const char *intern_cstr(const char *s)
+{
+    return intern(s, strlen(s));
+}
+
+const char *intern_find(const char *s, size_t len)
+{
+    size_t h = intern_hash_bytes(s, len);
+    struct intern_shard *sh = shard_of(h);
+    pthread_mutex_lock(&sh->lock);
+    struct intern_entry *e = lookup(sh, s, len, h);
+    pthread_mutex_unlock(&sh->lock);
+    return e ? e->str : NULL;
+}
+
+static const struct intern_entry *entry_of(const char *interned)
+{
+    return (const struct intern_entry *)(interned - offsetof(struct intern_entry, str));
+}
+
+size_t intern_hash(const char *interned)
+{
+    return entry_of(interned)->hash;
+}
+
+size_t intern_len(const char *interned)
+{
+    return entry_of(interned)->len;
+}
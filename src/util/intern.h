@@ -0,0 +1,25 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+
+/*
+ * Global string table. Interning the same bytes twice returns the same
+ * pointer, so interned strings compare with ==. Strings live until the
+ * process exits; their hash is kept next to them. Safe to use from
+ * several threads.
+ */
+
+const char *intern(const char *s, size_t len);
+const char *intern_cstr(const char *s);
+
+/* Returns the interned copy of s if there is one, without adding it */
+const char *intern_find(const char *s, size_t len);
+
+/* Only valid on pointers returned by intern() */
+size_t intern_hash(const char *interned);
+size_t intern_len(const char *interned);
+
+size_t intern_hash_bytes(const char *s, size_t len);
+
+#endif
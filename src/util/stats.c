@@ -0,0 +1,92 @@
+#include "stats.h"
+
+#ifdef SHELL_STATS
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <malloc.h>
+
+static const char *const sub_names[STATS_NSUBS] = {
+    "str", "vec", "lexer", "parser", "ast", "expand", "executer", "builtins", "events", "spawn",
+};
+
+static const char *const counter_names[STATS_NCOUNTERS] = {
+    "allocs", "alloc_bytes", "fork", "execvp", "pipe", "dup2", "open", "close", "waitpid",
+};
+
+/*
+ * Counters live in a shared mapping so forked children (pipeline stages,
+ * builtins run for redirections) add to the same totals. The last slot is
+ * the peak heap seen by any of them.
+ */
+#define STATS_PEAK (STATS_NSUBS * STATS_NCOUNTERS)
+
+static size_t *shared;
+
+void stats_enable(void)
+{
+    if (shared)
+        return;
+    void *p = mmap(NULL, (STATS_PEAK + 1) * sizeof(size_t), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p != MAP_FAILED)
+        shared = p;
+}
+
+void stats_count(enum stats_sub sub, enum stats_counter c, size_t n)
+{
+    if (shared)
+        __atomic_fetch_add(&shared[sub * STATS_NCOUNTERS + c], n, __ATOMIC_RELAXED);
+}
+
+static void sample_heap(void)
+{
+    size_t used = mallinfo2().uordblks;
+    size_t peak = __atomic_load_n(&shared[STATS_PEAK], __ATOMIC_RELAXED);
+    while (used > peak
+           && !__atomic_compare_exchange_n(&shared[STATS_PEAK], &peak, used, 1,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+void stats_alloc(enum stats_sub sub, size_t bytes)
+{
+    if (!shared)
+        return;
+    stats_count(sub, STATS_ALLOCS, 1);
+    stats_count(sub, STATS_ALLOC_BYTES, bytes);
+    sample_heap();
+}
+
+void stats_dump(FILE *out)
+{
+    if (!shared)
+        return;
+    sample_heap();
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+
+    fprintf(out, "{\n  \"subsystems\": {");
+    int first_sub = 1;
+    for (int s = 0; s < STATS_NSUBS; s++) {
+        int first = 1;
+        for (int c = 0; c < STATS_NCOUNTERS; c++) {
+            size_t v = shared[s * STATS_NCOUNTERS + c];
+            if (!v)
+                continue;
+            if (first)
+                fprintf(out, "%s\n    \"%s\": {", first_sub ? "" : ",", sub_names[s]);
+            fprintf(out, "%s\"%s\": %zu", first ? "" : ", ", counter_names[c], v);
+            first = first_sub = 0;
+        }
+        if (!first)
+            fprintf(out, "}");
+    }
+    fprintf(out, "%s},\n", first_sub ? "" : "\n  ");
+    fprintf(out, "  \"peak_heap_bytes\": %zu,\n", shared[STATS_PEAK]);
+    fprintf(out, "  \"max_rss_kb\": %ld\n}\n", ru.ru_maxrss);
+    fflush(out);
+}
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * Work counters for `42sh --stats`, grouped by subsystem and printed as
+ * JSON at exit. Counting only happens once stats_enable() was called;
+ * builds without SHELL_STATS (Release) compile every hook out.
+ */
+
+enum stats_sub {
+    STATS_STR,
+    STATS_VEC,
+    STATS_LEXER,
+    STATS_PARSER,
+    STATS_AST,
+    STATS_EXPAND,
+    STATS_EXECUTER,
+    STATS_BUILTINS,
+    STATS_EVENTS,
+    STATS_SPAWN,
+    STATS_NSUBS,
+};
+
+enum stats_counter {
+    STATS_ALLOCS,
+    STATS_ALLOC_BYTES,
+    STATS_FORK,
+    STATS_EXECVP,
+    STATS_PIPE,
+    STATS_DUP2,
+    STATS_OPEN,
+    STATS_CLOSE,
+    STATS_WAITPID,
+    STATS_NCOUNTERS,
+};
+
+#ifdef SHELL_STATS
+
+void stats_enable(void);
+void stats_count(enum stats_sub sub, enum stats_counter c, size_t n);
+void stats_alloc(enum stats_sub sub, size_t bytes);
+void stats_dump(FILE *out);
+
+#define STATS_COUNT(sub, c) stats_count((sub), (c), 1)
+#define STATS_ALLOC(sub, bytes) stats_alloc((sub), (bytes))
+
+#else
+
+#define stats_enable() ((void)0)
+#define stats_dump(out) ((void)(out))
+#define STATS_COUNT(sub, c) ((void)(sub), (void)(c))
+#define STATS_ALLOC(sub, bytes) ((void)(sub), (void)(bytes))
+
+#endif
+
+#endif
@@ -1,4 +1,5 @@
 #include "str.h"
+#include "stats.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -28,6 +29,7 @@ static void ensure_cap(struct str *s, size_t add)
     char *nb = realloc(s->buf, nc);
     if (!nb)
         abort();
+    STATS_ALLOC(STATS_STR, nc);
     s->buf = nb;
     s->cap = nc;
 }
@@ -41,7 +43,11 @@ void str_pushc(struct str *s, char c)
 
 void str_append(struct str *s, const char *t)
 {
-    size_t n = strlen(t);
+    str_appendn(s, t, strlen(t));
+}
+
+void str_appendn(struct str *s, const char *t, size_t n)
+{
     ensure_cap(s, n);
     memcpy(s->buf + s->len, t, n);
     s->len += n;
@@ -54,6 +60,7 @@ char *str_take(struct str *s)
         char *z = malloc(1);
         if (!z)
             abort();
+        STATS_ALLOC(STATS_STR, 1);
         z[0] = '\0';
         return z;
     }
@@ -12,6 +12,7 @@ struct str {
 void str_init(struct str *s);
 void str_pushc(struct str *s, char c);
 void str_append(struct str *s, const char *t);
+void str_appendn(struct str *s, const char *t, size_t n);
 char *str_take(struct str *s); // retourne malloced string et reset
 void str_free(struct str *s);
 
@@ -1,4 +1,5 @@
 #include "vec.h"
+#include "stats.h"
 #include <stdlib.h>
 
 void vec_init(struct vec *v)
@@ -28,6 +29,7 @@ void vec_push(struct vec *v, void *ptr)
         void **nd = realloc(v->data, new_cap * sizeof(void *));
         if (!nd)
             abort();
+        STATS_ALLOC(STATS_VEC, new_cap * sizeof(void *));
         v->data = nd;
         v->cap = new_cap;
     }
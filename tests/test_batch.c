@@ -0,0 +1,107 @@
+#include <criterion/criterion.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "batch/batch.h"
+
+static char dir[64];
+
+static void make_dir(void)
+{
+    snprintf(dir, sizeof(dir), "/tmp/test_batch_%d", (int)getpid());
+    char cmd[256];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s && mkdir -p %s/scripts", dir, dir);
+    cr_assert_eq(system(cmd), 0);
+}
+
+static void remove_dir(void)
+{
+    char cmd[256];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    system(cmd);
+}
+
+static void write_file(const char *name, const char *content)
+{
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *f = fopen(path, "w");
+    cr_assert_not_null(f);
+    fputs(content, f);
+    fclose(f);
+}
+
+static void read_output(const char *name, char *buf, size_t cap)
+{
+    char path[128];
+    snprintf(path, sizeof(path), "%s/out/%s", dir, name);
+    FILE *f = fopen(path, "r");
+    cr_assert_not_null(f, "missing %s", path);
+    size_t n = fread(buf, 1, cap - 1, f);
+    buf[n] = '\0';
+    fclose(f);
+}
+
+static int run(const char *source, char **summary)
+{
+    char src[128], out[128];
+    snprintf(src, sizeof(src), "%s/%s", dir, source);
+    snprintf(out, sizeof(out), "%s/out", dir);
+    size_t len;
+    FILE *f = open_memstream(summary, &len);
+    int st = batch_run(src, out, 2, 0, f);
+    fclose(f);
+    return st;
+}
+
+Test(batch, manifest_jobs_get_their_argv_and_files, .init = make_dir, .fini = remove_dir)
+{
+    write_file("scripts/greet.sh", "echo hello $1\necho oops >&2\n");
+    char manifest[512];
+    snprintf(manifest, sizeof(manifest),
+             "# two runs of one script\n%s/scripts/greet.sh world\n\n%s/scripts/greet.sh you\n",
+             dir, dir);
+    write_file("jobs", manifest);
+
+    char *summary;
+    cr_assert_eq(run("jobs", &summary), 0);
+    cr_assert_not_null(strstr(summary, "greet.sh world"));
+    free(summary);
+
+    char buf[128];
+    read_output("1.out", buf, sizeof(buf));
+    cr_assert_str_eq(buf, "hello world\n");
+    read_output("2.out", buf, sizeof(buf));
+    cr_assert_str_eq(buf, "hello you\n");
+    read_output("2.err", buf, sizeof(buf));
+    cr_assert_str_eq(buf, "oops\n");
+}
+
+Test(batch, directory_reports_each_status, .init = make_dir, .fini = remove_dir)
+{
+    write_file("scripts/a.sh", "true\n");
+    write_file("scripts/b.sh", "false\n");
+    write_file("scripts/c.sh", "then\n");
+
+    char *summary;
+    cr_assert_eq(run("scripts", &summary), 1);
+
+    char *a = strstr(summary, "a.sh"), *b = strstr(summary, "b.sh"), *c = strstr(summary, "c.sh");
+    cr_assert(a && b && c && a < b && b < c);
+    // status is the second column of each row, after the header
+    int expected[] = { 0, 1, 2 };
+    char *row = strchr(summary, '\n') + 1;
+    for (int i = 0; i < 3; i++, row = strchr(row, '\n') + 1) {
+        int job, status;
+        cr_assert_eq(sscanf(row, "%d %d", &job, &status), 2);
+        cr_assert_eq(job, i + 1);
+        cr_assert_eq(status, expected[i]);
+    }
+    free(summary);
+
+    char buf[128];
+    read_output("3.err", buf, sizeof(buf));
+    cr_assert_not_null(strstr(buf, "at 1:0"));
+}
@@ -0,0 +1,82 @@
+#include <criterion/criterion.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "check/check.h"
+
+static char paths[3][64];
+
+static char *write_script(int i, const char *s)
+{
+    snprintf(paths[i], sizeof(paths[i]), "/tmp/test_check_%d_%d.sh", (int)getpid(), i);
+    FILE *f = fopen(paths[i], "w");
+    cr_assert_not_null(f);
+    fputs(s, f);
+    fclose(f);
+    return paths[i];
+}
+
+static void remove_scripts(void)
+{
+    for (int i = 0; i < 3; i++)
+        if (paths[i][0])
+            unlink(paths[i]);
+}
+
+// runs check_files and captures its report
+static int check(char **files, int n, char **report)
+{
+    size_t len;
+    FILE *out = open_memstream(report, &len);
+    cr_assert_not_null(out);
+    int st = check_files(files, n, out);
+    fclose(out);
+    return st;
+}
+
+Test(check, valid_files_pass, .fini = remove_scripts)
+{
+    char *files[] = {
+        write_script(0, "echo a | tr a b\nif true; then echo x; elif false; then :; fi\n"),
+        write_script(1, "ls > out 2>&1; cat < in\n"),
+    };
+    char *report;
+    cr_assert_eq(check(files, 2, &report), 0);
+    cr_assert_str_eq(report, "");
+    free(report);
+}
+
+Test(check, reports_every_error_with_position, .fini = remove_scripts)
+{
+    char *files[] = { write_script(0, "echo ok\nthen\necho ok\necho > ;\n") };
+    char *report;
+    cr_assert_eq(check(files, 1, &report), 2);
+
+    char expected[256];
+    snprintf(expected, sizeof(expected),
+             "%s:2:0: unexpected token, expected command\n"
+             "%s:4:8: expected redirection target\n",
+             files[0], files[0]);
+    cr_assert_str_eq(report, expected);
+    free(report);
+}
+
+Test(check, reports_in_argument_order, .fini = remove_scripts)
+{
+    char *files[] = {
+        write_script(0, "fi\n"),
+        "/nonexistent/script.sh",
+        write_script(2, "echo |\n"),
+    };
+    char *report;
+    cr_assert_eq(check(files, 3, &report), 2);
+
+    char *first = strstr(report, paths[0]);
+    char *second = strstr(report, "/nonexistent/script.sh: ");
+    char *third = strstr(report, paths[2]);
+    cr_assert(first && second && third);
+    cr_assert(first < second && second < third);
+    free(report);
+}
@@ -0,0 +1,122 @@
+#include <criterion/criterion.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "expand/cmdtable.h"
+#include "history/complete.h"
+#include "util/vec.h"
+
+static char dir[64];
+static char bin1[96], bin2[96];
+
+static void touch(const char *d, const char *name, int mode)
+{
+    char path[192];
+    snprintf(path, sizeof(path), "%s/%s", d, name);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, mode);
+    cr_assert_geq(fd, 0);
+    close(fd);
+    chmod(path, mode);
+}
+
+static void make_path(void)
+{
+    snprintf(dir, sizeof(dir), "/tmp/test_complete_%d", (int)getpid());
+    snprintf(bin1, sizeof(bin1), "%s/bin1", dir);
+    snprintf(bin2, sizeof(bin2), "%s/bin2", dir);
+    char cmd[512];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s && mkdir -p %s %s %s/src/sub", dir, bin1, bin2, dir);
+    cr_assert_eq(system(cmd), 0);
+
+    touch(bin1, "frobnicate", 0755);
+    touch(bin1, "frobber", 0755);
+    touch(bin1, "notes.txt", 0644);
+    touch(bin2, "frobber", 0755);
+    touch(bin2, "zap", 0755);
+    char path[256];
+    snprintf(path, sizeof(path), "%s:%s", bin1, bin2);
+    setenv("PATH", path, 1);
+    cmdtable_clear();
+}
+
+static void remove_path(void)
+{
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    system(cmd);
+    cmdtable_clear();
+}
+
+static void free_all(struct vec *v)
+{
+    for (size_t i = 0; i < v->len; i++)
+        free(vec_get(v, i));
+    vec_free(v);
+}
+
+Test(cmdtable, first_directory_wins, .init = make_path, .fini = remove_path)
+{
+    char want[192];
+    snprintf(want, sizeof(want), "%s/frobber", bin1);
+    cr_assert_str_eq(cmdtable_lookup("frobber"), want);
+    snprintf(want, sizeof(want), "%s/zap", bin2);
+    cr_assert_str_eq(cmdtable_lookup("zap"), want);
+    cr_assert_null(cmdtable_lookup("notes.txt"));
+    cr_assert_null(cmdtable_lookup("frob"));
+}
+
+Test(cmdtable, prefix_is_sorted_range, .init = make_path, .fini = remove_path)
+{
+    size_t first;
+    cr_assert_eq(cmdtable_prefix("frob", 4, &first), 2);
+    cr_assert_str_eq(cmdtable_name(first), "frobber");
+    cr_assert_str_eq(cmdtable_name(first + 1), "frobnicate");
+    cr_assert_eq(cmdtable_prefix("q", 1, &first), 0);
+}
+
+Test(cmdtable, follows_directory_changes, .init = make_path, .fini = remove_path)
+{
+    cr_assert_not_null(cmdtable_lookup("zap"));
+    unsigned long gen = cmdtable_generation();
+
+    touch(bin2, "zoom", 0755);
+    char path[192];
+    snprintf(path, sizeof(path), "%s/zap", bin2);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/frobber", bin1);
+    chmod(path, 0644);
+
+    cr_assert_not_null(cmdtable_lookup("zoom"));
+    cr_assert_null(cmdtable_lookup("zap"));
+    char want[192];
+    snprintf(want, sizeof(want), "%s/frobber", bin2);
+    cr_assert_str_eq(cmdtable_lookup("frobber"), want);
+    cr_assert_neq(cmdtable_generation(), gen);
+}
+
+Test(complete, command_and_file_words, .init = make_path, .fini = remove_path)
+{
+    struct vec c;
+    size_t start;
+    vec_init(&c);
+    complete_candidates("ls; frobn", 9, &start, &c);
+    cr_assert_eq(start, 4);
+    cr_assert_eq(c.len, 1);
+    cr_assert_str_eq(vec_get(&c, 0), "frobnicate");
+    free_all(&c);
+
+    char line[128];
+    snprintf(line, sizeof(line), "cat %s/s", dir);
+    vec_init(&c);
+    complete_candidates(line, strlen(line), &start, &c);
+    cr_assert_eq(start, 4);
+    cr_assert_eq(c.len, 1);
+    char want[128];
+    snprintf(want, sizeof(want), "%s/src/", dir);
+    cr_assert_str_eq(vec_get(&c, 0), want);
+    free_all(&c);
+}
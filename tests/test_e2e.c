@@ -1,14 +1,25 @@
 #include <criterion/criterion.h>
 #include <criterion/redirect.h>
+#include <signal.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <dirent.h>
 
 #include "lexer/lexer.h"
 #include "parser/parser.h"
 #include "parser/ast.h"
 #include "executer/executer.h"
+#include "executer/spawn.h"
+#include "history/edit.h"
+#include "expand/vars.h"
+#include "util/stats.h"
+#include "util/str.h"
 
 static int run_script(const char *s)
 {
@@ -372,3 +383,701 @@ Test(e2e, pipeline_builtin_echo, .init = redirect_all)
     cr_assert_eq(st, 0);
     cr_assert_stdout_eq_str("hello\n");
 }
+
+// Pathname expansion
+static void glob_dir(void)
+{
+    redirect_all();
+    char dir[] = "/tmp/test_e2e_glob_XXXXXX";
+    cr_assert_not_null(mkdtemp(dir));
+    cr_assert_eq(chdir(dir), 0);
+    fclose(fopen("one.txt", "w"));
+    fclose(fopen("two.txt", "w"));
+}
+
+Test(e2e, glob_expansion, .init = glob_dir)
+{
+    int st = run_script("echo *.txt");
+    cr_assert_eq(st, 0);
+    cr_assert_stdout_eq_str("one.txt two.txt\n");
+}
+
+Test(e2e, quoted_glob_is_literal, .init = glob_dir)
+{
+    int st = run_script("echo '*'.txt; echo *.none");
+    cr_assert_eq(st, 0);
+    cr_assert_stdout_eq_str("*.txt\n*.none\n");
+}
+
+// Parameter expansion
+Test(e2e, env_parameter, .init = redirect_all)
+{
+    setenv("E2E_NAME", "world", 1);
+    int st = run_script("echo hello $E2E_NAME \"${E2E_NAME}!\"");
+    cr_assert_eq(st, 0);
+    cr_assert_stdout_eq_str("hello world world!\n");
+}
+
+Test(e2e, last_status_parameter, .init = redirect_all)
+{
+    int st = run_script("false; echo $?; echo $?");
+    cr_assert_eq(st, 0);
+    cr_assert_stdout_eq_str("1\n0\n");
+}
+
+Test(e2e, field_splitting, .init = redirect_all)
+{
+    setenv("E2E_LIST", "  a   b\tc ", 1);
+    int st = run_script("echo [$E2E_LIST] \"[$E2E_LIST]\"");
+    cr_assert_eq(st, 0);
+    cr_assert_stdout_eq_str("[ a b c ] [  a   b\tc ]\n");
+}
+
+Test(e2e, field_splitting_custom_ifs, .init = redirect_all)
+{
+    setenv("IFS", ":", 1);
+    setenv("E2E_PATH", "a::b", 1);
+    int st = run_script("cat /dev/null; echo $E2E_PATH");
+    cr_assert_eq(st, 0);
+    cr_assert_stdout_eq_str("a  b\n");
+}
+
+Test(e2e, unset_parameter_vanishes, .init = redirect_all)
+{
+    unsetenv("E2E_UNSET");
+    int st = run_script("echo a $E2E_UNSET b \"$E2E_UNSET\"c");
+    cr_assert_eq(st, 0);
+    cr_assert_stdout_eq_str("a b c\n");
+}
+
+Test(e2e, spawn_helper_runs_commands, .init = redirect_all)
+{
+    cr_assert_eq(spawn_helper_start(), 0);
+    int st = run_script("echo a | cat | cat; cat /dev/null; sh -c 'exit 3'");
+    cr_assert_eq(st, 3);
+    cr_assert_stdout_eq_str("a\n");
+}
+
+Test(e2e, timeout_builtin, .init = redirect_all)
+{
+    int st = run_script("timeout 0.1 sleep 5; echo $?; timeout 5 sh -c 'exit 4'; echo $?");
+    cr_assert_eq(st, 0);
+    cr_assert_stdout_eq_str("124\n4\n");
+}
+
+// Variables, loops and read
+Test(e2e, assignments, .init = redirect_all)
+{
+    int st = run_script("x=hello; y=\"$x   world\"; echo $y; echo \"$y\"; z=*; echo \"$z\"");
+    cr_assert_eq(st, 0);
+    cr_assert_stdout_eq_str("hello world\nhello   world\n*\n");
+}
+
+Test(e2e, prefix_assignment_is_temporary, .init = redirect_all)
+{
+    unsetenv("E2E_TMP");
+    int st = run_script("E2E_TMP=42 sh -c 'echo $E2E_TMP'; echo \"[$E2E_TMP]\"");
+    cr_assert_eq(st, 0);
+    cr_assert_stdout_eq_str("42\n[]\n");
+}
+
+Test(e2e, until_loop, .init = redirect_all)
+{
+    int st = run_script("until true; do echo no; done; while false; do echo no; done; echo ok");
+    cr_assert_eq(st, 0);
+    cr_assert_stdout_eq_str("ok\n");
+}
+
+static void write_tmp(char *path, const char *content)
+{
+    int fd = mkstemp(path);
+    cr_assert_geq(fd, 0);
+    cr_assert_eq(write(fd, content, strlen(content)), (ssize_t)strlen(content));
+    close(fd);
+}
+
+Test(e2e, read_loop_splits_fields, .init = redirect_all)
+{
+    char path[] = "/tmp/test_e2e_read_XXXXXX";
+    write_tmp(path, "a b c\n  d\\ e  f  \nlast");
+    char script[256];
+    snprintf(script, sizeof(script),
+             "while read x y; do echo \"[$x][$y]\"; done < %s; echo $?", path);
+    int st = run_script(script);
+    unlink(path);
+    cr_assert_eq(st, 0);
+    cr_assert_stdout_eq_str("[a][b c]\n[d e][f]\n0\n");
+}
+
+Test(e2e, read_raw_and_ifs, .init = redirect_all)
+{
+    char path[] = "/tmp/test_e2e_read_XXXXXX";
+    write_tmp(path, "x\\y:z\nu:v:w\n");
+    char script[256];
+    snprintf(script, sizeof(script),
+             "while IFS=: read -r a b; do echo \"$a|$b\"; done < %s; echo \"[$IFS]\"", path);
+    unsetenv("IFS");
+    int st = run_script(script);
+    unlink(path);
+    cr_assert_eq(st, 0);
+    cr_assert_stdout_eq_str("x\\y|z\nu|v:w\n[]\n");
+}
+
+Test(e2e, read_leaves_rest_of_input, .init = redirect_all)
+{
+    char path[] = "/tmp/test_e2e_read_XXXXXX";
+    write_tmp(path, "one\ntwo\nthree\n");
+    char script[256];
+    snprintf(script, sizeof(script), "while read l; do echo \"<$l>\"; cat; done < %s", path);
+    int st = run_script(script);
+    unlink(path);
+    cr_assert_eq(st, 0);
+    cr_assert_stdout_eq_str("<one>\ntwo\nthree\n");
+}
+
+Test(e2e, printf_builtin, .init = redirect_all)
+{
+    int st = run_script("printf '%s=%03d|%-3s|%.2f|%x|%c|%b\\n' a 7 b 2.5 255 xyz 'x\\ty';"
+                        " printf '%s,' 1 2 3; printf '\\n'");
+    cr_assert_eq(st, 0);
+    cr_assert_stdout_eq_str("a=007|b  |2.50|ff|x|x\ty\n1,2,3,\n");
+}
+
+Test(e2e, printf_format_from_variable, .init = redirect_all)
+{
+    char path[] = "/tmp/test_e2e_printf_XXXXXX";
+    write_tmp(path, "<%s>\\n a\n[%s]\\n b\n");
+    char script[256];
+    snprintf(script, sizeof(script), "while read -r f v; do printf \"$f\" $v; done < %s; printf %%d x",
+             path);
+    int st = run_script(script);
+    unlink(path);
+    cr_assert_eq(st, 1);
+    cr_assert_stdout_eq_str("<a>\n[b]\n0");
+}
+
+Test(e2e, test_builtin, .init = redirect_all)
+{
+    int st = run_script(
+        "[ -d /tmp ]; echo $?; [ -f /tmp ]; echo $?; test -n ''; echo $?; test abc; echo $?;"
+        "[ ! -e /nonexistent ]; echo $?; [ 3 -lt 10 ]; echo $?; [ a = a -a b != b ]; echo $?;"
+        "[ '(' a = b ')' -o '(' 2 -ge 1 ')' ]; echo $?; [ '!' = '!' ]; echo $?;"
+        "[ 1 -eq x ]; echo $?; [ a = a; echo $?");
+    cr_assert_eq(st, 0);
+    cr_assert_stdout_eq_str("0\n1\n1\n0\n0\n0\n1\n0\n0\n2\n2\n");
+}
+
+Test(e2e, final_command_replaces_the_shell)
+{
+    int p[2];
+    cr_assert_eq(pipe(p), 0);
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(p[1], STDOUT_FILENO);
+        close(p[0]);
+        close(p[1]);
+        const char *s = "true; if true; then sh -c 'echo $$'; fi";
+        struct lexer lx;
+        lexer_init_mem(&lx, s, strlen(s));
+        _exit(exec_ast_final(parse_input(&lx)));
+    }
+    close(p[1]);
+    char buf[64] = { 0 };
+    cr_assert_gt(read(p[0], buf, sizeof(buf) - 1), 0);
+    close(p[0]);
+    int ws;
+    waitpid(pid, &ws, 0);
+    cr_assert_eq(WEXITSTATUS(ws), 0);
+
+    // sh ran as the shell's own process
+    char want[32];
+    snprintf(want, sizeof(want), "%d\n", (int)pid);
+    cr_assert_str_eq(buf, want);
+}
+
+Test(e2e, pipeline_stages_exec_directly, .init = redirect_all)
+{
+    int st = run_script("echo x | sh -c 'read l; echo $PPID' | cat");
+    cr_assert_eq(st, 0);
+
+    // the stage's parent is the shell, not an intermediate child
+    char want[32];
+    snprintf(want, sizeof(want), "%d\n", (int)getpid());
+    cr_assert_stdout_eq_str(want);
+}
+
+Test(e2e, quoted_at_keeps_each_argument, .init = redirect_all)
+{
+    char *args[] = { "42sh", "a b", "c", NULL };
+    vars_set_positional(3, args);
+    int st = run_script("printf '<%s>' \"$@\" \"x$@y\"; echo; printf '<%s>' \"$*\"; IFS=:;"
+                        " printf '<%s>' \"$*\"; echo");
+    cr_assert_eq(st, 0);
+    cr_assert_stdout_eq_str("<a b><c><xa b><cy>\n<a b c><a b:c>\n");
+}
+
+Test(e2e, unquoted_at_splits_each_argument, .init = redirect_all)
+{
+    char *args[] = { "42sh", "a b", "c:d", NULL };
+    vars_set_positional(3, args);
+    int st = run_script("printf '<%s>' $@ x$*y; echo; IFS=:; printf '<%s>' $@; echo");
+    cr_assert_eq(st, 0);
+    cr_assert_stdout_eq_str("<a><b><c:d><xa><b><c:dy>\n<a b><c><d>\n");
+}
+
+Test(e2e, pid_is_the_shell_in_subshells, .init = redirect_all)
+{
+    char *args[] = { "42sh", NULL };
+    vars_set_positional(1, args);
+    int st = run_script("(echo $$) | cat; (sh -c 'true'; echo $$)");
+    cr_assert_eq(st, 0);
+    char want[64];
+    snprintf(want, sizeof(want), "%d\n%d\n", (int)getpid(), (int)getpid());
+    cr_assert_stdout_eq_str(want);
+}
+
+Test(e2e, long_pipeline_within_fd_limit, .timeout = 60)
+{
+    struct str script;
+    str_init(&script);
+    str_append(&script, "echo x");
+    for (int i = 1; i < 2000; i++)
+        str_append(&script, " | cat");
+
+    int p[2];
+    cr_assert_eq(pipe(p), 0);
+    pid_t pid = fork();
+    if (pid == 0) {
+        // far below the 2 * 2000 descriptors all pipes at once would need
+        struct rlimit rl = { 256, 256 };
+        setrlimit(RLIMIT_NOFILE, &rl);
+        dup2(p[1], STDOUT_FILENO);
+        close(p[0]);
+        close(p[1]);
+        _exit(run_script(script.buf));
+    }
+    close(p[1]);
+    char buf[16] = { 0 };
+    cr_assert_eq(read(p[0], buf, sizeof(buf) - 1), 2);
+    close(p[0]);
+    int ws;
+    waitpid(pid, &ws, 0);
+    cr_assert_eq(WEXITSTATUS(ws), 0);
+    cr_assert_str_eq(buf, "x\n");
+    str_free(&script);
+}
+
+Test(e2e, signals_reach_every_stage_of_a_long_pipeline)
+{
+    // the slow stages come first, past the pidfds watched at once
+    struct str script;
+    str_init(&script);
+    str_append(&script, "sh -c 'echo up >&3; exec sleep 30' | sleep 30");
+    for (int i = 0; i < 100; i++)
+        str_append(&script, " | true");
+
+    int p[2];
+    cr_assert_eq(pipe(p), 0);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(p[0]);
+        dup2(p[1], 3);
+        _exit(run_script(script.buf));
+    }
+    close(p[1]);
+    char buf[8] = { 0 };
+    cr_assert_gt(read(p[0], buf, sizeof(buf) - 1), 0);
+    usleep(300000); // the short stages end and the shell settles on the slow ones
+    time_t sent = time(NULL);
+    kill(pid, SIGTERM);
+
+    int ws;
+    waitpid(pid, &ws, 0);
+    cr_assert(WIFSIGNALED(ws) && WTERMSIG(ws) == SIGTERM);
+    cr_assert_lt(time(NULL) - sent, 10, "the shell waited out the sleeps");
+    // the sleeps got it too: nothing holds the pipe open any more
+    cr_assert_eq(read(p[0], buf, sizeof(buf)), 0);
+    close(p[0]);
+    str_free(&script);
+}
+
+Test(e2e, brace_group_and_subshell, .init = redirect_all)
+{
+    char path[] = "/tmp/42sh_group_XXXXXX";
+    write_tmp(path, "");
+    char script[512];
+    snprintf(script, sizeof(script),
+             "{ echo a; echo b; } > %s\n"
+             "{ echo c\n} >> %s; cat %s\n"
+             "x=1; (x=2; echo in $x); echo out $x\n"
+             "(echo s1; echo s2) | cat; { echo }; }\n",
+             path, path, path);
+    int st = run_script(script);
+    unlink(path);
+    cr_assert_eq(st, 0);
+    cr_assert_stdout_eq_str("a\nb\nc\nin 2\nout 1\ns1\ns2\n}\n");
+}
+
+Test(e2e, builtin_redirection_keeps_assignments, .init = redirect_all)
+{
+    char path[] = "/tmp/42sh_read_XXXXXX";
+    write_tmp(path, "a:b\n");
+    char script[256];
+    snprintf(script, sizeof(script), "IFS=: read p q < %s; echo $p $q; echo err >&2 2>/dev/null",
+             path);
+    int st = run_script(script);
+    unlink(path);
+    cr_assert_eq(st, 0);
+    cr_assert_stdout_eq_str("a b\n");
+}
+
+Test(e2e, builtin_subshell_restores_variables, .init = redirect_all)
+{
+    char path[] = "/tmp/42sh_sub_XXXXXX";
+    write_tmp(path, "line\n");
+    setenv("SUB_VAR", "outer", 1);
+    char script[512];
+    snprintf(script, sizeof(script),
+             "x=1\n"
+             "(x=2; SUB_VAR=inner; (x=3; echo deep $x); read y < %s; echo in $x $y $SUB_VAR)\n"
+             "echo out $x $y $SUB_VAR\n"
+             "(SUB_VAR=gone); sh -c 'echo env $SUB_VAR'\n",
+             path);
+    int st = run_script(script);
+    unlink(path);
+    cr_assert_eq(st, 0);
+    cr_assert_str_eq(getenv("SUB_VAR"), "outer");
+    cr_assert_stdout_eq_str("deep 3\nin 2 line inner\nout 1 outer\nenv outer\n");
+}
+
+static void write_exec(const char *dir, const char *name, const char *content)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0755);
+    cr_assert_geq(fd, 0);
+    cr_assert_eq(write(fd, content, strlen(content)), (ssize_t)strlen(content));
+    close(fd);
+}
+
+static void remove_dir(const char *dir, const char *name)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    unlink(path);
+    rmdir(dir);
+}
+
+Test(e2e, bound_command_follows_path_changes, .init = redirect_all)
+{
+    char a[] = "/tmp/42sh_bind_a_XXXXXX", b[] = "/tmp/42sh_bind_b_XXXXXX";
+    cr_assert_not_null(mkdtemp(a));
+    cr_assert_not_null(mkdtemp(b));
+    write_exec(a, "hi", "#!/bin/sh\necho a\n");
+    write_exec(b, "hi", "#!/bin/sh\necho b\n");
+    char list[] = "/tmp/42sh_bind_list_XXXXXX";
+    char lines[256];
+    snprintf(lines, sizeof(lines), "%s\n%s\n%s\n%s\n", a, a, b, b);
+    write_tmp(list, lines);
+    char *saved = strdup(getenv("PATH"));
+
+    char script[256];
+    snprintf(script, sizeof(script), "while read d; do PATH=$d; hi; done < %s\n", list);
+    FILE *f = fmemopen(script, strlen(script), "r");
+    struct lexer lx;
+    lexer_init(&lx, f);
+    struct ast *root = parse_input(&lx);
+    int st = exec_ast(root);
+    setenv("PATH", saved, 1);
+
+    // the loop body kept the path the table gave it last
+    struct ast *loop = root->as.list.items[0];
+    if (loop->type == AST_REDIRECT)
+        loop = loop->as.redirect.body;
+    struct ast *body = loop->as.whilenode.body;
+    struct ast_simple *hi = &body->as.list.items[1]->as.simple;
+    char want[256];
+    snprintf(want, sizeof(want), "%s/hi", b);
+    cr_assert_str_eq(hi->path, want);
+
+    ast_free(root);
+    fclose(f);
+    free(saved);
+    unlink(list);
+    remove_dir(a, "hi");
+    remove_dir(b, "hi");
+    cr_assert_eq(st, 0);
+    cr_assert_stdout_eq_str("a\na\nb\nb\n");
+}
+
+Test(e2e, bound_command_uses_an_assigned_path, .init = redirect_all)
+{
+    char a[] = "/tmp/42sh_bind_a_XXXXXX", b[] = "/tmp/42sh_bind_b_XXXXXX";
+    cr_assert_not_null(mkdtemp(a));
+    cr_assert_not_null(mkdtemp(b));
+    write_exec(a, "hi", "#!/bin/sh\necho a\n");
+    write_exec(b, "hi", "#!/bin/sh\necho b\n");
+    char *saved = strdup(getenv("PATH"));
+    char path[512];
+    snprintf(path, sizeof(path), "%s:%s", a, saved);
+    setenv("PATH", path, 1);
+
+    char list[] = "/tmp/42sh_bind_list_XXXXXX";
+    write_tmp(list, "1\n2\n3\n");
+    char script[512];
+    snprintf(script, sizeof(script), "while read n; do PATH=%s:/usr/bin:/bin hi; done < %s\n", b,
+             list);
+    int st = run_script(script);
+    setenv("PATH", saved, 1);
+    free(saved);
+    unlink(list);
+    remove_dir(a, "hi");
+    remove_dir(b, "hi");
+    cr_assert_eq(st, 0);
+    cr_assert_stdout_eq_str("b\nb\nb\n");
+}
+
+Test(e2e, bound_command_sees_new_executables, .init = redirect_all)
+{
+    char a[] = "/tmp/42sh_bind_a_XXXXXX", b[] = "/tmp/42sh_bind_b_XXXXXX";
+    cr_assert_not_null(mkdtemp(a));
+    cr_assert_not_null(mkdtemp(b));
+    write_exec(b, "hi", "#!/bin/sh\necho b\n");
+    char *saved = strdup(getenv("PATH"));
+    char path[512];
+    snprintf(path, sizeof(path), "%s:%s:%s", a, b, saved);
+    setenv("PATH", path, 1);
+
+    // a copy earlier in $PATH takes over from the third run on
+    char list[] = "/tmp/42sh_bind_list_XXXXXX";
+    write_tmp(list, "1\n2\n3\n4\n");
+    char script[512];
+    snprintf(script, sizeof(script),
+             "while read n; do hi; if [ $n = 2 ]; then echo 'echo a' > %s/hi; chmod +x %s/hi; fi;"
+             " done < %s\n",
+             a, a, list);
+    int st = run_script(script);
+    setenv("PATH", saved, 1);
+    free(saved);
+    unlink(list);
+    remove_dir(a, "hi");
+    remove_dir(b, "hi");
+    cr_assert_eq(st, 0);
+    cr_assert_stdout_eq_str("b\nb\na\na\n");
+}
+
+static void remove_cache(const char *dir)
+{
+    char cmd[256];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    cr_assert_eq(system(cmd), 0);
+}
+
+Test(e2e, memo_replays_output_and_status, .init = redirect_all)
+{
+    char dir[] = "/tmp/42sh_memo_XXXXXX";
+    cr_assert_not_null(mkdtemp(dir));
+    char count[] = "/tmp/42sh_memo_runs_XXXXXX";
+    write_tmp(count, "");
+    char script[1024];
+    snprintf(script, sizeof(script),
+             "MEMO_DIR=%s/cache\n"
+             "memo sh -c 'echo run >> %s; echo out; echo err >&2; exit 3' 2>&1; echo $?\n"
+             "memo sh -c 'echo run >> %s; echo out; echo err >&2; exit 3' 2>&1; echo $?\n"
+             "memo sh -c 'echo run >> %s; echo other'\n"
+             "cat %s\n",
+             dir, count, count, count, count);
+    int st = run_script(script);
+    unlink(count);
+    remove_cache(dir);
+    cr_assert_eq(st, 0);
+    cr_assert_stdout_eq_str("out\nerr\n3\nout\nerr\n3\nother\nrun\nrun\n");
+}
+
+Test(e2e, memo_reruns_when_a_dependency_changes, .init = redirect_all)
+{
+    char dir[] = "/tmp/42sh_memo_XXXXXX";
+    cr_assert_not_null(mkdtemp(dir));
+    char dep[] = "/tmp/42sh_memo_dep_XXXXXX";
+    write_tmp(dep, "one\n");
+    char script[1024];
+    snprintf(script, sizeof(script),
+             "MEMO_DIR=%s\n"
+             "memo --deps %s -- cat %s\n"
+             "echo two >> %s\n"
+             "memo --deps %s -- cat %s\n"
+             "memo --deps %s -- cat %s\n",
+             dir, dep, dep, dep, dep, dep, dep, dep);
+    int st = run_script(script);
+    unlink(dep);
+    remove_cache(dir);
+    cr_assert_eq(st, 0);
+    cr_assert_stdout_eq_str("one\none\ntwo\none\ntwo\n");
+}
+
+/* Size of the one entry in a memo cache */
+static long entry_size(const char *dir)
+{
+    DIR *d = opendir(dir);
+    cr_assert_not_null(d);
+    struct dirent *de;
+    struct stat st;
+    long size = -1;
+    while ((de = readdir(d)))
+        if (de->d_name[0] != '.' && fstatat(dirfd(d), de->d_name, &st, 0) == 0)
+            size = st.st_size;
+    closedir(d);
+    return size;
+}
+
+Test(e2e, memo_evicts_least_recently_used, .init = redirect_all)
+{
+    char dir[] = "/tmp/42sh_memo_XXXXXX";
+    cr_assert_not_null(mkdtemp(dir));
+    char count[] = "/tmp/42sh_memo_runs_XXXXXX";
+    write_tmp(count, "");
+    char script[1024];
+    snprintf(script, sizeof(script), "MEMO_DIR=%s; memo sh -c 'echo a >> %s'\n", dir, count);
+    cr_assert_eq(run_script(script), 0);
+
+    // room for two entries of the same size: b pushes out c, which a did not use
+    snprintf(script, sizeof(script),
+             "MEMO_MAX=%ld\n"
+             "memo sh -c 'echo b >> %s'; memo sh -c 'echo a >> %s'\n"
+             "memo sh -c 'echo c >> %s'; memo sh -c 'echo a >> %s'\n"
+             "memo sh -c 'echo b >> %s'; memo sh -c 'echo a >> %s'\n"
+             "cat %s\n",
+             entry_size(dir) * 5 / 2, count, count, count, count, count, count, count);
+    int st = run_script(script);
+    unlink(count);
+    remove_cache(dir);
+    cr_assert_eq(st, 0);
+    cr_assert_stdout_eq_str("a\nb\nc\nb\n");
+}
+
+#ifdef SHELL_STATS
+Test(e2e, builtin_subshell_does_not_fork, .init = redirect_all)
+{
+    stats_enable();
+    int st = run_script("x=1; (x=2; if [ $x = 2 ]; then echo $x; fi); echo $x");
+    cr_assert_eq(st, 0);
+    cr_assert_stdout_eq_str("2\n1\n");
+
+    char buf[4096];
+    FILE *f = fmemopen(buf, sizeof(buf), "w");
+    stats_dump(f);
+    fclose(f);
+    cr_assert_null(strstr(buf, "\"fork\""));
+}
+#endif
+
+#ifdef SHELL_STATS
+Test(e2e, group_redirection_opens_once, .init = redirect_all)
+{
+    char path[] = "/tmp/42sh_once_XXXXXX";
+    write_tmp(path, "");
+    char script[256];
+    snprintf(script, sizeof(script), "{ echo a; echo b; printf c; } > %s", path);
+    stats_enable();
+    int st = run_script(script);
+    unlink(path);
+    cr_assert_eq(st, 0);
+
+    char buf[4096];
+    FILE *f = fmemopen(buf, sizeof(buf), "w");
+    stats_dump(f);
+    fclose(f);
+    cr_assert_not_null(strstr(buf, "\"open\": 1"));
+    cr_assert_null(strstr(buf, "\"fork\""));
+}
+#endif
+
+/* fd now reads from (O_RDONLY) or writes to a new temporary file, whose path goes in path */
+static void file_on_fd(int fd, char *path, const char *text)
+{
+    int f = mkstemp(path);
+    cr_assert_geq(f, 0);
+    if (text)
+        cr_assert_eq(write(f, text, strlen(text)), (ssize_t)strlen(text));
+    lseek(f, 0, SEEK_SET);
+    dup2(f, fd);
+    close(f);
+}
+
+static void slurp(const char *path, char *buf, size_t size)
+{
+    FILE *f = fopen(path, "r");
+    cr_assert_not_null(f);
+    size_t n = fread(buf, 1, size - 1, f);
+    buf[n] = '\0';
+    fclose(f);
+    unlink(path);
+}
+
+Test(e2e, interactive_command_goes_on_at_ps2)
+{
+    // typed at the prompt; edit_line reads plain lines off a file
+    char in[] = "/tmp/42sh_tty_in_XXXXXX";
+    char out[] = "/tmp/42sh_tty_out_XXXXXX";
+    char err[] = "/tmp/42sh_tty_err_XXXXXX";
+    file_on_fd(STDIN_FILENO, in, "if true; then\necho a |\ncat\nfi\necho \"b\nc\"\n");
+    unlink(in);
+    file_on_fd(STDOUT_FILENO, out, NULL);
+    file_on_fd(STDERR_FILENO, err, NULL);
+
+    struct edit_prompt prompt = { "$ ", "> ", 0 };
+    struct lexer lx;
+    lexer_init_refill(&lx, edit_refill, &prompt);
+    int eof = 0, commands = 0;
+    while (!eof) {
+        prompt.continued = 0;
+        struct ast *root = parse_line(&lx, &eof);
+        lexer_forget(&lx);
+        if (root) {
+            exec_ast(root);
+            ast_free(root);
+            commands++;
+        }
+    }
+    lexer_destroy(&lx);
+    fflush(stdout);
+    fflush(stderr);
+
+    char buf[256];
+    cr_assert_eq(commands, 2);
+    slurp(out, buf, sizeof(buf));
+    cr_assert_str_eq(buf, "a\nb\nc\n");
+    slurp(err, buf, sizeof(buf));
+    cr_assert_str_eq(buf, "$ > > > $ > $ ");
+}
+
+#ifdef SHELL_STATS
+Test(e2e, test_builtin_does_not_fork, .init = redirect_all)
+{
+    stats_enable();
+    int st = run_script("if [ -d /tmp ]; then test -r /tmp -a -x /tmp; fi");
+    cr_assert_eq(st, 0);
+
+    char buf[4096];
+    FILE *f = fmemopen(buf, sizeof(buf), "w");
+    stats_dump(f);
+    fclose(f);
+    cr_assert_null(strstr(buf, "\"fork\""));
+}
+#endif
+
+#ifdef SHELL_STATS
+Test(e2e, stats_count_forks, .init = redirect_all)
+{
+    stats_enable();
+    run_script("echo a; true | cat");
+
+    char buf[4096];
+    FILE *f = fmemopen(buf, sizeof(buf), "w");
+    stats_dump(f);
+    fclose(f);
+    cr_assert_not_null(strstr(buf, "\"executer\": {\"fork\": "));
+    cr_assert_not_null(strstr(buf, "\"pipe\": 1"));
+    cr_assert_not_null(strstr(buf, "\"peak_heap_bytes\""));
+}
+#endif
@@ -5,8 +5,11 @@
 #include <unistd.h>
 #include <fcntl.h>
 
+#include "lexer/lexer.h"
+#include "parser/parser.h"
 #include "parser/ast.h"
 #include "executer/executer.h"
+#include "executer/optimize.h"
 
 static char **make_argv(const char *a, const char *b)
 {
@@ -137,3 +140,57 @@ Test(executer, if_branch_taken)
 
     ast_free(ifn);
 }
+
+static struct ast *parse_optimized(const char *s)
+{
+    struct lexer lx;
+    lexer_init_mem(&lx, s, strlen(s));
+    struct ast *root = parse_input(&lx);
+    lexer_destroy(&lx);
+    return optimize_ast(root);
+}
+
+Test(executer, optimize_folds_constant_if)
+{
+    struct ast *n = parse_optimized("if false; then echo a; elif [ x = y ]; then echo b;"
+                                    " elif test 1 -lt 2; then echo c; else echo d; fi");
+    cr_assert_eq(n->type, AST_SIMPLE);
+    cr_assert_str_eq(n->as.simple.argv[1], "c");
+    cr_assert(n->as.simple.frozen);
+    cr_assert_gt(n->as.simple.builtin, 0);
+    ast_free(n);
+
+    n = parse_optimized("while false; do echo x; done; until true; do echo y; done");
+    cr_assert_eq(n->type, AST_SIMPLE);
+    cr_assert_str_eq(n->as.simple.argv[0], "true");
+    ast_free(n);
+}
+
+Test(executer, optimize_keeps_what_depends_on_the_system)
+{
+    struct ast *n = parse_optimized("if [ -d /tmp ]; then echo a; elif true; then echo b;"
+                                    " elif x; then echo c; fi");
+    cr_assert_eq(n->type, AST_IF);
+    cr_assert_eq(n->as.ifnode.elif_len, 0); // b is always taken after the first arm
+    cr_assert_not_null(n->as.ifnode.else_branch);
+    ast_free(n);
+
+    n = parse_optimized("if false; then :; else echo $?; fi");
+    cr_assert_eq(n->type, AST_IF);
+    ast_free(n);
+
+    n = parse_optimized("ls /");
+    cr_assert_eq(n->as.simple.builtin, -1);
+    ast_free(n);
+}
+
+Test(executer, optimize_keeps_status_for_next_command, .init = cr_redirect_stdout)
+{
+    struct ast *n = parse_optimized("true; [ a = a ]; false; echo $?");
+    cr_assert_eq(n->type, AST_LIST);
+    cr_assert_eq(n->as.list.len, 2);
+    cr_assert_eq(exec_ast(n), 0);
+    fflush(stdout);
+    cr_assert_stdout_eq_str("1\n");
+    ast_free(n);
+}
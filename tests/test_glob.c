@@ -0,0 +1,115 @@
+#include <criterion/criterion.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "expand/glob.h"
+#include "util/vec.h"
+
+static void touch(const char *path)
+{
+    FILE *f = fopen(path, "w");
+    cr_assert_not_null(f);
+    fclose(f);
+}
+
+// creates a scratch tree and makes it the current directory
+static void setup_tree(void)
+{
+    char dir[] = "/tmp/test_glob_XXXXXX";
+    cr_assert_not_null(mkdtemp(dir));
+    cr_assert_eq(chdir(dir), 0);
+
+    touch("a.c");
+    touch("b.c");
+    touch("main.h");
+    touch(".hidden.c");
+    mkdir("sub", 0755);
+    touch("sub/x.log");
+    touch("sub/y.log");
+    mkdir("sub2", 0755);
+    touch("sub2/z.log");
+}
+
+static struct vec run_glob(const char *pattern)
+{
+    struct vec out;
+    vec_init(&out);
+    struct glob_pat *p = glob_compile(pattern);
+    glob_expand(p, &out);
+    glob_free(p);
+    return out;
+}
+
+Test(glob, star_suffix, .init = setup_tree)
+{
+    struct vec out = run_glob("*.c");
+    cr_assert_eq(out.len, 2);
+    cr_assert_str_eq(vec_get(&out, 0), "a.c");
+    cr_assert_str_eq(vec_get(&out, 1), "b.c");
+}
+
+Test(glob, hidden_files_need_explicit_dot, .init = setup_tree)
+{
+    struct vec out = run_glob(".*.c");
+    cr_assert_eq(out.len, 1);
+    cr_assert_str_eq(vec_get(&out, 0), ".hidden.c");
+}
+
+Test(glob, question_and_bracket, .init = setup_tree)
+{
+    struct vec out = run_glob("[ab].?");
+    cr_assert_eq(out.len, 2);
+
+    out = run_glob("[!a].c");
+    cr_assert_eq(out.len, 1);
+    cr_assert_str_eq(vec_get(&out, 0), "b.c");
+}
+
+Test(glob, multiple_components, .init = setup_tree)
+{
+    struct vec out = run_glob("sub*/*.log");
+    cr_assert_eq(out.len, 3);
+    cr_assert_str_eq(vec_get(&out, 0), "sub/x.log");
+    cr_assert_str_eq(vec_get(&out, 2), "sub2/z.log");
+}
+
+Test(glob, literal_components_are_checked, .init = setup_tree)
+{
+    struct vec out = run_glob("sub*/x.log");
+    cr_assert_eq(out.len, 1);
+    cr_assert_str_eq(vec_get(&out, 0), "sub/x.log");
+}
+
+Test(glob, trailing_slash_matches_dirs_only, .init = setup_tree)
+{
+    struct vec out = run_glob("*/");
+    cr_assert_eq(out.len, 2);
+    cr_assert_str_eq(vec_get(&out, 0), "sub/");
+}
+
+Test(glob, escaped_metachar_is_literal, .init = setup_tree)
+{
+    touch("*.c");
+    struct vec out = run_glob("\\*.c");
+    cr_assert_eq(out.len, 1);
+    cr_assert_str_eq(vec_get(&out, 0), "*.c");
+}
+
+Test(glob, no_match, .init = setup_tree)
+{
+    struct vec out = run_glob("*.rs");
+    cr_assert_eq(out.len, 0);
+}
+
+Test(glob, cache_sees_new_entries, .init = setup_tree)
+{
+    struct vec out = run_glob("*.c");
+    cr_assert_eq(out.len, 2);
+
+    touch("c.c");
+    out = run_glob("*.c");
+    cr_assert_eq(out.len, 3);
+}
@@ -0,0 +1,123 @@
+#include <criterion/criterion.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "history/history.h"
+
+static char path[64];
+
+static void open_history(void)
+{
+    snprintf(path, sizeof(path), "/tmp/test_history_%d", (int)getpid());
+    unlink(path);
+    cr_assert_eq(history_open(path), 0);
+}
+
+static void close_history(void)
+{
+    history_close();
+    unlink(path);
+}
+
+static void add(const char *s)
+{
+    cr_assert_eq(history_add(s, strlen(s)), 0);
+}
+
+static int entry_is(const char *e, const size_t *len, const char *want)
+{
+    return e && *len == strlen(want) && memcmp(e, want, *len) == 0;
+}
+
+Test(history, prev_and_next_walk_entries, .init = open_history, .fini = close_history)
+{
+    add("echo one");
+    add("   ");
+    add("echo two\n");
+    add("echo three");
+
+    size_t pos = HISTORY_END, len;
+    cr_assert(entry_is(history_prev(&pos, &len), &len, "echo three"));
+    cr_assert(entry_is(history_prev(&pos, &len), &len, "echo two"));
+    cr_assert(entry_is(history_prev(&pos, &len), &len, "echo one"));
+    cr_assert_null(history_prev(&pos, &len));
+    cr_assert(entry_is(history_next(&pos, &len), &len, "echo two"));
+    cr_assert(entry_is(history_next(&pos, &len), &len, "echo three"));
+    cr_assert_null(history_next(&pos, &len));
+    cr_assert_eq(pos, HISTORY_END);
+}
+
+Test(history, search_finds_newest_first, .init = open_history, .fini = close_history)
+{
+    add("make test");
+    add("ls -l");
+    add("make install");
+    add("git status");
+
+    size_t pos = HISTORY_END, len;
+    cr_assert(entry_is(history_search("make", 4, &pos, &len), &len, "make install"));
+    cr_assert(entry_is(history_search("make", 4, &pos, &len), &len, "make test"));
+    cr_assert_null(history_search("make", 4, &pos, &len));
+
+    pos = HISTORY_END;
+    cr_assert(entry_is(history_search("s -", 3, &pos, &len), &len, "ls -l"));
+}
+
+// enough entries for many blocks, so filtered blocks are skipped
+Test(history, search_across_indexed_blocks, .init = open_history, .fini = close_history)
+{
+    char line[64];
+    for (int i = 0; i < 20000; i++) {
+        snprintf(line, sizeof(line), "echo entry number %d", i);
+        add(line);
+    }
+    add("needle in the haystack");
+    for (int i = 0; i < 20000; i++) {
+        snprintf(line, sizeof(line), "printf item %d", i);
+        add(line);
+    }
+
+    for (int round = 0; round < 2; round++) {
+        size_t pos = HISTORY_END, len;
+        cr_assert(entry_is(history_search("needle", 6, &pos, &len), &len,
+                           "needle in the haystack"));
+        cr_assert_null(history_search("needle", 6, &pos, &len));
+        pos = HISTORY_END;
+        cr_assert(entry_is(history_search("number 17", 9, &pos, &len), &len,
+                           "echo entry number 17999"));
+    }
+}
+
+Test(history, concurrent_sessions_keep_whole_lines, .init = open_history, .fini = close_history)
+{
+    pid_t pids[4];
+    for (int c = 0; c < 4; c++) {
+        pids[c] = fork();
+        if (pids[c] == 0) {
+            char line[64];
+            for (int i = 0; i < 500; i++) {
+                snprintf(line, sizeof(line), "session %d command %d", c, i);
+                history_add(line, strlen(line));
+            }
+            _exit(0);
+        }
+    }
+    for (int c = 0; c < 4; c++)
+        waitpid(pids[c], NULL, 0);
+
+    size_t pos = HISTORY_END, len;
+    int n = 0, s, i;
+    const char *e;
+    while ((e = history_prev(&pos, &len))) {
+        char buf[64];
+        cr_assert_lt(len, sizeof(buf));
+        memcpy(buf, e, len);
+        buf[len] = '\0';
+        cr_assert_eq(sscanf(buf, "session %d command %d", &s, &i), 2, "torn entry: %s", buf);
+        n++;
+    }
+    cr_assert_eq(n, 2000);
+}
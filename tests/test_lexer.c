@@ -218,4 +218,155 @@ Test(lexer_redirections, number_without_redir_is_word)
     cr_assert_eq(t2.type, TOK_WORD);
     cr_assert_str_eq(t2.value, "42");
     cr_assert_eq(t3.type, TOK_WORD);
-}
\ No newline at end of file
+}
+// Word templates
+Test(lexer_words, plain_word_has_no_template)
+{
+    struct lexer lx = make_lexer("echo");
+
+    struct token tok = lexer_next(&lx);
+
+    cr_assert_null(tok.word);
+}
+
+Test(lexer_words, param_segments_keep_quote_state)
+{
+    struct lexer lx = make_lexer("a$HOME\"${x}b\"");
+
+    struct token tok = lexer_next(&lx);
+
+    cr_assert_eq(tok.type, TOK_WORD);
+    cr_assert_not_null(tok.word);
+    cr_assert(tok.word->has_param);
+    cr_assert_eq(tok.word->nsegs, 5);
+    cr_assert_eq(tok.word->segs[1].type, SEG_PARAM);
+    cr_assert_eq(tok.word->segs[1].quoted, 0);
+    cr_assert_eq(tok.word->segs[3].type, SEG_PARAM);
+    cr_assert_eq(tok.word->segs[3].quoted, 1);
+    cr_assert_eq(tok.word->segs[4].quoted, 1);
+}
+
+Test(lexer_words, double_quotes_are_single_token)
+{
+    struct lexer lx = make_lexer("echo \"hello \\\"world\\\"\"");
+
+    struct token t1 = lexer_next(&lx);
+    struct token t2 = lexer_next(&lx);
+
+    cr_assert_str_eq(t1.value, "echo");
+    cr_assert_str_eq(t2.value, "hello \"world\"");
+}
+
+// Words own their text; reserved words are the interned keyword
+Test(lexer_words, words_own_their_text)
+{
+    struct lexer lx = make_lexer("if echo a; then echo 'if'; fi");
+
+    struct token t1 = lexer_next(&lx);
+    struct token t2 = lexer_next(&lx);
+    lexer_next(&lx);
+    lexer_next(&lx);
+    struct token t3 = lexer_next(&lx);
+    struct token t4 = lexer_next(&lx);
+    struct token t5 = lexer_next(&lx);
+
+    cr_assert_eq(t1.type, TOK_IF);
+    cr_assert_eq(t3.type, TOK_THEN);
+    cr_assert_str_eq(t2.value, "echo");
+    cr_assert_str_eq(t4.value, "echo");
+    cr_assert_neq(t2.value, t4.value);
+    // quoted, it is only a word
+    cr_assert_eq(t5.type, TOK_WORD);
+    cr_assert_str_eq(t5.value, "if");
+    token_free(&t2);
+    token_free(&t4);
+    token_free(&t5);
+    lexer_destroy(&lx);
+}
+
+Test(lexer_words, plain_word_span)
+{
+    struct lexer lx = make_lexer("  ls -la");
+
+    struct token t1 = lexer_next(&lx);
+    struct token t2 = lexer_next(&lx);
+
+    cr_assert_eq(t1.off, 2);
+    cr_assert_eq(t1.len, 2);
+    cr_assert_eq(t2.off, 5);
+    cr_assert_eq(t2.len, 3);
+}
+
+Test(lexer_words, digits_starting_a_word)
+{
+    struct lexer lx = make_lexer("sleep 0.5 2>x");
+
+    struct token t1 = lexer_next(&lx);
+    struct token t2 = lexer_next(&lx);
+    struct token t3 = lexer_next(&lx);
+
+    cr_assert_str_eq(t1.value, "sleep");
+    cr_assert_eq(t2.type, TOK_WORD);
+    cr_assert_str_eq(t2.value, "0.5");
+    cr_assert_eq(t3.type, TOK_IONUMBER);
+}
+
+Test(lexer_words, long_words_with_specials_past_a_block)
+{
+    // specials at every offset of a 32-byte stride land in the slow path
+    char in[128];
+    for (int at = 0; at < 40; at++) {
+        memset(in, 'a', sizeof(in));
+        in[at] = '*';
+        in[60] = '\0';
+        struct lexer lx = make_lexer(in);
+        struct token t = lexer_next(&lx);
+        cr_assert_eq(t.type, TOK_WORD);
+        cr_assert_eq(strlen(t.value), 60);
+        cr_assert_not_null(t.word, "glob at %d", at);
+        token_free(&t);
+        lexer_destroy(&lx);
+    }
+}
+
+Test(lexer_words, every_byte_class)
+{
+    // only the breaks end the word: the others are kept or cooked
+    for (int c = 1; c < 256; c++) {
+        char in[80];
+        memset(in, 'x', 70);
+        in[35] = (char)c;
+        in[70] = '\0';
+        int brk = strchr(" \t\n;<>|()", c) != NULL;
+        int cooked = strchr("'\"$", c) != NULL;
+        if (cooked)
+            continue;
+        struct lexer lx = make_lexer(in);
+        struct token t = lexer_next(&lx);
+        cr_assert_eq(t.type, TOK_WORD);
+        cr_assert_eq(strlen(t.value), brk ? 35 : 70, "byte %d", c);
+        token_free(&t);
+        lexer_destroy(&lx);
+    }
+}
+
+Test(lexer_position, counted_from_offsets)
+{
+    struct lexer lx = make_lexer("echo a\n\nfoo  bar\n");
+    struct token t;
+    int line, col;
+    for (int i = 0; i < 5; i++)
+        t = lexer_next(&lx);
+    cr_assert_str_eq(t.value, "foo");
+    lexer_position(&lx, t.at, &line, &col);
+    cr_assert_eq(line, 3);
+    cr_assert_eq(col, 0);
+    t = lexer_next(&lx);
+    lexer_position(&lx, t.at, &line, &col);
+    cr_assert_eq(line, 3);
+    cr_assert_eq(col, 5);
+    // going back restarts the count
+    lexer_position(&lx, 2, &line, &col);
+    cr_assert_eq(line, 1);
+    cr_assert_eq(col, 2);
+}
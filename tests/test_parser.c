@@ -1,10 +1,16 @@
 #include <criterion/criterion.h>
 #include <criterion/redirect.h>
+#include <malloc.h>
+#include <setjmp.h>
 #include <string.h>
+#include <time.h>
 
 #include "lexer/lexer.h"
 #include "parser/parser.h"
 #include "parser/ast.h"
+#include "expand/casetab.h"
+#include "util/error.h"
+#include "util/intern.h"
 
 static struct ast *parse_from_str(const char *s)
 {
@@ -36,6 +42,17 @@ Test(parser, simple_command)
     ast_free(ast);
 }
 
+Test(parser, blank_lines_and_comments_are_empty)
+{
+    cr_assert_null(parse_from_str("\n\n"));
+    cr_assert_null(parse_from_str("# only a comment\n\n"));
+
+    struct ast *ast = parse_from_str("\n\necho hi\n");
+    cr_assert_not_null(ast);
+    cr_assert_eq(ast->as.list.len, 1);
+    ast_free(ast);
+}
+
 Test(parser, list_of_commands)
 {
     struct ast *ast = parse_from_str("echo a; echo b; echo c");
@@ -322,3 +339,325 @@ Test(parser, pipeline_in_list)
 
     ast_free(ast);
 }
+
+Test(parser, while_loop_with_redirection)
+{
+    struct ast *ast = parse_from_str("x=1 y=2 read a b\nwhile read l; do echo $l; done < in");
+
+    struct ast *simple = ast->as.list.items[0];
+    cr_assert_eq(simple->type, AST_SIMPLE);
+    cr_assert_eq(simple->as.simple.assign_len, 2);
+
+    struct ast *redir = ast->as.list.items[1];
+    cr_assert_eq(redir->type, AST_REDIRECT);
+    cr_assert_eq(redir->as.redirect.redir_len, 1);
+    cr_assert_eq(redir->as.redirect.redirs[0].fd, 0);
+    cr_assert_str_eq(redir->as.redirect.redirs[0].target, "in");
+
+    struct ast *loop = redir->as.redirect.body;
+    cr_assert_eq(loop->type, AST_WHILE);
+    cr_assert_eq(loop->as.whilenode.until, 0);
+    cr_assert_eq(loop->as.whilenode.body->type, AST_LIST);
+
+    ast_free(ast);
+}
+
+Test(parser, case_arms)
+{
+    struct ast *ast = parse_from_str("case $x in\n(a|b) echo ab;;\n c*) ;;\n *) echo other\nesac");
+
+    cr_assert_eq(ast->type, AST_LIST);
+    struct ast *node = ast->as.list.items[0];
+    cr_assert_eq(node->type, AST_CASE);
+    struct ast_case *c = &node->as.casenode;
+    cr_assert_not_null(c->subject_word);
+    cr_assert_eq(c->len, 3);
+    cr_assert_eq(c->npatterns, 4);
+    cr_assert_eq(c->patterns[1].arm, 0);
+    cr_assert_eq(c->patterns[2].arm, 1);
+    cr_assert_null(c->bodies[1]);
+    cr_assert_not_null(c->bodies[2]);
+
+    // a and b are looked up, c* and * are matched in order
+    cr_assert_eq(c->ndynamic, 2);
+    cr_assert_eq(case_index_find(c->index, "b", 1), 0);
+    cr_assert_eq(case_index_find(c->index, "c", 1), -1);
+
+    ast_free(ast);
+}
+
+Test(parser, case_takes_reserved_words_as_words)
+{
+    struct ast *ast = parse_from_str("case done in\n(if|fi) ;;\n done) echo d;;\nesac");
+
+    struct ast_case *c = &ast->as.list.items[0]->as.casenode;
+    cr_assert_str_eq(c->subject, "done");
+    cr_assert_eq(c->len, 2);
+    cr_assert_eq(c->npatterns, 3);
+    cr_assert_eq(case_index_find(c->index, "fi", 2), 0);
+    cr_assert_eq(case_index_find(c->index, "done", 4), 1);
+
+    ast_free(ast);
+}
+
+Test(parser, only_command_names_are_interned)
+{
+    struct ast *ast = parse_from_str("echo zq_arg >zq_out; x=zq_val echo b");
+
+    struct ast_simple *a = &ast->as.list.items[0]->as.simple;
+    struct ast_simple *b = &ast->as.list.items[1]->as.simple;
+    cr_assert_eq(a->argv[0], b->argv[1]);
+    cr_assert_eq(a->argv[0], intern_find("echo", 4));
+    cr_assert_null(intern_find("zq_arg", 6));
+    cr_assert_null(intern_find("zq_out", 6));
+    cr_assert_null(intern_find("x=zq_val", 8));
+
+    ast_free(ast);
+}
+
+Test(parser, group_and_subshell)
+{
+    struct ast *ast = parse_from_str("{ echo a; echo b; } >> out\n(cd /; ls) | cat");
+
+    struct ast *redir = ast->as.list.items[0];
+    cr_assert_eq(redir->type, AST_REDIRECT);
+    cr_assert_eq(redir->as.redirect.redirs[0].type, REDIR_APPEND);
+    cr_assert_eq(redir->as.redirect.body->type, AST_LIST);
+    cr_assert_eq(redir->as.redirect.body->as.list.len, 2);
+
+    struct ast *pipe = ast->as.list.items[1];
+    cr_assert_eq(pipe->type, AST_PIPELINE);
+    cr_assert_eq(pipe->as.pipeline.commands[0]->type, AST_SUBSHELL);
+
+    ast_free(ast);
+}
+
+Test(parser, syntax_error_unclosed_group, .exit_code = 2)
+{
+    parse_from_str("{ echo a; echo b }");
+}
+
+static int same_tree(const struct ast *a, const struct ast *b)
+{
+    if (!a || !b)
+        return a == b;
+    if (a->type != b->type)
+        return 0;
+    switch (a->type) {
+    case AST_SIMPLE:
+        for (size_t i = 0;; i++) {
+            if (!a->as.simple.argv[i] || !b->as.simple.argv[i]) {
+                return a->as.simple.argv[i] == b->as.simple.argv[i]
+                       && a->as.simple.redir_len == b->as.simple.redir_len;
+            }
+            if (strcmp(a->as.simple.argv[i], b->as.simple.argv[i]) != 0)
+                return 0;
+        }
+    case AST_LIST:
+        if (a->as.list.len != b->as.list.len)
+            return 0;
+        for (size_t i = 0; i < a->as.list.len; i++)
+            if (!same_tree(a->as.list.items[i], b->as.list.items[i]))
+                return 0;
+        return 1;
+    case AST_PIPELINE:
+        if (a->as.pipeline.len != b->as.pipeline.len)
+            return 0;
+        for (size_t i = 0; i < a->as.pipeline.len; i++)
+            if (!same_tree(a->as.pipeline.commands[i], b->as.pipeline.commands[i]))
+                return 0;
+        return 1;
+    case AST_REDIRECT:
+        return same_tree(a->as.redirect.body, b->as.redirect.body);
+    case AST_SUBSHELL:
+        return same_tree(a->as.subshell.body, b->as.subshell.body);
+    default:
+        return 1;
+    }
+}
+
+static const char split_block[] =
+    "echo start 'a\nb' \"c\n;d\" # it's a comment \"\n"
+    "if true; then\n  echo in\nfi\n"
+    "case $x in\n  a) echo a;;\n  (b|c) ( echo sub )\n  ;;\nesac\n"
+    "echo one |\n  cat\n"
+    "( echo x\n  echo y ) > f\n"
+    "while false; do\n  echo done\ndone\n"
+    "{ echo g\n}\n";
+
+Test(parser, split_parse_matches_sequential)
+{
+    struct str text;
+    str_init(&text);
+    while (text.len < (3 << 20))
+        str_append(&text, split_block);
+
+    struct lexer a, b;
+    lexer_init_mem(&a, text.buf, text.len);
+    lexer_init_mem(&b, text.buf, text.len);
+    struct ast *seq = parse_input(&a);
+    struct ast *par = parse_input_split(&b, 4);
+
+    cr_assert_eq(seq->as.list.len, par->as.list.len);
+    cr_assert(same_tree(seq, par));
+    ast_free(seq);
+    ast_free(par);
+    lexer_destroy(&a);
+    lexer_destroy(&b);
+    str_free(&text);
+}
+
+static void keep_error(void *ctx, int line, int col, const char *msg)
+{
+    snprintf(ctx, 128, "%s at %d:%d", msg, line, col);
+}
+
+static void parse_catching(const struct str *text, int threads, char *msg)
+{
+    struct lexer lx;
+    lexer_init_mem(&lx, text->buf, text->len);
+    jmp_buf env;
+    syntax_error_set_reporter(keep_error, msg);
+    if (setjmp(env) == 0) {
+        syntax_error_set_recover(&env);
+        if (threads)
+            parse_input_split(&lx, threads);
+        else
+            parse_input(&lx);
+    }
+    syntax_error_set_recover(NULL);
+    syntax_error_set_reporter(NULL, NULL);
+    lexer_destroy(&lx);
+}
+
+Test(parser, syntax_errors_free_what_was_built)
+{
+    // each fails deep inside nodes, vectors or a word still being built
+    static const char *bad[] = {
+        "if true; then echo \"$x; fi\n",
+        "while a | b >out x=$y c; do echo 'z; done\n",
+        "case $x in a|b*) echo ${; esac\n",
+        "case $x in a) echo a;; $y) echo b;; c\n",
+        "{ echo a; echo b 2>; }\n",
+        "( echo a; if x; then y; elif z; then w; else v; fi ) >o 2>\n",
+        "if a; then b; elif c; then d; fi; echo $e )\n",
+        "for_ever | until a; do b >c\n",
+    };
+    size_t n = sizeof(bad) / sizeof(bad[0]);
+    char msg[128];
+    struct str text;
+    for (int round = 0; round < 2; round++) {
+        // the first round settles the intern table and stdio
+        size_t before = mallinfo2().uordblks;
+        for (size_t i = 0; i < n; i++) {
+            str_init(&text);
+            str_append(&text, bad[i]);
+            msg[0] = '\0';
+            parse_catching(&text, 0, msg);
+            cr_assert_neq(msg[0], '\0', "%s", bad[i]);
+            str_free(&text);
+        }
+        if (round == 1)
+            cr_assert_eq(mallinfo2().uordblks, before);
+    }
+}
+
+Test(parser, split_parse_reports_the_same_error)
+{
+    struct str text;
+    str_init(&text);
+    while (text.len < (3 << 20))
+        str_append(&text, "echo a\n");
+    str_append(&text, "fi\n");
+    while (text.len < (5 << 20))
+        str_append(&text, "echo b\n");
+
+    char seq[128] = "", par[128] = "";
+    parse_catching(&text, 0, seq);
+    parse_catching(&text, 4, par);
+    cr_assert_neq(seq[0], '\0');
+    cr_assert_str_eq(par, seq);
+    str_free(&text);
+}
+
+/* Hands the lexer one line per call, like a pipe read a line at a time */
+struct line_source {
+    const char *text;
+    size_t pos;
+    size_t len;
+    int calls;
+};
+
+static int next_line(void *ctx, struct str *in)
+{
+    struct line_source *src = ctx;
+    src->calls++;
+    if (src->pos >= src->len)
+        return 0;
+    const char *p = src->text + src->pos;
+    const char *nl = memchr(p, '\n', src->len - src->pos);
+    size_t n = nl ? (size_t)(nl - p) + 1 : src->len - src->pos;
+    str_appendn(in, p, n);
+    src->pos += n;
+    return 1;
+}
+
+Test(parser, parse_line_stops_at_the_newline)
+{
+    const char *text = "echo a; echo b\n\nif true\nthen echo c\nfi\n";
+    struct line_source src = { text, 0, strlen(text), 0 };
+    struct lexer lx;
+    lexer_init_refill(&lx, next_line, &src);
+    int eof;
+
+    struct ast *n = parse_line(&lx, &eof);
+    cr_assert_eq(src.calls, 1); // the command runs before the next line is read
+    cr_assert_eq(n->type, AST_LIST);
+    cr_assert_eq(n->as.list.len, 2);
+    ast_free(n);
+    lexer_forget(&lx);
+
+    cr_assert_null(parse_line(&lx, &eof)); // blank line
+    cr_assert_eq(src.calls, 2);
+
+    n = parse_line(&lx, &eof);
+    cr_assert_eq(src.calls, 5);
+    cr_assert_eq(n->as.list.items[0]->type, AST_IF);
+    cr_assert_eq(eof, 0);
+    ast_free(n);
+
+    cr_assert_null(parse_line(&lx, &eof));
+    cr_assert_eq(eof, 1);
+    lexer_destroy(&lx);
+}
+
+Test(parser, large_multi_line_block_is_read_once)
+{
+    struct str text;
+    str_init(&text);
+    str_append(&text, "if true; then\n");
+    for (int i = 0; i < 20000; i++)
+        str_append(&text, "  echo 'a b' \"$x\" >/dev/null\n");
+    str_append(&text, "fi\necho done\n");
+
+    struct line_source src = { text.buf, 0, text.len, 0 };
+    struct lexer lx;
+    lexer_init_refill(&lx, next_line, &src);
+    int eof;
+    clock_t start = clock();
+    struct ast *n = parse_line(&lx, &eof);
+    double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    cr_assert_eq(src.calls, 20002); // each line lexed as it arrives, never again
+    struct ast *body = n->as.list.items[0]->as.ifnode.then_branch;
+    cr_assert_eq(body->as.list.len, 20000);
+    cr_assert_lt(secs, 2.0, "%.2fs: the block is parsed again for each line");
+    ast_free(n);
+    lexer_forget(&lx);
+
+    n = parse_line(&lx, &eof);
+    cr_assert_str_eq(n->as.list.items[0]->as.simple.argv[1], "done");
+    ast_free(n);
+    lexer_destroy(&lx);
+    str_free(&text);
+}
@@ -0,0 +1,116 @@
+#include <criterion/criterion.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "server/server.h"
+
+static char sock[64];
+static pid_t srv;
+
+static void start_server(void)
+{
+    snprintf(sock, sizeof(sock), "/tmp/test_server_%d.sock", (int)getpid());
+    srv = fork();
+    cr_assert_neq(srv, -1);
+    if (srv == 0)
+        _exit(server_run(sock));
+
+    struct stat st;
+    for (int i = 0; i < 200 && stat(sock, &st) < 0; i++)
+        usleep(10000);
+}
+
+static void stop_server(void)
+{
+    kill(srv, SIGTERM);
+    waitpid(srv, NULL, 0);
+    unlink(sock);
+}
+
+// runs s on the server and captures what it writes on stdout
+static int request(const char *s, char *out, size_t cap)
+{
+    int p[2];
+    cr_assert_eq(pipe(p), 0);
+    int fds[3] = { 0, p[1], 2 };
+    char *argv[] = { "test", "one", NULL };
+    int st = client_request(sock, s, strlen(s), 2, argv, fds);
+    close(p[1]);
+
+    ssize_t n = read(p[0], out, cap - 1);
+    out[n > 0 ? n : 0] = '\0';
+    close(p[0]);
+    return st;
+}
+
+Test(server, runs_script_on_client_stdio, .init = start_server, .fini = stop_server)
+{
+    char out[256];
+    int st = request("echo hi $1", out, sizeof(out));
+    cr_assert_eq(st, 0);
+    cr_assert_str_eq(out, "hi one\n");
+}
+
+Test(server, returns_exit_status, .init = start_server, .fini = stop_server)
+{
+    char out[256];
+    cr_assert_eq(request("echo a; false", out, sizeof(out)), 1);
+    cr_assert_str_eq(out, "a\n");
+}
+
+Test(server, survives_syntax_error, .init = start_server, .fini = stop_server)
+{
+    char out[256];
+    cr_assert_eq(request("if then", out, sizeof(out)), 2);
+    cr_assert_eq(request("echo still here", out, sizeof(out)), 0);
+    cr_assert_str_eq(out, "still here\n");
+}
+
+Test(server, socket_is_private, .init = start_server, .fini = stop_server)
+{
+    struct stat st;
+    cr_assert_eq(lstat(sock, &st), 0);
+    cr_assert(S_ISSOCK(st.st_mode));
+    cr_assert_eq(st.st_mode & 077, 0);
+}
+
+Test(server, leaves_other_files_alone)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/test_server_file_%d", (int)getpid());
+    FILE *f = fopen(path, "w");
+    cr_assert_not_null(f);
+    fclose(f);
+    cr_assert_eq(server_run(path), 1);
+    struct stat st;
+    cr_assert_eq(lstat(path, &st), 0);
+    cr_assert(S_ISREG(st.st_mode));
+    unlink(path);
+}
+
+Test(server, replaces_a_spare_that_dies, .init = start_server, .fini = stop_server, .timeout = 10)
+{
+    // with no request in flight the only child is the spare in accept()
+    char path[64], buf[64] = { 0 };
+    snprintf(path, sizeof(path), "/proc/%d/task/%d/children", (int)srv, (int)srv);
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return; // no children list in this kernel
+    cr_assert_not_null(fgets(buf, sizeof(buf), f));
+    fclose(f);
+    pid_t spare = (pid_t)atoi(buf);
+    cr_assert_gt(spare, 0);
+    cr_assert_eq(kill(spare, SIGKILL), 0);
+    // a connection made before it is gone could still be taken by the dying spare
+    while (kill(spare, 0) == 0)
+        usleep(1000);
+
+    char out[256];
+    cr_assert_eq(request("echo back", out, sizeof(out)), 0);
+    cr_assert_str_eq(out, "back\n");
+}